@@ -0,0 +1,317 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "../history.h"
+#include "../historyimageitem.h"
+#include "../historyjournal.h"
+#include "../historymodel.h"
+#include "../historystringitem.h"
+#include "../historyurlitem.h"
+#include "../urlgrabber.h"
+
+#include <QMimeData>
+#include <QTemporaryDir>
+#include <QtTest>
+
+class HistoryBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkInsert_data();
+    void benchmarkInsert();
+    void benchmarkDedupe_data();
+    void benchmarkDedupe();
+    void benchmarkMoveToTop_data();
+    void benchmarkMoveToTop();
+
+    void benchmarkSave_data();
+    void benchmarkSave();
+    void benchmarkSaveIncremental_data();
+    void benchmarkSaveIncremental();
+    void benchmarkLoad_data();
+    void benchmarkLoad();
+
+    void benchmarkMatchingActions_data();
+    void benchmarkMatchingActions();
+
+    void benchmarkClipboardStorm_data();
+    void benchmarkClipboardStorm();
+
+private:
+    static void addSizes();
+    static QVector<HistoryItemPtr> textItems(int count);
+    /**
+     * Texts, URLs and small images in equal parts
+     */
+    static QVector<HistoryItemPtr> mixedItems(int count);
+    static QVector<HistoryItemConstPtr> constItems(const QVector<HistoryItemPtr> &items);
+    static ActionList actions();
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_fileName;
+};
+
+void HistoryBenchmark::initTestCase()
+{
+    // URLGrabber reads KlipperSettings
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void HistoryBenchmark::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    QVERIFY(m_dir->isValid());
+    m_fileName = m_dir->filePath(QStringLiteral("history.journal"));
+}
+
+void HistoryBenchmark::addSizes()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+}
+
+QVector<HistoryItemPtr> HistoryBenchmark::textItems(int count)
+{
+    QVector<HistoryItemPtr> items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        items.append(HistoryItemPtr(new HistoryStringItem(QStringLiteral("clipboard entry number %1").arg(i))));
+    }
+    return items;
+}
+
+QVector<HistoryItemPtr> HistoryBenchmark::mixedItems(int count)
+{
+    QVector<HistoryItemPtr> items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        switch (i % 3) {
+        case 0:
+            items.append(HistoryItemPtr(new HistoryStringItem(QStringLiteral("Some copied text %1, ").arg(i).repeated(1 + i % 20))));
+            break;
+        case 1:
+            items.append(HistoryItemPtr(new HistoryURLItem({QUrl(QStringLiteral("https://kde.org/page/%1").arg(i))}, KUrlMimeData::MetaDataMap(), false)));
+            break;
+        case 2: {
+            QImage image(64, 64, QImage::Format_RGB32);
+            image.fill(QColor::fromRgb(QRandomGenerator::global()->generate()));
+            image.setPixel(0, 0, i);
+            items.append(HistoryItemPtr(new HistoryImageItem(QPixmap::fromImage(image))));
+            break;
+        }
+        }
+    }
+    return items;
+}
+
+QVector<HistoryItemConstPtr> HistoryBenchmark::constItems(const QVector<HistoryItemPtr> &items)
+{
+    QVector<HistoryItemConstPtr> result;
+    result.reserve(items.size());
+    for (const auto &item : items) {
+        result.append(item);
+    }
+    return result;
+}
+
+ActionList HistoryBenchmark::actions()
+{
+    // a mix of what users tend to configure, only few of them match any given text
+    ActionList actions;
+    for (int i = 0; i < 10; ++i) {
+        actions << new ClipAction(QStringLiteral("^https?://[^/]*example%1\\.org/.*").arg(i), QStringLiteral("Web %1").arg(i));
+        actions << new ClipAction(QStringLiteral("^/home/[^ ]+\\.(png|jpe?g|svg)%1$").arg(i), QStringLiteral("Image %1").arg(i));
+        actions << new ClipAction(QStringLiteral("^[A-Z]+-%1[0-9]+$").arg(i), QStringLiteral("Ticket %1").arg(i));
+        actions << new ClipAction(QStringLiteral("^mailto:.*@host%1\\..*").arg(i), QStringLiteral("Mail %1").arg(i));
+        actions << new ClipAction(QStringLiteral("^[a-f0-9]{40}%1$").arg(i), QStringLiteral("Commit %1").arg(i));
+    }
+    return actions;
+}
+
+void HistoryBenchmark::benchmarkInsert_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkInsert()
+{
+    QFETCH(int, size);
+    const QVector<HistoryItemPtr> items = textItems(size);
+    QBENCHMARK {
+        HistoryModel model;
+        model.setMaxSize(size);
+        for (const auto &item : items) {
+            model.insert(item);
+        }
+    }
+}
+
+void HistoryBenchmark::benchmarkDedupe_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkDedupe()
+{
+    QFETCH(int, size);
+    HistoryModel model;
+    model.setMaxSize(size);
+    const QVector<HistoryItemPtr> items = textItems(size);
+    for (const auto &item : items) {
+        model.insert(item);
+    }
+    // copying something which is in the history already, it has to be found and moved up
+    int i = 0;
+    QBENCHMARK {
+        model.insert(HistoryItemPtr(new HistoryStringItem(QStringLiteral("clipboard entry number %1").arg(i))));
+        i = (i + 7) % size;
+    }
+    QCOMPARE(model.rowCount(), size);
+}
+
+void HistoryBenchmark::benchmarkMoveToTop_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkMoveToTop()
+{
+    QFETCH(int, size);
+    HistoryModel model;
+    model.setMaxSize(size);
+    const QVector<HistoryItemPtr> items = textItems(size);
+    for (const auto &item : items) {
+        model.insert(item);
+    }
+    QBENCHMARK {
+        model.moveToTop(model.index(size - 1).data(Qt::UserRole + 1).toByteArray());
+    }
+}
+
+void HistoryBenchmark::benchmarkSave_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkSave()
+{
+    // what Klipper::saveHistory does after starting with an empty history
+    QFETCH(int, size);
+    const QVector<HistoryItemConstPtr> items = constItems(mixedItems(size));
+    QBENCHMARK {
+        QFile::remove(m_fileName);
+        HistoryJournal journal(m_fileName);
+        QVERIFY(journal.sync(items));
+    }
+}
+
+void HistoryBenchmark::benchmarkSaveIncremental_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkSaveIncremental()
+{
+    // what Klipper::saveHistory does after something got copied
+    QFETCH(int, size);
+    QVector<HistoryItemConstPtr> items = constItems(mixedItems(size));
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync(items));
+    int i = 0;
+    QBENCHMARK {
+        items.prepend(HistoryItemConstPtr(new HistoryStringItem(QStringLiteral("new entry %1").arg(i++))));
+        items.removeLast();
+        QVERIFY(journal.sync(items));
+    }
+}
+
+void HistoryBenchmark::benchmarkLoad_data()
+{
+    addSizes();
+}
+
+void HistoryBenchmark::benchmarkLoad()
+{
+    // what Klipper::loadHistory does
+    QFETCH(int, size);
+    {
+        HistoryJournal journal(m_fileName);
+        QVERIFY(journal.sync(constItems(mixedItems(size))));
+    }
+    QBENCHMARK {
+        History history(nullptr);
+        history.setMaxSize(size);
+        HistoryJournal journal(m_fileName);
+        QVector<HistoryItemPtr> items;
+        QVERIFY(journal.load(items));
+        for (auto it = items.crbegin(); it != items.crend(); ++it) {
+            history.forceInsert(*it);
+        }
+        QCOMPARE(history.model()->rowCount(), size);
+    }
+}
+
+void HistoryBenchmark::benchmarkMatchingActions_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::newRow("no match") << QStringLiteral("Just some text somebody copied from a document");
+    QTest::newRow("url") << QStringLiteral("https://www.example5.org/some/page.html");
+    QTest::newRow("ticket") << QStringLiteral("BUG-312345");
+    QTest::newRow("long text") << QStringLiteral("Lorem ipsum dolor sit amet. ").repeated(100);
+}
+
+void HistoryBenchmark::benchmarkMatchingActions()
+{
+    QFETCH(QString, text);
+    History history(nullptr);
+    URLGrabber grabber(&history);
+    grabber.setActionList(actions());
+    QCOMPARE(grabber.actionList().count(), 50);
+    QBENCHMARK {
+        grabber.matchingActions(text, true);
+    }
+}
+
+void HistoryBenchmark::benchmarkClipboardStorm_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("20") << 20;
+    QTest::newRow("2048") << 2048;
+}
+
+void HistoryBenchmark::benchmarkClipboardStorm()
+{
+    // Dragging a selection over a paragraph changes the selection with every mouse move.
+    // Each change goes through the same steps as in Klipper::checkClipData.
+    QFETCH(int, size);
+    History history(nullptr);
+    history.setMaxSize(size);
+    for (const auto &item : mixedItems(size)) {
+        history.forceInsert(item);
+    }
+    URLGrabber grabber(&history);
+    grabber.setActionList(actions());
+
+    const QString paragraph = QStringLiteral("The quick brown fox jumps over the lazy dog, see https://example3.org/fox for details. ").repeated(10);
+    QBENCHMARK {
+        for (int length = 1; length <= paragraph.length(); length += 3) {
+            QMimeData data;
+            data.setText(paragraph.left(length));
+            HistoryItemPtr item = HistoryItem::create(&data);
+            history.insert(item);
+            grabber.matchingActions(item->text().trimmed(), true);
+        }
+    }
+    QCOMPARE(history.model()->rowCount(), size);
+}
+
+QTEST_MAIN(HistoryBenchmark)
+#include "historybenchmark.moc"
@@ -0,0 +1,313 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "../historyimageitem.h"
+#include "../historyjournal.h"
+#include "../historymodel.h"
+#include "../historystringitem.h"
+
+#include <QTemporaryDir>
+#include <QtTest>
+
+class HistoryJournalTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void init();
+    void testRoundTrip();
+    void testAppendOnly();
+    void testRemove();
+    void testCorruptTail();
+    void testUnreadable();
+    void testCompact();
+    void testClear();
+    void testLazyString();
+    void testLazyImage();
+    void testThumbnail();
+    void testLateThumbnail();
+
+private:
+    static QVector<HistoryItemConstPtr> items(const QStringList &texts);
+    static QStringList texts(const QVector<HistoryItemPtr> &items);
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_fileName;
+};
+
+QVector<HistoryItemConstPtr> HistoryJournalTest::items(const QStringList &texts)
+{
+    QVector<HistoryItemConstPtr> result;
+    for (const QString &text : texts) {
+        result.append(HistoryItemConstPtr(new HistoryStringItem(text)));
+    }
+    return result;
+}
+
+QStringList HistoryJournalTest::texts(const QVector<HistoryItemPtr> &items)
+{
+    QStringList result;
+    for (const auto &item : items) {
+        result.append(item->text());
+    }
+    return result;
+}
+
+void HistoryJournalTest::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    QVERIFY(m_dir->isValid());
+    m_fileName = m_dir->filePath(QStringLiteral("history.journal"));
+}
+
+void HistoryJournalTest::testRoundTrip()
+{
+    const QStringList expected{QStringLiteral("foo"), QStringLiteral("bar"), QStringLiteral("foobar")};
+    HistoryJournal journal(m_fileName);
+    QVector<HistoryItemPtr> loaded;
+    QVERIFY(!journal.load(loaded));
+    QVERIFY(journal.sync(items(expected)));
+
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(texts(loaded), expected);
+}
+
+void HistoryJournalTest::testAppendOnly()
+{
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync(items({QStringLiteral("foo"), QStringLiteral("bar")})));
+    QFile file(m_fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray before = file.readAll();
+    file.close();
+
+    // moving an item to the top must not rewrite anything
+    QVERIFY(journal.sync(items({QStringLiteral("bar"), QStringLiteral("foo")})));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray after = file.readAll();
+    file.close();
+    QVERIFY(after.size() > before.size());
+    QVERIFY(after.startsWith(before));
+
+    // nothing changed, nothing to write
+    QVERIFY(journal.sync(items({QStringLiteral("bar"), QStringLiteral("foo")})));
+    QCOMPARE(QFileInfo(m_fileName).size(), qint64(after.size()));
+
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("bar"), QStringLiteral("foo")}));
+}
+
+void HistoryJournalTest::testRemove()
+{
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync(items({QStringLiteral("foo"), QStringLiteral("bar"), QStringLiteral("foobar")})));
+    QVERIFY(journal.sync(items({QStringLiteral("foobar"), QStringLiteral("foo")})));
+
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("foobar"), QStringLiteral("foo")}));
+
+    // and a journal picked up from disk continues where the old one stopped
+    QVERIFY(other.sync(items({QStringLiteral("bar"), QStringLiteral("foobar")})));
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("bar"), QStringLiteral("foobar")}));
+}
+
+void HistoryJournalTest::testCorruptTail()
+{
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync(items({QStringLiteral("foo")})));
+    const qint64 goodSize = QFileInfo(m_fileName).size();
+    QVERIFY(journal.sync(items({QStringLiteral("bar"), QStringLiteral("foo")})));
+
+    // simulate a crash in the middle of the last append
+    QVERIFY(QFile::resize(m_fileName, QFileInfo(m_fileName).size() - 3));
+
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    // the bar item made it, but the order record got torn
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("foo")}));
+    QVERIFY(QFileInfo(m_fileName).size() > goodSize);
+
+    // appending after recovery works
+    QVERIFY(other.sync(items({QStringLiteral("bar"), QStringLiteral("foo")})));
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("bar"), QStringLiteral("foo")}));
+}
+
+void HistoryJournalTest::testUnreadable()
+{
+    // e.g. written by a newer version
+    const QByteArray garbage("not a journal we know");
+    QFile file(m_fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(garbage), qint64(garbage.size()));
+    file.close();
+
+    HistoryJournal journal(m_fileName);
+    QVector<HistoryItemPtr> loaded;
+    QVERIFY(!journal.load(loaded));
+
+    // it must be left alone
+    QVERIFY(!journal.sync(items({QStringLiteral("foo")})));
+    QVERIFY(!journal.compact(items({QStringLiteral("foo")})));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), garbage);
+    file.close();
+
+    // unless it gets cleared on purpose
+    QVERIFY(journal.clear());
+    QVERIFY(journal.sync(items({QStringLiteral("foo")})));
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("foo")}));
+}
+
+void HistoryJournalTest::testCompact()
+{
+    HistoryJournal journal(m_fileName);
+    QStringList texts;
+    for (int i = 0; i < 100; ++i) {
+        texts.prepend(QString::number(i));
+        QVERIFY(journal.sync(items(texts)));
+    }
+    const qint64 before = QFileInfo(m_fileName).size();
+    QVERIFY(journal.compact(items(texts)));
+    QVERIFY(QFileInfo(m_fileName).size() < before);
+
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(HistoryJournalTest::texts(loaded), texts);
+
+    // appending after compaction works
+    texts.prepend(QStringLiteral("foo"));
+    QVERIFY(journal.sync(items(texts)));
+    QVERIFY(other.load(loaded));
+    QCOMPARE(HistoryJournalTest::texts(loaded), texts);
+}
+
+void HistoryJournalTest::testClear()
+{
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync(items({QStringLiteral("foo")})));
+    QVERIFY(QFile::exists(m_fileName));
+    QVERIFY(journal.clear());
+    QVERIFY(!QFile::exists(m_fileName));
+
+    QVERIFY(journal.sync(items({QStringLiteral("bar")})));
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(texts(loaded), QStringList({QStringLiteral("bar")}));
+}
+
+void HistoryJournalTest::testLazyString()
+{
+    const QString longText(10000, QLatin1Char('a'));
+    const HistoryItemConstPtr item(new HistoryStringItem(longText));
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync({item}));
+
+    QVector<HistoryItemPtr> loaded;
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(loaded.count(), 1);
+    QCOMPARE(loaded.first()->uuid(), item->uuid());
+    QCOMPARE(loaded.first()->text(), item->text());
+    QScopedPointer<QMimeData> mimeData(loaded.first()->mimeData());
+    QCOMPARE(mimeData->text(), longText);
+
+    // rewriting a lazy item keeps the full text
+    QVERIFY(journal.compact({loaded.first()}));
+    QVERIFY(journal.load(loaded));
+    mimeData.reset(loaded.first()->mimeData());
+    QCOMPARE(mimeData->text(), longText);
+}
+
+void HistoryJournalTest::testLazyImage()
+{
+    QImage image(64, 32, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    const HistoryItemConstPtr item(new HistoryImageItem(QPixmap::fromImage(image)));
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync({item}));
+
+    QVector<HistoryItemPtr> loaded;
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(loaded.count(), 1);
+    QCOMPARE(loaded.first()->uuid(), item->uuid());
+    // the description is known without decoding the image
+    QCOMPARE(loaded.first()->text(), item->text());
+
+    HistoryModel model;
+    model.setMaxSize(10);
+    model.insert(loaded.first());
+    QCOMPARE(loaded.first()->image().size(), QSize(64, 32));
+    QScopedPointer<QMimeData> mimeData(loaded.first()->mimeData());
+    QCOMPARE(qvariant_cast<QImage>(mimeData->imageData()).pixelColor(0, 0), QColor(Qt::red));
+}
+
+void HistoryJournalTest::testThumbnail()
+{
+    QImage image(2000, 1000, QImage::Format_RGB32);
+    image.fill(Qt::blue);
+    auto item = QSharedPointer<HistoryImageItem>::create(QPixmap::fromImage(image));
+    QVERIFY(item->needsThumbnail());
+    item->setThumbnail(item->createThumbnail().result());
+    QCOMPARE(item->thumbnail().size(), QSize(512, 256));
+    QVERIFY(!item->needsThumbnail());
+
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync({item}));
+    QVector<HistoryItemPtr> loaded;
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(loaded.count(), 1);
+    auto loadedImage = loaded.first().dynamicCast<HistoryImageItem>();
+    QVERIFY(loadedImage);
+    // the thumbnail is there without decoding the image
+    QCOMPARE(loadedImage->thumbnail().size(), QSize(512, 256));
+    QCOMPARE(loadedImage->memoryCost(), qint64(loadedImage->thumbnail().sizeInBytes()));
+
+    HistoryModel model;
+    model.setMaxSize(10);
+    model.insert(loadedImage);
+    QCOMPARE(model.index(0).data(Qt::DecorationRole).value<QPixmap>().size(), QSize(512, 256));
+    QScopedPointer<QMimeData> mimeData(loadedImage->mimeData());
+    QCOMPARE(qvariant_cast<QImage>(mimeData->imageData()).size(), QSize(2000, 1000));
+}
+
+void HistoryJournalTest::testLateThumbnail()
+{
+    QImage image(2000, 1000, QImage::Format_RGB32);
+    image.fill(Qt::blue);
+    auto item = QSharedPointer<HistoryImageItem>::create(QPixmap::fromImage(image));
+
+    // saved before the thumbnail was done
+    HistoryJournal journal(m_fileName);
+    QVERIFY(journal.sync({item}));
+    QVERIFY(item->needsThumbnail());
+    item->setThumbnail(item->createThumbnail().result());
+
+    QVERIFY(journal.sync({item}));
+    QVector<HistoryItemPtr> loaded;
+    HistoryJournal other(m_fileName);
+    QVERIFY(other.load(loaded));
+    QCOMPARE(loaded.count(), 1);
+    auto loadedImage = loaded.first().dynamicCast<HistoryImageItem>();
+    QVERIFY(loadedImage);
+    QCOMPARE(loadedImage->thumbnail().size(), QSize(512, 256));
+
+    // and it's kept when compacting
+    QVERIFY(other.compact({loadedImage}));
+    QVERIFY(journal.load(loaded));
+    QCOMPARE(loaded.first().dynamicCast<HistoryImageItem>()->thumbnail().size(), QSize(512, 256));
+}
+
+QTEST_MAIN(HistoryJournalTest)
+#include "historyjournaltest.moc"
@@ -22,6 +22,12 @@ private Q_SLOTS:
     void testIndexOf();
     void testType_data();
     void testType();
+    void testLargeHistory_data();
+    void testLargeHistory();
+    void testMemoryBudget();
+    void testSearch();
+    void testThumbnail();
+    void testImageUuid();
 };
 
 void HistoryModelTest::testSetMaxSize()
@@ -232,5 +238,201 @@ void HistoryModelTest::testType()
     QCOMPARE(history->index(0).data(Qt::UserRole + 2).value<HistoryItemType>(), expectedType);
 }
 
+void HistoryModelTest::testLargeHistory_data()
+{
+    QTest::addColumn<int>("maxSize");
+    QTest::newRow("2048") << 2048;
+    QTest::newRow("10000") << 10000;
+}
+
+void HistoryModelTest::testLargeHistory()
+{
+    QFETCH(int, maxSize);
+    QScopedPointer<HistoryModel> history(new HistoryModel(nullptr));
+    history->setMaxSize(maxSize);
+
+    auto verifyIndex = [&history]() {
+        for (int i = 0; i < history->rowCount(); ++i) {
+            const QByteArray uuid = history->index(i).data(Qt::UserRole + 1).toByteArray();
+            if (history->indexOf(uuid).row() != i) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // overflow the history, so the oldest ones get dropped
+    const int count = maxSize + maxSize / 2;
+    for (int i = 0; i < count; ++i) {
+        history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QString::number(i))));
+    }
+    QCOMPARE(history->rowCount(), maxSize);
+    QVERIFY(verifyIndex());
+    QCOMPARE(history->index(0).data().toString(), QString::number(count - 1));
+    QVERIFY(!history->indexOf(QCryptographicHash::hash(QByteArrayLiteral("0"), QCryptographicHash::Sha1)).isValid());
+
+    // duplicates move to the top, from both halves of the history
+    for (int i = count - 1; i >= count - maxSize; i -= 97) {
+        const QString text = QString::number(i);
+        history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(text)));
+        QCOMPARE(history->index(0).data().toString(), text);
+        QCOMPARE(history->rowCount(), maxSize);
+    }
+    QVERIFY(verifyIndex());
+
+    history->moveTopToBack();
+    history->moveTopToBack();
+    history->moveBackToTop();
+    QVERIFY(verifyIndex());
+
+    // remove from top, middle and bottom
+    const QByteArray topUuid = history->index(0).data(Qt::UserRole + 1).toByteArray();
+    QVERIFY(history->remove(topUuid));
+    QVERIFY(!history->indexOf(topUuid).isValid());
+    QVERIFY(history->removeRows(maxSize / 3, 10));
+    QVERIFY(history->removeRows(history->rowCount() - 5, 5));
+    QCOMPARE(history->rowCount(), maxSize - 16);
+    QVERIFY(verifyIndex());
+
+    // shrinking drops the tail
+    history->setMaxSize(maxSize / 4);
+    QCOMPARE(history->rowCount(), maxSize / 4);
+    QVERIFY(verifyIndex());
+}
+
+void HistoryModelTest::testMemoryBudget()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QScopedPointer<HistoryModel> history(new HistoryModel(nullptr));
+    history->setMaxSize(10);
+    // room for about two of the images
+    history->setMemoryBudget(2 * 100 * 100 * 4 + 100);
+    history->setSpillToDisk(true);
+
+    QVector<QColor> colors{Qt::red, Qt::green, Qt::blue, Qt::yellow};
+    for (const QColor &color : colors) {
+        QImage image(100, 100, QImage::Format_ARGB32);
+        image.fill(color);
+        history->insert(QSharedPointer<HistoryItem>(new HistoryImageItem(QPixmap::fromImage(image))));
+    }
+    QCOMPARE(history->rowCount(), 4);
+    QVERIFY(history->memoryUsage().value(HistoryItemType::Image) <= history->memoryBudget());
+
+    // the current item stays in memory, the oldest ones got evicted
+    auto item = [&history](int row) {
+        return history->index(row).data(Qt::UserRole).value<HistoryItemConstPtr>();
+    };
+    QVERIFY(item(0)->memoryCost() > 0);
+    QCOMPARE(item(3)->memoryCost(), qint64(0));
+
+    // evicted items come back from disk
+    for (int i = 0; i < colors.count(); ++i) {
+        QScopedPointer<QMimeData> mimeData(item(colors.count() - 1 - i)->mimeData());
+        QCOMPARE(qvariant_cast<QImage>(mimeData->imageData()).pixelColor(50, 50), colors.at(i));
+    }
+
+    // without spilling, only items which already have a copy on disk can be evicted
+    history->setSpillToDisk(false);
+    history->setMemoryBudget(1);
+    const QString longText(10000, QLatin1Char('a'));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(longText)));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("foo"))));
+    QCOMPARE(item(1)->memoryCost(), qint64(longText.size() * sizeof(QChar)));
+    QCOMPARE(history->memoryUsage().value(HistoryItemType::Text), qint64((longText.size() + 3) * sizeof(QChar)));
+    // only the last image never went to disk
+    QCOMPARE(history->memoryUsage().value(HistoryItemType::Image), qint64(100 * 100 * 4));
+
+    // lifting the limit keeps everything
+    history->setMemoryBudget(0);
+    for (int i = 0; i < history->rowCount(); ++i) {
+        QScopedPointer<QMimeData> mimeData(item(i)->mimeData());
+    }
+    history->enforceMemoryBudget();
+    QVERIFY(item(history->rowCount() - 1)->memoryCost() > 0);
+}
+
+void HistoryModelTest::testSearch()
+{
+    QScopedPointer<HistoryModel> history(new HistoryModel(nullptr));
+    history->setMaxSize(4);
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("Hello World"))));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("foo bar"))));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("world peace"))));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryURLItem({QUrl(QStringLiteral("http://kde.org/world"))}, KUrlMimeData::MetaDataMap(), false)));
+
+    // rows in ascending order
+    QCOMPARE(history->search(QStringLiteral("world")), QVector<int>({0, 1, 3}));
+    QCOMPARE(history->search(QStringLiteral("World"), Qt::CaseSensitive), QVector<int>({3}));
+    QCOMPARE(history->search(QStringLiteral("o w")), QVector<int>({3}));
+    // queries shorter than a trigram
+    QCOMPARE(history->search(QStringLiteral("ba")), QVector<int>({2}));
+    QCOMPARE(history->search(QString()), QVector<int>({0, 1, 2, 3}));
+    QVERIFY(history->search(QStringLiteral("worlds")).isEmpty());
+    QVERIFY(history->search(QStringLiteral("xyz")).isEmpty());
+
+    // the index follows moves, removals and items dropping out of the history
+    history->moveToTop(QCryptographicHash::hash(QByteArrayLiteral("Hello World"), QCryptographicHash::Sha1));
+    QCOMPARE(history->search(QStringLiteral("hello")), QVector<int>({0}));
+    QVERIFY(history->remove(QCryptographicHash::hash(QByteArrayLiteral("world peace"), QCryptographicHash::Sha1)));
+    QCOMPARE(history->search(QStringLiteral("world")), QVector<int>({0, 1}));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("peace"))));
+    history->insert(QSharedPointer<HistoryItem>(new HistoryStringItem(QStringLiteral("bar baz"))));
+    QCOMPARE(history->search(QStringLiteral("bar")), QVector<int>({0}));
+    QCOMPARE(history->search(QStringLiteral("peace")), QVector<int>({1}));
+
+    history->clear();
+    QVERIFY(history->search(QStringLiteral("peace")).isEmpty());
+}
+
+void HistoryModelTest::testThumbnail()
+{
+    QScopedPointer<HistoryModel> history(new HistoryModel(nullptr));
+    history->setMaxSize(10);
+    QSignalSpy dataChangedSpy(history.data(), &HistoryModel::dataChanged);
+
+    // small images are shown as they are
+    QImage small(100, 50, QImage::Format_RGB32);
+    small.fill(Qt::red);
+    history->insert(QSharedPointer<HistoryItem>(new HistoryImageItem(QPixmap::fromImage(small))));
+    QCOMPARE(history->index(0).data(Qt::DecorationRole).value<QPixmap>().size(), QSize(100, 50));
+
+    // large ones get a thumbnail created in the background
+    QImage large(1000, 3000, QImage::Format_RGB32);
+    large.fill(Qt::green);
+    const QSharedPointer<HistoryItem> item(new HistoryImageItem(QPixmap::fromImage(large)));
+    history->insert(item);
+    QVERIFY(dataChangedSpy.wait());
+    QCOMPARE(dataChangedSpy.count(), 1);
+    QCOMPARE(dataChangedSpy.first().at(0).toModelIndex(), history->index(0));
+    QCOMPARE(dataChangedSpy.first().at(2).value<QVector<int>>(), QVector<int>({Qt::DecorationRole}));
+    const QPixmap thumbnail = history->index(0).data(Qt::DecorationRole).value<QPixmap>();
+    QCOMPARE(thumbnail.size(), QSize(170, 512));
+    QCOMPARE(thumbnail.toImage().pixelColor(50, 50), QColor(Qt::green));
+
+    // while the clipboard still gets the original
+    QScopedPointer<QMimeData> mimeData(item->mimeData());
+    QCOMPARE(qvariant_cast<QImage>(mimeData->imageData()).size(), QSize(1000, 3000));
+}
+
+void HistoryModelTest::testImageUuid()
+{
+    QImage original(640, 480, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < original.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(original.scanLine(y));
+        for (int x = 0; x < original.width(); ++x) {
+            line[x] = qRgb((x * 7) ^ y, (y * 13) ^ x, (x + y) & 0xff);
+        }
+    }
+    QImage copy = original.copy();
+    QCOMPARE(HistoryImageItem::computeUuid(copy), HistoryImageItem::computeUuid(original));
+
+    copy.setPixel(320, 240, qRgb(1, 2, 3));
+    QVERIFY(HistoryImageItem::computeUuid(copy) != HistoryImageItem::computeUuid(original));
+
+    // same pixels, different shape
+    const QImage reshaped(original.constBits(), 480, 640, QImage::Format_ARGB32_Premultiplied);
+    QVERIFY(HistoryImageItem::computeUuid(reshaped) != HistoryImageItem::computeUuid(original));
+}
+
 QTEST_MAIN(HistoryModelTest)
 #include "historymodeltest.moc"
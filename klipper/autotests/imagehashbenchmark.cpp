@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+
+#include "../historyimageitem.h"
+
+#include <QCryptographicHash>
+#include <QtTest>
+
+class ImageHashBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void benchmarkSha1Png_data();
+    void benchmarkSha1Png();
+    void benchmarkPixelHash_data();
+    void benchmarkPixelHash();
+
+private:
+    static void addImages();
+    static QImage image(const QSize &size);
+};
+
+QImage ImageHashBenchmark::image(const QSize &size)
+{
+    // something which doesn't compress too well, like a screenshot with text
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            line[x] = qRgb((x * 7) ^ y, (y * 13) ^ x, (x + y) & 0xff);
+        }
+    }
+    return image;
+}
+
+void ImageHashBenchmark::addImages()
+{
+    QTest::addColumn<QImage>("image");
+    QTest::newRow("1080p") << image(QSize(1920, 1080));
+    QTest::newRow("4K") << image(QSize(3840, 2160));
+}
+
+void ImageHashBenchmark::benchmarkSha1Png_data()
+{
+    addImages();
+}
+
+void ImageHashBenchmark::benchmarkSha1Png()
+{
+    // what HistoryImageItem used to do
+    QFETCH(QImage, image);
+    const QPixmap pixmap = QPixmap::fromImage(image);
+    QBENCHMARK {
+        QByteArray buffer;
+        QDataStream out(&buffer, QIODevice::WriteOnly);
+        out << pixmap;
+        QCryptographicHash::hash(buffer, QCryptographicHash::Sha1);
+    }
+}
+
+void ImageHashBenchmark::benchmarkPixelHash_data()
+{
+    addImages();
+}
+
+void ImageHashBenchmark::benchmarkPixelHash()
+{
+    QFETCH(QImage, image);
+    const QPixmap pixmap = QPixmap::fromImage(image);
+    QBENCHMARK {
+        HistoryImageItem::computeUuid(pixmap.toImage());
+    }
+}
+
+QTEST_MAIN(ImageHashBenchmark)
+#include "imagehashbenchmark.moc"
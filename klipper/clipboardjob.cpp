@@ -7,6 +7,7 @@
 #include "clipboardjob.h"
 #include "history.h"
 #include "historyitem.h"
+#include "historymodel.h"
 #include "klipper.h"
 
 #include "klipper_debug.h"
@@ -41,6 +42,17 @@ void ClipboardJob::start()
         m_klipper->slotConfigure();
         setResult(true);
         return;
+    } else if (operation == QLatin1String("search")) {
+        // the uuids of the matching items as in the model's UuidRole, youngest first
+        HistoryModel *model = m_klipper->history()->model();
+        const QVector<int> rows = model->search(parameters().value(QStringLiteral("query")).toString());
+        QStringList uuids;
+        uuids.reserve(rows.count());
+        for (int row : rows) {
+            uuids << model->index(row).data(Qt::UserRole + 3).toString();
+        }
+        setResult(uuids);
+        return;
     }
 
     // other operations need the item
@@ -7,35 +7,189 @@
 #include "historyimageitem.h"
 
 #include "historymodel.h"
+#include "historypayloadcache.h"
 
-#include <QCryptographicHash>
 #include <QIcon>
 #include <QMimeData>
+#include <QtConcurrent>
+#include <QtEndian>
 
 #include <KLocalizedString>
 
 namespace
 {
-QByteArray compute_uuid(const QPixmap &data)
+// Large enough for the popup and the applet on high dpi screens
+const QSize s_thumbnailSize(512, 512);
+
+QImage scaledThumbnail(const QImage &image)
+{
+    return image.scaled(s_thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+// XXH64 (https://github.com/Cyan4973/xxHash), we don't need a cryptographic hash to tell images apart
+const quint64 s_prime1 = 11400714785074694791ULL;
+const quint64 s_prime2 = 14029467366897019727ULL;
+const quint64 s_prime3 = 1609587929392839161ULL;
+const quint64 s_prime4 = 9650029242287828579ULL;
+const quint64 s_prime5 = 2870177450012600261ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 accumulate(quint64 acc, quint64 input)
+{
+    acc += input * s_prime2;
+    return rotl(acc, 31) * s_prime1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+    acc ^= accumulate(0, val);
+    return acc * s_prime1 + s_prime4;
+}
+
+quint64 xxh64(const uchar *p, qsizetype len, quint64 seed)
 {
-    QByteArray buffer;
-    QDataStream out(&buffer, QIODevice::WriteOnly);
-    out << data;
-    return QCryptographicHash::hash(buffer, QCryptographicHash::Sha1);
+    const uchar *const end = p + len;
+    quint64 h;
+
+    if (len >= 32) {
+        const uchar *const limit = end - 32;
+        quint64 v1 = seed + s_prime1 + s_prime2;
+        quint64 v2 = seed + s_prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - s_prime1;
+        do {
+            v1 = accumulate(v1, qFromLittleEndian<quint64>(p));
+            v2 = accumulate(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = accumulate(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = accumulate(v4, qFromLittleEndian<quint64>(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + s_prime5;
+    }
+
+    h += quint64(len);
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= accumulate(0, qFromLittleEndian<quint64>(p));
+        h = rotl(h, 27) * s_prime1 + s_prime4;
+    }
+    if (p + 4 <= end) {
+        h ^= quint64(qFromLittleEndian<quint32>(p)) * s_prime1;
+        h = rotl(h, 23) * s_prime2 + s_prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= (*p) * s_prime5;
+        h = rotl(h, 11) * s_prime1;
+    }
+
+    h ^= h >> 33;
+    h *= s_prime2;
+    h ^= h >> 29;
+    h *= s_prime3;
+    h ^= h >> 32;
+    return h;
 }
 
 }
 
+QByteArray HistoryImageItem::computeUuid(const QImage &image)
+{
+    // Hash the pixels as they are in memory, encoding them first (as QDataStream does
+    // with PNG) costs way more than the hashing itself for large images.
+    quint64 hash = (quint64(image.width()) << 32) | quint64(image.height());
+    hash = xxh64(reinterpret_cast<const uchar *>(&hash), sizeof(hash), image.format());
+    // Only hash the used part of each scan line, the padding is undefined
+    const qsizetype lineLength = (qsizetype(image.width()) * image.depth() + 7) / 8;
+    for (int y = 0; y < image.height(); ++y) {
+        hash = xxh64(image.constScanLine(y), lineLength, hash);
+    }
+    hash = qToBigEndian(hash);
+    return QByteArray(reinterpret_cast<const char *>(&hash), sizeof(hash));
+}
+
 HistoryImageItem::HistoryImageItem(const QPixmap &data)
-    : HistoryItem(compute_uuid(data))
+    : HistoryItem(computeUuid(data.toImage()))
     , m_data(data)
+    , m_size(data.size())
+    , m_depth(data.depth())
+{
+}
+
+HistoryImageItem::HistoryImageItem(const QByteArray &uuid, const QSize &size, int depth, const HistoryPayloadPtr &payload, const QImage &thumbnail)
+    : HistoryItem(uuid)
+    , m_size(size)
+    , m_depth(depth)
+    , m_payload(payload)
+    , m_thumbnail(thumbnail)
+{
+}
+
+QImage HistoryImageItem::thumbnail() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_thumbnail;
+}
+
+void HistoryImageItem::setThumbnail(const QImage &thumbnail)
+{
+    QMutexLocker lock(&m_mutex);
+    m_thumbnail = thumbnail;
+    m_thumbnailPixmap = QPixmap();
+}
+
+bool HistoryImageItem::needsThumbnail() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_thumbnail.isNull() && (m_size.width() > s_thumbnailSize.width() || m_size.height() > s_thumbnailSize.height());
+}
+
+QFuture<QImage> HistoryImageItem::createThumbnail() const
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_data.isNull()) {
+        // QPixmap is not to be used outside of the GUI thread, QImage is
+        return QtConcurrent::run(scaledThumbnail, m_data.toImage());
+    }
+    // don't keep the decoded image around, only the thumbnail is needed
+    const HistoryPayloadPtr payload = m_payload;
+    return QtConcurrent::run([payload] {
+        QImage image;
+        if (payload) {
+            QDataStream stream(payload->data());
+            QString type;
+            stream >> type >> image;
+        }
+        return image.isNull() ? QImage() : scaledThumbnail(image);
+    });
+}
+
+const QPixmap &HistoryImageItem::pixmap() const
 {
+    QMutexLocker lock(&m_mutex);
+    if (m_data.isNull() && m_payload) {
+        QDataStream stream(m_payload->data());
+        QString type;
+        stream >> type >> m_data;
+    }
+    touch();
+    return m_data;
 }
 
 QString HistoryImageItem::text() const
 {
     if (m_text.isNull()) {
-        m_text = QStringLiteral("▨ ") + i18n("%1x%2 %3bpp", m_data.width(), m_data.height(), m_data.depth());
+        m_text = QStringLiteral("▨ ") + i18n("%1x%2 %3bpp", m_size.width(), m_size.height(), m_depth);
     }
     return m_text;
 }
@@ -43,20 +197,74 @@ QString HistoryImageItem::text() const
 /* virtual */
 void HistoryImageItem::write(QDataStream &stream) const
 {
+    QMutexLocker lock(&m_mutex);
+    if (m_payload) {
+        // already serialized, no need to decode and encode it again
+        const QByteArray data = m_payload->data();
+        stream.writeRawData(data.constData(), data.size());
+        return;
+    }
     stream << QStringLiteral("image") << m_data;
 }
 
+qint64 HistoryImageItem::memoryCost() const
+{
+    QMutexLocker lock(&m_mutex);
+    // the thumbnail stays, but it counts against the budget as well
+    qint64 cost = m_thumbnail.sizeInBytes();
+    if (!m_data.isNull()) {
+        cost += qint64(m_data.width()) * m_data.height() * m_data.depth() / 8;
+    }
+    return cost;
+}
+
+qint64 HistoryImageItem::evict(bool spill)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_data.isNull()) {
+        return 0;
+    }
+    if (!m_payload) {
+        if (!spill) {
+            return 0;
+        }
+        // Encoding and writing the image takes a while, don't keep the save thread waiting for it
+        const QPixmap pixmap = m_data;
+        lock.unlock();
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << QStringLiteral("image") << pixmap;
+        const HistoryPayloadPtr payload = HistoryPayloadCache::spill(data);
+        lock.relock();
+        if (!payload || m_data.cacheKey() != pixmap.cacheKey()) {
+            return 0;
+        }
+        if (!m_payload) {
+            m_payload = payload;
+        }
+    }
+    const qint64 cost = qint64(m_data.width()) * m_data.height() * m_data.depth() / 8;
+    m_data = QPixmap();
+    return cost;
+}
+
 QMimeData *HistoryImageItem::mimeData() const
 {
     QMimeData *data = new QMimeData();
-    data->setImageData(m_data.toImage());
+    data->setImageData(pixmap().toImage());
     return data;
 }
 
 const QPixmap &HistoryImageItem::image() const
 {
     if (m_model->displayImages()) {
-        return m_data;
+        if (m_thumbnailPixmap.isNull()) {
+            m_thumbnailPixmap = QPixmap::fromImage(thumbnail());
+        }
+        if (!m_thumbnailPixmap.isNull()) {
+            return m_thumbnailPixmap;
+        }
+        return pixmap();
     }
     static QPixmap imageIcon(QIcon::fromTheme(QStringLiteral("view-preview")).pixmap(QSize(48, 48)));
     return imageIcon;
@@ -6,6 +6,10 @@
 
 #pragma once
 
+#include <QFuture>
+#include <QImage>
+#include <QMutex>
+
 #include "historyitem.h"
 
 /**
@@ -15,6 +19,11 @@ class HistoryImageItem : public HistoryItem
 {
 public:
     explicit HistoryImageItem(const QPixmap &data);
+    /**
+     * Creates an item whose pixmap only gets decoded from @p payload
+     * once it is needed. A @p thumbnail is shown in its place meanwhile.
+     */
+    HistoryImageItem(const QByteArray &uuid, const QSize &size, int depth, const HistoryPayloadPtr &payload, const QImage &thumbnail = QImage());
     ~HistoryImageItem() override
     {
     }
@@ -26,16 +35,72 @@ public:
         }
         return false;
     }
+    /**
+     * The thumbnail if there is one, the full image otherwise.
+     * Use mimeData() to get the original.
+     */
     const QPixmap &image() const override;
     QMimeData *mimeData() const override;
 
     void write(QDataStream &stream) const override;
 
+    qint64 memoryCost() const override;
+    qint64 evict(bool spill) override;
+
+    QSize size() const
+    {
+        return m_size;
+    }
+    int depth() const
+    {
+        return m_depth;
+    }
+
+    /**
+     * A downscaled copy of the image. Null if the image is small enough
+     * to be shown as it is or the thumbnail was not created yet.
+     */
+    QImage thumbnail() const;
+    void setThumbnail(const QImage &thumbnail);
+
+    /**
+     * Whether the image is too large to be shown as it is, but has no thumbnail yet
+     */
+    bool needsThumbnail() const;
+
+    /**
+     * Downscales the image in a worker thread, the result is meant for setThumbnail().
+     * Must be called from the GUI thread.
+     */
+    QFuture<QImage> createThumbnail() const;
+
+    /**
+     * Identifies an image by its dimensions, format and pixels.
+     * This is a fast, non-cryptographic hash, good enough to tell
+     * clipboard contents apart.
+     */
+    static QByteArray computeUuid(const QImage &image);
+
 private:
+    const QPixmap &pixmap() const;
+
     /**
      *
      */
-    const QPixmap m_data;
+    mutable QPixmap m_data;
+    const QSize m_size;
+    const int m_depth;
+    /**
+     * Where m_data gets decoded from, if it was not passed in directly
+     * or got evicted. Guarded by m_mutex.
+     */
+    HistoryPayloadPtr m_payload;
+    mutable QMutex m_mutex;
+    /**
+     * Guarded by m_mutex
+     */
+    QImage m_thumbnail;
+    mutable QPixmap m_thumbnailPixmap;
     /**
      * Cache for m_data's string representation
      */
@@ -6,6 +6,7 @@
 #include "historyitem.h"
 
 #include "klipper_debug.h"
+#include <QAtomicInteger>
 #include <QMap>
 
 #include <kurlmimedata.h>
@@ -15,10 +16,16 @@
 #include "historystringitem.h"
 #include "historyurlitem.h"
 
+namespace
+{
+QAtomicInteger<quint64> s_useCounter;
+}
+
 HistoryItem::HistoryItem(const QByteArray &uuid)
     : m_model(nullptr)
     , m_uuid(uuid)
 {
+    touch();
 }
 
 HistoryItem::~HistoryItem()
@@ -119,3 +126,19 @@ void HistoryItem::setModel(HistoryModel *model)
 {
     m_model = model;
 }
+
+qint64 HistoryItem::memoryCost() const
+{
+    return 0;
+}
+
+qint64 HistoryItem::evict(bool spill)
+{
+    Q_UNUSED(spill)
+    return 0;
+}
+
+void HistoryItem::touch() const
+{
+    m_lastUsed.storeRelaxed(s_useCounter.fetchAndAddRelaxed(1));
+}
@@ -5,6 +5,7 @@
 */
 #pragma once
 
+#include <QAtomicInteger>
 #include <QPixmap>
 
 class HistoryModel;
@@ -15,6 +16,24 @@ class QDataStream;
 class HistoryItem;
 typedef QSharedPointer<HistoryItem> HistoryItemPtr;
 typedef QSharedPointer<const HistoryItem> HistoryItemConstPtr;
+
+/**
+ * The serialized form of a history item (as produced by HistoryItem::write())
+ * which is kept outside of the item, e.g. in a memory-mapped file.
+ * Items holding one only decode it when their data is actually needed.
+ */
+class HistoryPayload
+{
+public:
+    virtual ~HistoryPayload() = default;
+
+    /**
+     * The serialized item. The returned data may point into memory
+     * owned by the payload, so it must not outlive it.
+     */
+    virtual QByteArray data() const = 0;
+};
+typedef QSharedPointer<const HistoryPayload> HistoryPayloadPtr;
 /**
  * An entry in the clipboard history.
  */
@@ -88,11 +107,42 @@ public:
 
     void setModel(HistoryModel *model);
 
+    /**
+     * @return bytes of item data currently held in memory
+     */
+    virtual qint64 memoryCost() const;
+
+    /**
+     * Drops the in-memory data of this item if it can be restored later on.
+     * Items which were not loaded from disk can only be evicted if
+     * @p spill allows writing them out to the disk cache.
+     * @return bytes freed
+     */
+    virtual qint64 evict(bool spill);
+
+    /**
+     * Increases every time some item's data is accessed,
+     * the least recently used items have the lowest value.
+     */
+    quint64 lastUsed() const
+    {
+        return m_lastUsed.loadRelaxed();
+    }
+
 protected:
+    /**
+     * Marks the item as most recently used
+     */
+    void touch() const;
+
     HistoryModel *m_model;
 
 private:
     QByteArray m_uuid;
+    /**
+     * Touched from the GUI thread as well as while saving
+     */
+    mutable QAtomicInteger<quint64> m_lastUsed;
 };
 
 inline const QPixmap &HistoryItem::image() const
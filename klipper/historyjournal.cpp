@@ -0,0 +1,524 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "historyjournal.h"
+
+#include <limits>
+#include <zlib.h>
+
+#include <QDataStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSet>
+
+#include "historyimageitem.h"
+#include "historyitem.h"
+#include "historystringitem.h"
+#include "klipper_debug.h"
+
+namespace
+{
+const quint32 s_magic = 0x4b4c504a; // "KLPJ"
+// 2: adds IndexedItemRecord
+// 3: adds the thumbnail to indexed image records
+const quint32 s_version = 3;
+const qint64 s_headerSize = 2 * sizeof(quint32);
+// type + payload length + payload crc
+const qint64 s_recordHeaderSize = sizeof(quint8) + 2 * sizeof(quint32);
+// Don't bother compacting small journals, rewriting them is cheap but pointless
+const qint64 s_minCompactionSize = 1024 * 1024;
+// Strings smaller than this are decoded right away, a lazy item would not save anything
+const int s_lazyThreshold = 4096;
+
+quint32 checksum(const QByteArray &data)
+{
+    return crc32(0, reinterpret_cast<const unsigned char *>(data.constData()), data.size());
+}
+
+QByteArray fileHeader()
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << s_magic << s_version;
+    return header;
+}
+}
+
+class HistoryJournal::Mapping
+{
+public:
+    explicit Mapping(const QString &fileName)
+        : m_file(fileName)
+    {
+        if (!m_file.open(QIODevice::ReadOnly) || m_file.size() > std::numeric_limits<int>::max()) {
+            return;
+        }
+        m_size = m_file.size();
+        m_data = m_file.map(0, m_size);
+    }
+    ~Mapping()
+    {
+        if (m_data) {
+            m_file.unmap(m_data);
+        }
+    }
+
+    QString errorString() const
+    {
+        return m_file.errorString();
+    }
+
+    QByteArray bytes(qint64 offset, int size) const
+    {
+        if (!m_data || offset + size > m_size) {
+            return QByteArray();
+        }
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(m_data) + offset, size);
+    }
+
+    QByteArray bytes() const
+    {
+        return bytes(0, m_size);
+    }
+
+private:
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+};
+
+namespace
+{
+/**
+ * An item payload in the memory-mapped journal. Mapped pages are only read in
+ * once the item gets decoded and are backed by the file, so they can be
+ * dropped again by the kernel at any time.
+ */
+class MappedPayload : public HistoryPayload
+{
+public:
+    MappedPayload(const QSharedPointer<const HistoryJournal::Mapping> &mapping, qint64 offset, int size)
+        : m_mapping(mapping)
+        , m_offset(offset)
+        , m_size(size)
+    {
+    }
+
+    QByteArray data() const override
+    {
+        return m_mapping->bytes(m_offset, m_size);
+    }
+
+private:
+    const QSharedPointer<const HistoryJournal::Mapping> m_mapping;
+    const qint64 m_offset;
+    const int m_size;
+};
+}
+
+HistoryJournal::HistoryJournal(const QString &fileName)
+    : m_fileName(fileName)
+{
+}
+
+HistoryJournal::~HistoryJournal()
+{
+}
+
+QByteArray HistoryJournal::itemRecord(const HistoryItem &item)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << item.uuid();
+    // Put what's needed to show the item in front of the payload, so it can be loaded lazily
+    if (auto image = dynamic_cast<const HistoryImageItem *>(&item)) {
+        stream << QStringLiteral("image") << image->size() << qint32(image->depth()) << image->thumbnail();
+    } else if (dynamic_cast<const HistoryStringItem *>(&item)) {
+        stream << QStringLiteral("string") << item.text();
+    } else {
+        item.write(stream);
+        return record(ItemRecord, payload);
+    }
+    item.write(stream);
+    return record(IndexedItemRecord, payload);
+}
+
+bool HistoryJournal::hasThumbnail(const HistoryItem &item)
+{
+    auto image = dynamic_cast<const HistoryImageItem *>(&item);
+    return image && !image->thumbnail().isNull();
+}
+
+bool HistoryJournal::isOutdated(const HistoryItem &item, const RecordRef &ref)
+{
+    return !ref.hasThumbnail && hasThumbnail(item);
+}
+
+QByteArray HistoryJournal::record(RecordType type, const QByteArray &payload)
+{
+    QByteArray data;
+    data.reserve(s_recordHeaderSize + payload.size());
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << quint8(type) << quint32(payload.size()) << checksum(payload);
+    data.append(payload);
+    return data;
+}
+
+void HistoryJournal::reset()
+{
+    m_file.close();
+    m_fileSize = 0;
+    m_fileVersion = 0;
+    m_needsCompaction = false;
+    m_items.clear();
+    m_order.clear();
+    m_orderSize = 0;
+}
+
+bool HistoryJournal::load(QVector<QSharedPointer<HistoryItem>> &items)
+{
+    static const char failed_load_warning[] = "Failed to load history journal.";
+    reset();
+    m_readOnly = false;
+
+    if (QFileInfo(m_fileName).size() == 0) {
+        return false;
+    }
+    // Until it's been read there is no telling what we would throw away by writing to it
+    m_readOnly = true;
+    // Item payloads are not decoded here, the items keep the mapping alive and page them in when needed
+    auto mapping = QSharedPointer<const Mapping>::create(m_fileName);
+    const QByteArray data = mapping->bytes();
+    if (data.isEmpty()) {
+        qCWarning(KLIPPER_LOG) << failed_load_warning << mapping->errorString();
+        return false;
+    }
+
+    QDataStream stream(data);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != s_magic || version < 1 || version > s_version) {
+        qCWarning(KLIPPER_LOG) << failed_load_warning << "Unknown file format";
+        return false;
+    }
+    // appending new records to an older format would make it unreadable for the old version
+    // while still claiming to be that version, so rewrite it with the next sync
+    m_needsCompaction = version != s_version;
+    m_fileVersion = version;
+
+    QHash<QByteArray, QSharedPointer<HistoryItem>> restored;
+    qint64 goodEnd = s_headerSize;
+    while (!stream.atEnd()) {
+        const qint64 offset = stream.device()->pos();
+        quint8 type = 0;
+        quint32 length = 0;
+        quint32 crc = 0;
+        stream >> type >> length >> crc;
+        const qint64 payloadOffset = offset + s_recordHeaderSize;
+        if (stream.status() != QDataStream::Ok || length > data.size() - payloadOffset) {
+            break;
+        }
+        const QByteArray payload = mapping->bytes(payloadOffset, length);
+        if (checksum(payload) != crc) {
+            break;
+        }
+        stream.skipRawData(length);
+        const RecordRef ref{offset, s_recordHeaderSize + length};
+        goodEnd = offset + ref.size;
+
+        QDataStream payloadStream(payload);
+        switch (type) {
+        case ItemRecord: {
+            QByteArray uuid;
+            payloadStream >> uuid;
+            HistoryItemPtr item = HistoryItem::create(payloadStream);
+            if (item) {
+                restored.insert(uuid, item);
+                m_items.insert(uuid, ref);
+            }
+            break;
+        }
+        case IndexedItemRecord: {
+            QByteArray uuid;
+            QString itemType;
+            QString preview;
+            QSize size;
+            qint32 depth = 0;
+            QImage thumbnail;
+            payloadStream >> uuid >> itemType;
+            if (itemType == QLatin1String("image")) {
+                payloadStream >> size >> depth;
+                if (version >= 3) {
+                    payloadStream >> thumbnail;
+                }
+            } else {
+                payloadStream >> preview;
+            }
+            const qint64 bodyOffset = payloadStream.device()->pos();
+            auto body = QSharedPointer<MappedPayload>::create(mapping, payloadOffset + bodyOffset, int(length - bodyOffset));
+            HistoryItemPtr item;
+            if (itemType == QLatin1String("image")) {
+                item.reset(new HistoryImageItem(uuid, size, depth, body, thumbnail));
+            } else if (itemType == QLatin1String("string") && length - bodyOffset > s_lazyThreshold) {
+                item.reset(new HistoryStringItem(uuid, preview, body));
+            } else {
+                QDataStream bodyStream(body->data());
+                item = HistoryItem::create(bodyStream);
+            }
+            if (item) {
+                restored.insert(uuid, item);
+                m_items.insert(uuid, RecordRef{ref.offset, ref.size, !thumbnail.isNull()});
+            }
+            break;
+        }
+        case RemoveRecord: {
+            QByteArray uuid;
+            payloadStream >> uuid;
+            restored.remove(uuid);
+            m_items.remove(uuid);
+            break;
+        }
+        case OrderRecord:
+            payloadStream >> m_order;
+            m_orderSize = ref.size;
+            break;
+        default:
+            qCWarning(KLIPPER_LOG) << failed_load_warning << "Skipping unknown record type" << type;
+            break;
+        }
+    }
+
+    if (goodEnd < data.size()) {
+        qCWarning(KLIPPER_LOG) << "History journal has a corrupt tail, dropping" << (data.size() - goodEnd) << "bytes";
+        // nothing we hand out points behind goodEnd, so it's safe to cut it off while mapped
+        if (!QFile::resize(m_fileName, goodEnd)) {
+            qCWarning(KLIPPER_LOG) << failed_load_warning << "Could not truncate journal";
+        }
+    }
+    m_fileSize = goodEnd;
+    m_readOnly = false;
+
+    items.clear();
+    items.reserve(m_order.size());
+    for (const QByteArray &uuid : qAsConst(m_order)) {
+        if (auto item = restored.value(uuid)) {
+            items.append(item);
+        }
+    }
+    return true;
+}
+
+bool HistoryJournal::openForAppend()
+{
+    if (m_file.isOpen()) {
+        return true;
+    }
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(KLIPPER_LOG) << "Failed to open history journal" << m_file.errorString();
+        return false;
+    }
+    if (m_fileSize < s_headerSize) {
+        // There is no journal yet, or just an empty file. Don't truncate it in place,
+        // someone might still have it mapped.
+        m_file.close();
+        QFile::remove(m_fileName);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qCWarning(KLIPPER_LOG) << "Failed to open history journal" << m_file.errorString();
+            return false;
+        }
+        m_items.clear();
+        m_order.clear();
+        m_orderSize = 0;
+        m_fileVersion = s_version;
+        if (m_file.write(fileHeader()) != s_headerSize) {
+            m_file.close();
+            return false;
+        }
+    }
+    m_fileSize = m_file.size();
+    return true;
+}
+
+bool HistoryJournal::append(const QByteArray &data, RecordRef *ref)
+{
+    if (m_file.write(data) != data.size()) {
+        qCWarning(KLIPPER_LOG) << "Failed to append to history journal" << m_file.errorString();
+        // we can't tell how much made it to disk, start over next time
+        reset();
+        return false;
+    }
+    if (ref) {
+        ref->offset = m_fileSize;
+        ref->size = data.size();
+    }
+    m_fileSize += data.size();
+    return true;
+}
+
+bool HistoryJournal::needsCompaction() const
+{
+    qint64 live = s_headerSize + m_orderSize;
+    for (const RecordRef &ref : m_items) {
+        live += ref.size;
+    }
+    const qint64 dead = m_fileSize - live;
+    return m_needsCompaction || (dead > s_minCompactionSize && dead > live);
+}
+
+bool HistoryJournal::sync(const QVector<QSharedPointer<const HistoryItem>> &items)
+{
+    if (m_readOnly) {
+        qCWarning(KLIPPER_LOG) << "History journal could not be read, not writing to it";
+        return false;
+    }
+    if (m_fileSize < s_headerSize && QFileInfo(m_fileName).size() > 0) {
+        // We lost track of what's in the file after a failed write, replace it as a whole
+        return compact(items);
+    }
+    if (m_fileSize >= s_headerSize && m_fileVersion != s_version) {
+        // don't mix records of different versions in one file
+        return compact(items);
+    }
+    if (!openForAppend()) {
+        return false;
+    }
+
+    QVector<QByteArray> order;
+    order.reserve(items.size());
+    QSet<QByteArray> current;
+    current.reserve(items.size());
+    for (const auto &item : items) {
+        const QByteArray &uuid = item->uuid();
+        order.append(uuid);
+        current.insert(uuid);
+        const auto existing = m_items.constFind(uuid);
+        // a later record of an item replaces the earlier one when loading
+        if (existing != m_items.constEnd() && !isOutdated(*item, existing.value())) {
+            continue;
+        }
+        RecordRef ref;
+        if (!append(itemRecord(*item), &ref)) {
+            return false;
+        }
+        ref.hasThumbnail = hasThumbnail(*item);
+        m_items.insert(uuid, ref);
+    }
+
+    for (auto it = m_items.begin(); it != m_items.end();) {
+        if (current.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << it.key();
+        if (!append(record(RemoveRecord, payload))) {
+            return false;
+        }
+        it = m_items.erase(it);
+    }
+
+    if (order != m_order) {
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << order;
+        RecordRef ref;
+        if (!append(record(OrderRecord, payload), &ref)) {
+            return false;
+        }
+        m_order = order;
+        m_orderSize = ref.size;
+    }
+
+    if (!m_file.flush()) {
+        qCWarning(KLIPPER_LOG) << "Failed to write history journal" << m_file.errorString();
+        reset();
+        return false;
+    }
+
+    if (needsCompaction()) {
+        return compact(items);
+    }
+    return true;
+}
+
+bool HistoryJournal::compact(const QVector<QSharedPointer<const HistoryItem>> &items)
+{
+    static const char failed_compact_warning[] = "Failed to compact history journal.";
+    if (m_readOnly) {
+        qCWarning(KLIPPER_LOG) << failed_compact_warning << "It could not be read";
+        return false;
+    }
+    m_file.close();
+
+    // live payloads are copied over verbatim, there is no need to decode and re-encode them
+    QFile oldFile(m_fileName);
+    const bool haveOldFile = oldFile.open(QIODevice::ReadOnly);
+
+    QSaveFile newFile(m_fileName);
+    if (!newFile.open(QIODevice::WriteOnly)) {
+        qCWarning(KLIPPER_LOG) << failed_compact_warning << newFile.errorString();
+        return false;
+    }
+
+    QHash<QByteArray, RecordRef> newItems;
+    newItems.reserve(items.size());
+    QVector<QByteArray> order;
+    order.reserve(items.size());
+    qint64 pos = newFile.write(fileHeader());
+
+    for (const auto &item : items) {
+        const QByteArray &uuid = item->uuid();
+        order.append(uuid);
+        QByteArray data;
+        const RecordRef oldRef = m_items.value(uuid);
+        // records of older versions need to be brought up to date
+        if (haveOldFile && m_fileVersion == s_version && oldRef.size > 0 && oldFile.seek(oldRef.offset)) {
+            data = oldFile.read(oldRef.size);
+        }
+        bool thumbnail = oldRef.hasThumbnail;
+        if (data.size() != oldRef.size || oldRef.size == 0 || isOutdated(*item, oldRef)) {
+            data = itemRecord(*item);
+            thumbnail = hasThumbnail(*item);
+        }
+        newItems.insert(uuid, RecordRef{pos, data.size(), thumbnail});
+        pos += newFile.write(data);
+    }
+
+    QByteArray orderPayload;
+    QDataStream stream(&orderPayload, QIODevice::WriteOnly);
+    stream << order;
+    const QByteArray orderRecord = record(OrderRecord, orderPayload);
+    pos += newFile.write(orderRecord);
+    oldFile.close();
+
+    if (!newFile.commit()) {
+        qCWarning(KLIPPER_LOG) << failed_compact_warning << newFile.errorString();
+        // the old file is still intact, but we no longer know what we appended to it
+        reset();
+        return false;
+    }
+
+    m_items = newItems;
+    m_needsCompaction = false;
+    m_fileVersion = s_version;
+    m_order = order;
+    m_orderSize = orderRecord.size();
+    m_fileSize = pos;
+    return true;
+}
+
+bool HistoryJournal::clear()
+{
+    reset();
+    m_readOnly = false;
+    if (QFile::exists(m_fileName) && !QFile::remove(m_fileName)) {
+        qCWarning(KLIPPER_LOG) << "Failed to remove history journal" << m_fileName;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class HistoryItem;
+
+/**
+ * Append-only on-disk store for the clipboard history.
+ *
+ * Every item payload is written exactly once as its own checksummed record.
+ * Later changes to the history only append small records: a tombstone for
+ * items which got dropped and the uuids of the current order. Once the
+ * superseded records outweigh the live ones the journal is compacted into a
+ * fresh file, copying the live payloads over without decoding them.
+ *
+ * Images and long texts are not decoded when loading. The journal is
+ * memory-mapped and those items only page in and decode their payload
+ * once it is actually needed.
+ *
+ * A torn record at the end of the file (e.g. after a crash in the middle of
+ * an append) fails its checksum and is cut off when loading.
+ */
+class HistoryJournal
+{
+public:
+    class Mapping;
+
+    explicit HistoryJournal(const QString &fileName);
+    ~HistoryJournal();
+
+    QString fileName() const
+    {
+        return m_fileName;
+    }
+
+    /**
+     * Streams the journal from disk.
+     * If there is a journal which can't be read, it is left alone and
+     * sync() and compact() fail until it is cleared.
+     * @param items receives the restored items, youngest first
+     * @return false if there is no usable journal
+     */
+    bool load(QVector<QSharedPointer<HistoryItem>> &items);
+
+    /**
+     * Brings the journal in line with @p items (youngest first), only
+     * appending what changed since the last sync.
+     */
+    bool sync(const QVector<QSharedPointer<const HistoryItem>> &items);
+
+    /**
+     * Rewrites the journal so it only contains @p items.
+     */
+    bool compact(const QVector<QSharedPointer<const HistoryItem>> &items);
+
+    /**
+     * Removes the journal from disk.
+     */
+    bool clear();
+
+private:
+    enum RecordType : quint8 {
+        ItemRecord = 1,
+        RemoveRecord = 2,
+        OrderRecord = 3,
+        /**
+         * An item with the data needed to display it in front of its payload
+         */
+        IndexedItemRecord = 4,
+    };
+    struct RecordRef {
+        qint64 offset = 0;
+        qint64 size = 0;
+        /**
+         * An image record with its thumbnail
+         */
+        bool hasThumbnail = false;
+    };
+
+    bool openForAppend();
+    bool append(const QByteArray &data, RecordRef *ref = nullptr);
+    bool needsCompaction() const;
+    void reset();
+
+    static QByteArray itemRecord(const HistoryItem &item);
+    static bool hasThumbnail(const HistoryItem &item);
+    /**
+     * Whether the record of @p item needs to be written again, because its
+     * thumbnail was only created after the record.
+     */
+    static bool isOutdated(const HistoryItem &item, const RecordRef &ref);
+    static QByteArray record(RecordType type, const QByteArray &payload);
+
+    QString m_fileName;
+    QFile m_file;
+    qint64 m_fileSize = 0;
+    /**
+     * Item records in the current file which are still part of the history
+     */
+    QHash<QByteArray, RecordRef> m_items;
+    QVector<QByteArray> m_order;
+    qint64 m_orderSize = 0;
+    bool m_needsCompaction = false;
+    /**
+     * Format version of the records in the current file
+     */
+    quint32 m_fileVersion = 0;
+    /**
+     * The journal exists but could not be read, so it must not be written either
+     */
+    bool m_readOnly = false;
+};
@@ -9,12 +9,24 @@
 #include "historystringitem.h"
 #include "historyurlitem.h"
 
+#include <QFutureWatcher>
+#include <QTimer>
+
+#include <algorithm>
+
 HistoryModel::HistoryModel(QObject *parent)
     : QAbstractListModel(parent)
+    , m_rowOffset(0)
     , m_maxSize(0)
     , m_displayImages(true)
+    , m_memoryBudget(0)
+    , m_spillToDisk(false)
+    , m_budgetTimer(new QTimer(this))
     , m_mutex(QMutex::Recursive)
 {
+    m_budgetTimer->setSingleShot(true);
+    m_budgetTimer->setInterval(0);
+    connect(m_budgetTimer, &QTimer::timeout, this, &HistoryModel::enforceMemoryBudget);
 }
 
 HistoryModel::~HistoryModel()
@@ -27,6 +39,9 @@ void HistoryModel::clear()
     QMutexLocker lock(&m_mutex);
     beginResetModel();
     m_items.clear();
+    m_rows.clear();
+    m_rowOffset = 0;
+    m_searchIndex.clear();
     endResetModel();
 }
 
@@ -42,6 +57,71 @@ void HistoryModel::setMaxSize(int size)
     }
 }
 
+void HistoryModel::setMemoryBudget(qint64 bytes)
+{
+    if (m_memoryBudget == bytes) {
+        return;
+    }
+    m_memoryBudget = bytes;
+    enforceMemoryBudget();
+}
+
+QMap<HistoryItemType, qint64> HistoryModel::memoryUsage() const
+{
+    QMap<HistoryItemType, qint64> usage{{HistoryItemType::Text, 0}, {HistoryItemType::Image, 0}, {HistoryItemType::Url, 0}};
+    for (const auto &item : m_items) {
+        usage[typeOf(item.data())] += item->memoryCost();
+    }
+    return usage;
+}
+
+void HistoryModel::enforceMemoryBudget()
+{
+    if (m_memoryBudget <= 0) {
+        return;
+    }
+    qint64 used = 0;
+    QVector<HistoryItemPtr> candidates;
+    {
+        QMutexLocker lock(&m_mutex);
+        for (const auto &item : qAsConst(m_items)) {
+            used += item->memoryCost();
+        }
+        if (used <= m_memoryBudget) {
+            return;
+        }
+
+        // the current clipboard content has to stay around
+        candidates.reserve(m_items.count());
+        for (int i = 1; i < m_items.count(); ++i) {
+            candidates.append(m_items.at(i));
+        }
+    }
+
+    // Spilling writes to the disk, don't block the save thread meanwhile
+    std::sort(candidates.begin(), candidates.end(), [](const HistoryItemPtr &a, const HistoryItemPtr &b) {
+        return a->lastUsed() < b->lastUsed();
+    });
+    for (const HistoryItemPtr &item : qAsConst(candidates)) {
+        if (used <= m_memoryBudget) {
+            break;
+        }
+        used -= item->evict(m_spillToDisk);
+    }
+}
+
+HistoryItemType HistoryModel::typeOf(const HistoryItem *item)
+{
+    if (dynamic_cast<const HistoryStringItem *>(item)) {
+        return HistoryItemType::Text;
+    } else if (dynamic_cast<const HistoryImageItem *>(item)) {
+        return HistoryItemType::Image;
+    } else if (dynamic_cast<const HistoryURLItem *>(item)) {
+        return HistoryItemType::Url;
+    }
+    return HistoryItemType::Text;
+}
+
 int HistoryModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid()) {
@@ -57,19 +137,16 @@ QVariant HistoryModel::data(const QModelIndex &index, int role) const
     }
 
     QSharedPointer<HistoryItem> item = m_items.at(index.row());
-    HistoryItemType type = HistoryItemType::Text;
-    if (dynamic_cast<HistoryStringItem *>(item.data())) {
-        type = HistoryItemType::Text;
-    } else if (dynamic_cast<HistoryImageItem *>(item.data())) {
-        type = HistoryItemType::Image;
-    } else if (dynamic_cast<HistoryURLItem *>(item.data())) {
-        type = HistoryItemType::Url;
-    }
+    const HistoryItemType type = typeOf(item.data());
 
     switch (role) {
     case Qt::DisplayRole:
         return item->text();
     case Qt::DecorationRole:
+        // showing an image might have paged it back in
+        if (m_memoryBudget > 0) {
+            m_budgetTimer->start();
+        }
         return item->image();
     case Qt::UserRole:
         return QVariant::fromValue<HistoryItemConstPtr>(qSharedPointerConstCast<const HistoryItem>(item));
@@ -96,7 +173,14 @@ bool HistoryModel::removeRows(int row, int count, const QModelIndex &parent)
     QMutexLocker lock(&m_mutex);
     beginRemoveRows(QModelIndex(), row, row + count - 1);
     for (int i = 0; i < count; ++i) {
-        m_items.removeAt(row);
+        const QByteArray uuid = m_items.takeAt(row)->uuid();
+        m_rows.remove(uuid);
+        m_searchIndex.remove(uuid);
+    }
+    if (row == 0) {
+        m_rowOffset -= count;
+    } else {
+        updateRows(row, m_items.count() - 1);
     }
     endRemoveRows();
     return true;
@@ -113,12 +197,18 @@ bool HistoryModel::remove(const QByteArray &uuid)
 
 QModelIndex HistoryModel::indexOf(const QByteArray &uuid) const
 {
-    for (int i = 0; i < m_items.count(); ++i) {
-        if (m_items.at(i)->uuid() == uuid) {
-            return index(i);
-        }
+    const auto it = m_rows.constFind(uuid);
+    if (it == m_rows.constEnd()) {
+        return QModelIndex();
+    }
+    return index(*it + m_rowOffset);
+}
+
+void HistoryModel::updateRows(int first, int last)
+{
+    for (int i = first; i <= last; ++i) {
+        m_rows[m_items.at(i)->uuid()] = i - m_rowOffset;
     }
-    return QModelIndex();
 }
 
 QModelIndex HistoryModel::indexOf(const HistoryItem *item) const
@@ -149,14 +239,62 @@ void HistoryModel::insert(QSharedPointer<HistoryItem> item)
             return;
         }
         beginRemoveRows(QModelIndex(), m_items.count() - 1, m_items.count() - 1);
-        m_items.removeLast();
+        const QByteArray uuid = m_items.takeLast()->uuid();
+        m_rows.remove(uuid);
+        m_searchIndex.remove(uuid);
         endRemoveRows();
     }
 
     beginInsertRows(QModelIndex(), 0, 0);
     item->setModel(this);
     m_items.prepend(item);
+    // shifts all existing rows down by one
+    ++m_rowOffset;
+    updateRows(0, 0);
+    m_searchIndex.insert(item->uuid(), item->text());
     endInsertRows();
+
+    createThumbnail(item);
+    enforceMemoryBudget();
+}
+
+void HistoryModel::createThumbnail(const QSharedPointer<HistoryItem> &item)
+{
+    auto image = dynamic_cast<const HistoryImageItem *>(item.data());
+    if (!image || !image->needsThumbnail()) {
+        return;
+    }
+    auto watcher = new QFutureWatcher<QImage>(this);
+    const QWeakPointer<HistoryItem> weakItem = item;
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, weakItem] {
+        watcher->deleteLater();
+        const auto item = weakItem.toStrongRef();
+        if (!item) {
+            return;
+        }
+        {
+            // the history may be being saved in another thread
+            QMutexLocker lock(&m_mutex);
+            static_cast<HistoryImageItem *>(item.data())->setThumbnail(watcher->result());
+        }
+        const QModelIndex index = indexOf(item->uuid());
+        if (index.isValid()) {
+            emit dataChanged(index, index, {Qt::DecorationRole});
+        }
+    });
+    watcher->setFuture(image->createThumbnail());
+}
+
+QVector<int> HistoryModel::search(const QString &query, Qt::CaseSensitivity cs) const
+{
+    const QSet<QByteArray> matches = m_searchIndex.search(query, cs);
+    QVector<int> rows;
+    rows.reserve(matches.size());
+    for (const QByteArray &uuid : matches) {
+        rows.append(m_rows.value(uuid) + m_rowOffset);
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
 }
 
 void HistoryModel::moveToTop(const QByteArray &uuid)
@@ -176,6 +314,14 @@ void HistoryModel::moveToTop(int row)
     QMutexLocker lock(&m_mutex);
     beginMoveRows(QModelIndex(), row, row, QModelIndex(), 0);
     m_items.move(row, 0);
+    // rows 0..row shifted down by one, only touch whichever side is shorter
+    if (row < m_items.count() / 2) {
+        updateRows(0, row);
+    } else {
+        ++m_rowOffset;
+        updateRows(0, 0);
+        updateRows(row + 1, m_items.count() - 1);
+    }
     endMoveRows();
 }
 
@@ -188,6 +334,9 @@ void HistoryModel::moveTopToBack()
     beginMoveRows(QModelIndex(), 0, 0, QModelIndex(), m_items.count());
     auto item = m_items.takeFirst();
     m_items.append(item);
+    // everything else moved up by one
+    --m_rowOffset;
+    updateRows(m_items.count() - 1, m_items.count() - 1);
     endMoveRows();
 }
 
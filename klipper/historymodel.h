@@ -6,9 +6,13 @@
 #pragma once
 
 #include <QAbstractListModel>
+#include <QMap>
 #include <QMutex>
 
+#include "historysearchindex.h"
+
 class HistoryItem;
+class QTimer;
 
 enum class HistoryItemType {
     Text,
@@ -34,6 +38,33 @@ public:
     bool displayImages() const;
     void setDisplayImages(bool show);
 
+    /**
+     * Limits the bytes of item data held in memory. Once the history grows
+     * beyond it, the least recently used items get evicted; they are read
+     * back from disk when needed. 0 disables the limit.
+     */
+    qint64 memoryBudget() const;
+    void setMemoryBudget(qint64 bytes);
+
+    /**
+     * Whether items which are only held in memory may be written to the
+     * disk cache to evict them. Otherwise only items loaded from the
+     * saved history can be evicted.
+     */
+    bool spillToDisk() const;
+    void setSpillToDisk(bool spill);
+
+    /**
+     * @return bytes of item data currently held in memory, per item type
+     */
+    QMap<HistoryItemType, qint64> memoryUsage() const;
+
+    /**
+     * Evicts items until the memory budget is met again.
+     * The current clipboard content is never evicted.
+     */
+    void enforceMemoryBudget();
+
     void clear();
     void moveToTop(const QByteArray &uuid);
     void moveTopToBack();
@@ -44,16 +75,40 @@ public:
 
     void insert(QSharedPointer<HistoryItem> item);
 
+    /**
+     * @return rows of all items whose text contains @p query, in ascending order
+     */
+    QVector<int> search(const QString &query, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
     QMutex *mutex()
     {
         return &m_mutex;
     }
 
 private:
+    static HistoryItemType typeOf(const HistoryItem *item);
+    /**
+     * Downscales large images off-thread, the thumbnail is shown in their place
+     */
+    void createThumbnail(const QSharedPointer<HistoryItem> &item);
     void moveToTop(int row);
+    void updateRows(int first, int last);
     QList<QSharedPointer<HistoryItem>> m_items;
+    /**
+     * uuid -> row index. Rows are stored relative to m_rowOffset, so
+     * shifting all of them (inserting at or removing from the top) is O(1).
+     */
+    QHash<QByteArray, int> m_rows;
+    int m_rowOffset;
+    HistorySearchIndex m_searchIndex;
     int m_maxSize;
     bool m_displayImages;
+    qint64 m_memoryBudget;
+    bool m_spillToDisk;
+    /**
+     * Enforces the memory budget once control returns to the event loop
+     */
+    QTimer *m_budgetTimer;
     QMutex m_mutex;
 };
 
@@ -72,4 +127,19 @@ inline void HistoryModel::setDisplayImages(bool show)
     m_displayImages = show;
 }
 
+inline qint64 HistoryModel::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+inline bool HistoryModel::spillToDisk() const
+{
+    return m_spillToDisk;
+}
+
+inline void HistoryModel::setSpillToDisk(bool spill)
+{
+    m_spillToDisk = spill;
+}
+
 Q_DECLARE_METATYPE(HistoryItemType)
@@ -0,0 +1,85 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "historypayloadcache.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+
+#include <errno.h>
+#include <signal.h>
+
+#include "klipper_debug.h"
+
+namespace
+{
+class SpilledPayload : public HistoryPayload
+{
+public:
+    explicit SpilledPayload(const QString &fileName)
+        : m_fileName(fileName)
+    {
+    }
+    ~SpilledPayload() override
+    {
+        QFile::remove(m_fileName);
+    }
+
+    QByteArray data() const override
+    {
+        QFile file(m_fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qCWarning(KLIPPER_LOG) << "Failed to read back evicted clipboard item" << file.errorString();
+            return QByteArray();
+        }
+        return qUncompress(file.readAll());
+    }
+
+private:
+    const QString m_fileName;
+};
+
+QString cacheDir()
+{
+    static const QString dir = [] {
+        // not the application specific location, klipper also runs inside plasmashell
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/klipper/evicted");
+        QDir().mkpath(path);
+
+        // clean up after instances which didn't exit cleanly, files are prefixed with the owner's pid
+        const QStringList files = QDir(path).entryList(QDir::Files);
+        for (const QString &file : files) {
+            bool ok = false;
+            const qint64 pid = file.section(QLatin1Char('-'), 0, 0).toLongLong(&ok);
+            if (!ok || (kill(pid, 0) != 0 && errno == ESRCH)) {
+                QFile::remove(path + QLatin1Char('/') + file);
+            }
+        }
+        return path;
+    }();
+    return dir;
+}
+}
+
+HistoryPayloadPtr HistoryPayloadCache::spill(const QByteArray &data)
+{
+    // QTemporaryFile is only accessible by the user
+    QTemporaryFile file(cacheDir() + QLatin1Char('/') + QString::number(QCoreApplication::applicationPid()) + QStringLiteral("-XXXXXX"));
+    file.setAutoRemove(false);
+    if (!file.open()) {
+        qCWarning(KLIPPER_LOG) << "Failed to evict clipboard item" << file.errorString();
+        return HistoryPayloadPtr();
+    }
+    // favor speed, this happens on the GUI thread
+    const QByteArray compressed = qCompress(data, 1);
+    if (file.write(compressed) != compressed.size() || !file.flush()) {
+        qCWarning(KLIPPER_LOG) << "Failed to evict clipboard item" << file.errorString();
+        file.remove();
+        return HistoryPayloadPtr();
+    }
+    return HistoryPayloadPtr(new SpilledPayload(file.fileName()));
+}
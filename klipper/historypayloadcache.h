@@ -0,0 +1,23 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include "historyitem.h"
+
+/**
+ * On-disk cache for the payloads of history items evicted from memory.
+ *
+ * Every spilled payload is compressed into its own file readable only by the
+ * user, which gets removed again once no item refers to the payload anymore.
+ */
+namespace HistoryPayloadCache
+{
+/**
+ * Writes @p data to the cache.
+ * @return a payload reading it back, or null if writing failed
+ */
+HistoryPayloadPtr spill(const QByteArray &data);
+}
@@ -0,0 +1,104 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#include "historysearchindex.h"
+
+#include <algorithm>
+
+QVector<HistorySearchIndex::Trigram> HistorySearchIndex::trigrams(const QString &folded)
+{
+    QVector<Trigram> result;
+    if (folded.size() < 3) {
+        return result;
+    }
+    result.reserve(folded.size() - 2);
+    for (int i = 0; i + 2 < folded.size(); ++i) {
+        result.append((Trigram(folded.at(i).unicode()) << 32) | (Trigram(folded.at(i + 1).unicode()) << 16) | Trigram(folded.at(i + 2).unicode()));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+bool HistorySearchIndex::matches(const Entry &entry, const QString &query, const QString &folded, Qt::CaseSensitivity cs)
+{
+    if (cs == Qt::CaseSensitive) {
+        return entry.text.contains(query);
+    }
+    return entry.folded.contains(folded);
+}
+
+void HistorySearchIndex::insert(const QByteArray &uuid, const QString &text)
+{
+    if (m_entries.contains(uuid)) {
+        return;
+    }
+    Entry entry{text, text.toCaseFolded()};
+    const auto grams = trigrams(entry.folded);
+    for (Trigram gram : grams) {
+        m_postings[gram].insert(uuid);
+    }
+    m_entries.insert(uuid, entry);
+}
+
+void HistorySearchIndex::remove(const QByteArray &uuid)
+{
+    const auto it = m_entries.find(uuid);
+    if (it == m_entries.end()) {
+        return;
+    }
+    const auto grams = trigrams(it->folded);
+    for (Trigram gram : grams) {
+        auto posting = m_postings.find(gram);
+        if (posting == m_postings.end()) {
+            continue;
+        }
+        posting->remove(uuid);
+        if (posting->isEmpty()) {
+            m_postings.erase(posting);
+        }
+    }
+    m_entries.erase(it);
+}
+
+void HistorySearchIndex::clear()
+{
+    m_entries.clear();
+    m_postings.clear();
+}
+
+QSet<QByteArray> HistorySearchIndex::search(const QString &query, Qt::CaseSensitivity cs) const
+{
+    QSet<QByteArray> result;
+    const QString folded = query.toCaseFolded();
+    const auto grams = trigrams(folded);
+    if (grams.isEmpty()) {
+        // too short to narrow anything down
+        for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+            if (matches(*it, query, folded, cs)) {
+                result.insert(it.key());
+            }
+        }
+        return result;
+    }
+
+    // every match contains all the trigrams, so checking the items of the rarest one is enough
+    const QSet<QByteArray> *candidates = nullptr;
+    for (Trigram gram : grams) {
+        const auto posting = m_postings.constFind(gram);
+        if (posting == m_postings.constEnd()) {
+            return result;
+        }
+        if (!candidates || posting->size() < candidates->size()) {
+            candidates = &posting.value();
+        }
+    }
+    for (const QByteArray &uuid : *candidates) {
+        if (matches(m_entries.value(uuid), query, folded, cs)) {
+            result.insert(uuid);
+        }
+    }
+    return result;
+}
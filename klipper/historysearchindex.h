@@ -0,0 +1,50 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: GPL-2.0-or-later
+*/
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+/**
+ * Trigram index over the texts of the history items.
+ *
+ * Every item's text is split into its (case folded) three character
+ * sequences. A substring search only has to look at the items sharing the
+ * least common trigram of the query instead of going through all of them.
+ */
+class HistorySearchIndex
+{
+public:
+    void insert(const QByteArray &uuid, const QString &text);
+    void remove(const QByteArray &uuid);
+    void clear();
+
+    int count() const
+    {
+        return m_entries.count();
+    }
+
+    /**
+     * @return uuids of all items whose text contains @p query
+     */
+    QSet<QByteArray> search(const QString &query, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+
+private:
+    typedef quint64 Trigram;
+    struct Entry {
+        QString text;
+        QString folded;
+    };
+
+    static QVector<Trigram> trigrams(const QString &folded);
+    static bool matches(const Entry &entry, const QString &query, const QString &folded, Qt::CaseSensitivity cs);
+
+    QHash<QByteArray, Entry> m_entries;
+    QHash<Trigram, QSet<QByteArray>> m_postings;
+};
@@ -6,6 +6,15 @@
 #include "historystringitem.h"
 
 #include <QCryptographicHash>
+#include <QDataStream>
+
+#include "historypayloadcache.h"
+
+namespace
+{
+// Evicting short strings frees less than what's needed to keep track of them on disk
+const int s_minEvictLength = 4096;
+}
 
 HistoryStringItem::HistoryStringItem(const QString &data)
     : HistoryItem(QCryptographicHash::hash(data.toUtf8(), QCryptographicHash::Sha1))
@@ -13,21 +22,86 @@ HistoryStringItem::HistoryStringItem(const QString &data)
 {
 }
 
+HistoryStringItem::HistoryStringItem(const QByteArray &uuid, const QString &preview, const HistoryPayloadPtr &payload)
+    : HistoryItem(uuid)
+    , m_preview(preview)
+    , m_payload(payload)
+{
+}
+
+const QString &HistoryStringItem::data() const
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_data.isNull() && m_payload) {
+        QDataStream stream(m_payload->data());
+        QString type;
+        stream >> type >> m_data;
+    }
+    touch();
+    return m_data;
+}
+
 /* virtual */
 void HistoryStringItem::write(QDataStream &stream) const
 {
+    QMutexLocker lock(&m_mutex);
+    if (m_payload) {
+        // already serialized, no need to decode and encode it again
+        const QByteArray data = m_payload->data();
+        stream.writeRawData(data.constData(), data.size());
+        return;
+    }
     stream << QStringLiteral("string") << m_data;
 }
 
 QMimeData *HistoryStringItem::mimeData() const
 {
     QMimeData *data = new QMimeData();
-    data->setText(m_data);
+    data->setText(this->data());
     return data;
 }
 
-QString HistoryStringItem::text() const
+qint64 HistoryStringItem::memoryCost() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_data.size() * sizeof(QChar);
+}
+
+qint64 HistoryStringItem::evict(bool spill)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_data.size() < s_minEvictLength) {
+        return 0;
+    }
+    if (!m_payload) {
+        if (!spill) {
+            return 0;
+        }
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << QStringLiteral("string") << m_data;
+        m_payload = HistoryPayloadCache::spill(data);
+        if (!m_payload) {
+            return 0;
+        }
+        m_preview = preview(m_data);
+    }
+    const qint64 cost = m_data.size() * sizeof(QChar);
+    m_data = QString();
+    return cost;
+}
+
+QString HistoryStringItem::preview(const QString &data)
 {
     const int TEXT_LENGTH_LIMIT = 200;
-    return m_data.left(TEXT_LENGTH_LIMIT - 1) + (m_data.length() <= TEXT_LENGTH_LIMIT ? QStringLiteral("") : QStringLiteral("…"));
+    return data.left(TEXT_LENGTH_LIMIT - 1) + (data.length() <= TEXT_LENGTH_LIMIT ? QStringLiteral("") : QStringLiteral("…"));
+}
+
+QString HistoryStringItem::text() const
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_payload) {
+        return m_preview;
+    }
+    return preview(m_data);
 }
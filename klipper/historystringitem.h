@@ -6,6 +6,7 @@
 #pragma once
 
 #include <QMimeData>
+#include <QMutex>
 
 #include "historyitem.h"
 
@@ -16,6 +17,11 @@ class HistoryStringItem : public HistoryItem
 {
 public:
     explicit HistoryStringItem(const QString &data);
+    /**
+     * Creates an item which only shows @p preview as its text
+     * until the full string is needed and decoded from @p payload.
+     */
+    HistoryStringItem(const QByteArray &uuid, const QString &preview, const HistoryPayloadPtr &payload);
     ~HistoryStringItem() override
     {
     }
@@ -23,7 +29,7 @@ public:
     bool operator==(const HistoryItem &rhs) const override
     {
         if (const HistoryStringItem *casted_rhs = dynamic_cast<const HistoryStringItem *>(&rhs)) {
-            return casted_rhs->m_data == m_data;
+            return casted_rhs->data() == data();
         }
         return false;
     }
@@ -34,6 +40,19 @@ public:
      */
     void write(QDataStream &stream) const override;
 
+    qint64 memoryCost() const override;
+    qint64 evict(bool spill) override;
+
 private:
-    QString m_data;
+    const QString &data() const;
+    static QString preview(const QString &data);
+
+    mutable QString m_data;
+    QString m_preview;
+    /**
+     * Where m_data gets decoded from, if it was not passed in directly
+     * or got evicted. Guarded by m_mutex.
+     */
+    HistoryPayloadPtr m_payload;
+    mutable QMutex m_mutex;
 };
@@ -53,6 +53,19 @@ QString HistoryURLItem::text() const
     return ret;
 }
 
+qint64 HistoryURLItem::memoryCost() const
+{
+    // URLs are small and always kept in memory, a rough estimate is good enough
+    qint64 cost = 0;
+    for (const QUrl &url : m_urls) {
+        cost += url.toString().size() * sizeof(QChar);
+    }
+    for (auto it = m_metaData.constBegin(); it != m_metaData.constEnd(); ++it) {
+        cost += (it.key().size() + it.value().size()) * sizeof(QChar);
+    }
+    return cost;
+}
+
 QMimeData *HistoryURLItem::mimeData() const
 {
     QMimeData *data = new QMimeData();
@@ -25,6 +25,8 @@ public:
      */
     void write(QDataStream &stream) const override;
 
+    qint64 memoryCost() const override;
+
 private:
     QList<QUrl> m_urls;
     KUrlMimeData::MetaDataMap m_metaData;
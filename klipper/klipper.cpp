@@ -18,7 +18,6 @@
 #include <QDir>
 #include <QMenu>
 #include <QMessageBox>
-#include <QSaveFile>
 #include <QtConcurrent>
 
 #include <KActionCollection>
@@ -32,6 +31,7 @@
 #include "configdialog.h"
 #include "history.h"
 #include "historyitem.h"
+#include "historyjournal.h"
 #include "historymodel.h"
 #include "historystringitem.h"
 #include "klipperpopup.h"
@@ -122,6 +122,8 @@ Klipper::Klipper(QObject *parent, const KSharedConfigPtr &config, KlipperMode mo
     connect(&m_pendingCheckTimer, &QTimer::timeout, this, &Klipper::slotCheckPending);
 
     m_history = new History(this);
+    // don't use "appdata", klipper is also a kicker applet
+    m_journal.reset(new HistoryJournal(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/klipper/history3.journal")));
     m_popup = new KlipperPopup(m_history);
     m_popup->setShowHelp(m_mode == KlipperMode::Standalone);
     connect(m_history, &History::changed, this, &Klipper::slotHistoryChanged);
@@ -328,6 +330,9 @@ void Klipper::loadSettings()
     setURLGrabberEnabled(m_bURLGrabber);
     history()->setMaxSize(KlipperSettings::maxClipItems());
     history()->model()->setDisplayImages(!m_bIgnoreImages);
+    // don't write clipboard contents to disk if the user doesn't want them saved
+    history()->model()->setSpillToDisk(m_bKeepContents);
+    history()->model()->setMemoryBudget(qint64(KlipperSettings::maxHistoryMemory()) * 1024 * 1024);
 
     // Convert 4.3 settings
     if (KlipperSettings::synchronize() != 3) {
@@ -353,6 +358,17 @@ void Klipper::loadSettings()
             QtConcurrent::run(this, &Klipper::saveHistory, false);
         });
         connect(m_history, &History::changed, m_saveFileTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+        // thumbnails are created after the item was added and need to be saved, too
+        connect(m_history->model(),
+                &HistoryModel::dataChanged,
+                m_saveFileTimer,
+                [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+                    Q_UNUSED(topLeft)
+                    Q_UNUSED(bottomRight)
+                    if (roles.contains(Qt::DecorationRole)) {
+                        m_saveFileTimer->start();
+                    }
+                });
     } else {
         delete m_saveFileTimer;
         m_saveFileTimer = nullptr;
@@ -376,6 +392,36 @@ void Klipper::showPopupMenu(QMenu *menu)
 }
 
 bool Klipper::loadHistory()
+{
+    QVector<HistoryItemPtr> items;
+    const bool fromJournal = m_journal->load(items);
+    if (!fromJournal && !loadLegacyHistory(items)) {
+        return false;
+    }
+
+    // The list is saved youngest-first to keep the most important
+    // clipboard items at the top, but the history is created oldest
+    // first.
+    history()->slotClear();
+    for (auto it = items.crbegin(); it != items.crend(); ++it) {
+        history()->forceInsert(*it);
+    }
+
+    if (!fromJournal) {
+        // migrate to the journal right away, no need to keep the old file around once that worked
+        if (saveHistory()) {
+            QFile::remove(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("klipper/history2.lst")));
+        }
+    }
+
+    if (!history()->empty()) {
+        setClipboard(*history()->first(), Clipboard | Selection);
+    }
+
+    return true;
+}
+
+bool Klipper::loadLegacyHistory(QVector<HistoryItemPtr> &items)
 {
     static const char failed_load_warning[] = "Failed to load history resource. Clipboard history cannot be read.";
     // don't use "appdata", klipper is also a kicker applet
@@ -409,72 +455,49 @@ bool Klipper::loadHistory()
     history_stream >> version;
     delete[] version;
 
-    // The list needs to be reversed, as it is saved
-    // youngest-first to keep the most important clipboard
-    // items at the top, but the history is created oldest
-    // first.
-    QVector<HistoryItemPtr> reverseList;
+    items.clear();
     for (HistoryItemPtr item = HistoryItem::create(history_stream); !item.isNull(); item = HistoryItem::create(history_stream)) {
-        reverseList.prepend(item);
-    }
-
-    history()->slotClear();
-
-    for (auto it = reverseList.constBegin(); it != reverseList.constEnd(); ++it) {
-        history()->forceInsert(*it);
-    }
-
-    if (!history()->empty()) {
-        setClipboard(*history()->first(), Clipboard | Selection);
+        items.append(item);
     }
 
     return true;
 }
 
-void Klipper::saveHistory(bool empty)
+bool Klipper::saveHistory(bool empty)
 {
     QMutexLocker lock(m_history->model()->mutex());
     static const char failed_save_warning[] = "Failed to save history. Clipboard history cannot be saved.";
-    // don't use "appdata", klipper is also a kicker applet
-    QString history_file_name(QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("klipper/history2.lst")));
-    if (history_file_name.isNull() || history_file_name.isEmpty()) {
-        // try creating the file
-        QDir dir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation));
-        if (!dir.mkpath(QStringLiteral("klipper"))) {
+
+    if (empty) {
+        if (!m_journal->clear()) {
             qCWarning(KLIPPER_LOG) << failed_save_warning;
-            return;
         }
-        history_file_name = dir.absoluteFilePath(QStringLiteral("klipper/history2.lst"));
-    }
-    if (history_file_name.isNull() || history_file_name.isEmpty()) {
-        qCWarning(KLIPPER_LOG) << failed_save_warning;
-        return;
+        // also get rid of a history saved by an older version
+        const QString legacyFile = QStandardPaths::locate(QStandardPaths::GenericDataLocation, QStringLiteral("klipper/history2.lst"));
+        if (!legacyFile.isEmpty()) {
+            QFile::remove(legacyFile);
+        }
+        return true;
     }
-    QSaveFile history_file(history_file_name);
-    if (!history_file.open(QIODevice::WriteOnly)) {
+
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation));
+    if (!dir.mkpath(QStringLiteral("klipper"))) {
         qCWarning(KLIPPER_LOG) << failed_save_warning;
-        return;
+        return false;
     }
-    QByteArray data;
-    QDataStream history_stream(&data, QIODevice::WriteOnly);
-    history_stream << KLIPPER_VERSION_STRING; // const char*
 
-    if (!empty) {
-        HistoryItemConstPtr item = history()->first();
-        if (item) {
-            do {
-                history_stream << item.data();
-                item = HistoryItemConstPtr(history()->find(item->next_uuid()));
-            } while (item != history()->first());
-        }
+    const HistoryModel *model = m_history->model();
+    QVector<HistoryItemConstPtr> items;
+    items.reserve(model->rowCount());
+    for (int i = 0; i < model->rowCount(); ++i) {
+        items.append(model->index(i).data(Qt::UserRole).value<HistoryItemConstPtr>());
     }
 
-    quint32 crc = crc32(0, reinterpret_cast<unsigned char *>(data.data()), data.size());
-    QDataStream ds(&history_file);
-    ds << crc << data;
-    if (!history_file.commit()) {
+    if (!m_journal->sync(items)) {
         qCWarning(KLIPPER_LOG) << failed_save_warning;
+        return false;
     }
+    return true;
 }
 
 // save session on shutdown. Don't simply use the c'tor, as that may not be called.
@@ -846,6 +869,30 @@ QString Klipper::getClipboardHistoryItem(int i)
     return QString();
 }
 
+QVariantMap Klipper::getClipboardHistoryMemoryUsage()
+{
+    QMutexLocker lock(history()->model()->mutex());
+    const auto usage = history()->model()->memoryUsage();
+    return {
+        {QStringLiteral("text"), usage.value(HistoryItemType::Text)},
+        {QStringLiteral("image"), usage.value(HistoryItemType::Image)},
+        {QStringLiteral("url"), usage.value(HistoryItemType::Url)},
+        {QStringLiteral("budget"), history()->model()->memoryBudget()},
+    };
+}
+
+QStringList Klipper::searchClipboardHistory(const QString &query)
+{
+    HistoryModel *model = history()->model();
+    const QVector<int> rows = model->search(query);
+    QStringList result;
+    result.reserve(rows.count());
+    for (int row : rows) {
+        result << model->index(row).data().toString();
+    }
+    return result;
+}
+
 //
 // changing a spinbox in klipper's config-dialog causes the lineedit-contents
 // of the spinbox to be selected and hence the clipboard changes. But we don't
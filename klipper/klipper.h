@@ -9,6 +9,8 @@
 
 #include "config-klipper.h"
 
+#include <memory>
+
 #include <QClipboard>
 #include <QElapsedTimer>
 #include <QPointer>
@@ -24,6 +26,7 @@ class KlipperPopup;
 class URLGrabber;
 class QTime;
 class History;
+class HistoryJournal;
 class QAction;
 class QMenu;
 class QMimeData;
@@ -58,6 +61,15 @@ public Q_SLOTS:
     Q_SCRIPTABLE void saveClipboardHistory();
     Q_SCRIPTABLE QStringList getClipboardHistoryMenu();
     Q_SCRIPTABLE QString getClipboardHistoryItem(int i);
+    /**
+     * Bytes of clipboard history held in memory per item type ("text", "image", "url")
+     * and the configured limit ("budget", 0 if unlimited)
+     */
+    Q_SCRIPTABLE QVariantMap getClipboardHistoryMemoryUsage();
+    /**
+     * Texts of all history items containing @p query (case insensitive), youngest first
+     */
+    Q_SCRIPTABLE QStringList searchClipboardHistory(const QString &query);
     Q_SCRIPTABLE void showKlipperPopupMenu();
     Q_SCRIPTABLE void showKlipperManuallyInvokeActionMenu();
 
@@ -116,11 +128,18 @@ protected:
      */
     bool loadHistory();
 
+    /**
+     * Loads history from the single-file format used up to Plasma 5.23.
+     * @param items receives the restored items, youngest first
+     */
+    bool loadLegacyHistory(QVector<QSharedPointer<HistoryItem>> &items);
+
     /**
      * Save history to disk
      * @param empty save empty history instead of actual history
+     * @return false if the history could not be saved
      */
-    void saveHistory(bool empty = false);
+    bool saveHistory(bool empty = false);
 
     /**
      * Check data in clipboard, and if it passes these checks,
@@ -221,5 +240,6 @@ private:
     KActionCollection *m_collection;
     KlipperMode m_mode;
     QTimer *m_saveFileTimer = nullptr;
+    std::unique_ptr<HistoryJournal> m_journal;
     QPointer<KNotification> m_notification;
 };
@@ -12,12 +12,14 @@
 #include <KLocalizedString>
 
 #include "historyitem.h"
+#include "historymodel.h"
 #include "klipperpopup.h"
 
 PopupProxy::PopupProxy(KlipperPopup *parent, int menu_height, int menu_width)
     : QObject(parent)
     , m_proxy_for_menu(parent)
     , m_spill_uuid()
+    , m_useSearchIndex(false)
     , m_menu_height(menu_height)
     , m_menu_width(menu_width)
 {
@@ -57,10 +59,36 @@ int PopupProxy::buildParent(int index, const QRegularExpression &filter)
     if (filter.isValid()) {
         m_filter = filter;
     }
+    updateMatches();
 
     return insertFromSpill(index);
 }
 
+void PopupProxy::updateMatches()
+{
+    static const QRegularExpression specialCharacters(QStringLiteral("[\\\\^$.|?*+()\\[\\]{}]"));
+    const QString pattern = m_filter.pattern();
+    m_matches.clear();
+    m_useSearchIndex = !pattern.isEmpty() && !pattern.contains(specialCharacters);
+    if (!m_useSearchIndex) {
+        return;
+    }
+    const Qt::CaseSensitivity cs = m_filter.patternOptions() & QRegularExpression::CaseInsensitiveOption ? Qt::CaseInsensitive : Qt::CaseSensitive;
+    const HistoryModel *model = parent()->history()->model();
+    const QVector<int> rows = model->search(pattern, cs);
+    for (int row : rows) {
+        m_matches.insert(model->index(row).data(Qt::UserRole + 1).toByteArray());
+    }
+}
+
+bool PopupProxy::matches(const HistoryItem *item) const
+{
+    if (m_useSearchIndex) {
+        return m_matches.contains(item->uuid());
+    }
+    return m_filter.match(item->text()).hasMatch();
+}
+
 KlipperPopup *PopupProxy::parent()
 {
     return static_cast<KlipperPopup *>(QObject::parent());
@@ -130,7 +158,7 @@ int PopupProxy::insertFromSpill(int index)
         return count;
     }
     do {
-        if (m_filter.match(item->text()).hasMatch()) {
+        if (matches(item.data())) {
             tryInsertItem(item.data(), remainingHeight, index++);
             count++;
         }
@@ -7,6 +7,7 @@
 
 #include <QObject>
 #include <QRegularExpression>
+#include <QSet>
 
 #include "history.h"
 
@@ -65,10 +66,23 @@ private:
      */
     void deleteMoreMenus();
 
+    /**
+     * Looks up the items matching m_filter in the history's search index,
+     * if the filter is plain text.
+     */
+    void updateMatches();
+
+    bool matches(const HistoryItem *item) const;
+
 private:
     QMenu *m_proxy_for_menu;
     QByteArray m_spill_uuid;
     QRegularExpression m_filter;
+    /**
+     * Uuids of the items matching m_filter, only used if m_useSearchIndex is set
+     */
+    QSet<QByteArray> m_matches;
+    bool m_useSearchIndex;
     int m_menu_height;
     int m_menu_width;
 };
@@ -11,13 +11,15 @@
 #include <QFutureWatcher>
 #include <QGuiApplication>
 #include <QPointer>
+#include <QSocketNotifier>
+#include <QTimer>
 
 #include <QtWaylandClient/QWaylandClientExtension>
 
 #include <qpa/qplatformnativeinterface.h>
 
 #include <errno.h>
-#include <poll.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -28,6 +30,11 @@ static QString utf8Text()
     return QStringLiteral("text/plain;charset=utf-8");
 }
 
+// Give up on sources which don't deliver their data in time
+static const int s_readTimeout = 5000;
+// Anything larger is not something we want to keep in the clipboard history
+static const int s_maxReadSize = 64 * 1024 * 1024;
+
 class DataControlDeviceManager : public QWaylandClientExtensionTemplate<DataControlDeviceManager>, public QtWayland::zwlr_data_control_manager_v1
 {
     Q_OBJECT
@@ -43,6 +50,75 @@ public:
     }
 };
 
+/**
+ * Reads the data of one mime type from its pipe as it arrives,
+ * without ever blocking the event loop.
+ */
+class DataControlOfferReader : public QObject
+{
+    Q_OBJECT
+public:
+    DataControlOfferReader(int fd, QObject *parent)
+        : QObject(parent)
+        , m_fd(fd)
+        , m_notifier(new QSocketNotifier(fd, QSocketNotifier::Read, this))
+    {
+        connect(m_notifier, &QSocketNotifier::activated, this, &DataControlOfferReader::readAvailable);
+    }
+
+    ~DataControlOfferReader()
+    {
+        close(m_fd);
+    }
+
+    QByteArray data() const
+    {
+        return m_data;
+    }
+
+Q_SIGNALS:
+    void finished(bool success);
+
+private:
+    void readAvailable();
+    void finish(bool success)
+    {
+        m_notifier->setEnabled(false);
+        Q_EMIT finished(success);
+    }
+
+    const int m_fd;
+    QSocketNotifier *const m_notifier;
+    QByteArray m_data;
+};
+
+void DataControlOfferReader::readAvailable()
+{
+    char buf[4096];
+    while (true) {
+        const ssize_t n = read(m_fd, buf, sizeof buf);
+        if (n > 0) {
+            if (m_data.size() + n > s_maxReadSize) {
+                qWarning("DataControlOffer: offered data exceeds %d bytes, ignoring it", s_maxReadSize);
+                m_data.clear();
+                finish(false);
+                return;
+            }
+            m_data.append(buf, n);
+        } else if (n == 0) {
+            finish(true);
+            return;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // wait for the notifier to tell us there is more
+            return;
+        } else if (errno != EINTR) {
+            qWarning("DataControlOffer: read() failed: %s", strerror(errno));
+            finish(false);
+            return;
+        }
+    }
+}
+
 class DataControlOffer : public QMimeData, public QtWayland::zwlr_data_control_offer_v1
 {
     Q_OBJECT
@@ -50,6 +126,13 @@ public:
     DataControlOffer(struct ::zwlr_data_control_offer_v1 *id)
         : QtWayland::zwlr_data_control_offer_v1(id)
     {
+        m_timeout.setSingleShot(true);
+        m_timeout.setInterval(s_readTimeout);
+        connect(&m_timeout, &QTimer::timeout, this, [this]() {
+            qWarning("DataControlOffer: timeout reading offered data");
+            qDeleteAll(findChildren<DataControlOfferReader *>(QString(), Qt::FindDirectChildrenOnly));
+            finishPrefetch();
+        });
     }
 
     ~DataControlOffer()
@@ -57,19 +140,26 @@ public:
         destroy();
     }
 
-    QStringList formats() const override
-    {
-        return m_receivedFormats;
-    }
+    /**
+     * Only the formats which were prefetched, anything else can't be retrieved from this offer.
+     */
+    QStringList formats() const override;
 
     bool hasFormat(const QString &mimeType) const override
     {
-        if (mimeType == QStringLiteral("text/plain") && m_receivedFormats.contains(utf8Text())) {
-            return true;
-        }
-        return m_receivedFormats.contains(mimeType);
+        return m_data.contains(mimeType) || (mimeType == QLatin1String("text/plain") && m_data.contains(utf8Text()));
     }
 
+    /**
+     * Starts reading the data of all formats the clipboard history is interested in.
+     * ready() gets emitted once all of them arrived, failed or timed out.
+     * Other formats are not available from this offer.
+     */
+    void prefetch();
+
+Q_SIGNALS:
+    void ready();
+
 protected:
     void zwlr_data_control_offer_v1_offer(const QString &mime_type) override
     {
@@ -79,88 +169,116 @@ protected:
     QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override;
 
 private:
-    static bool readData(int fd, QByteArray &data);
+    QStringList formatsToPrefetch() const;
+    void finishPrefetch();
+
     QStringList m_receivedFormats;
+    QHash<QString, QByteArray> m_data;
+    int m_pendingReads = 0;
+    QTimer m_timeout;
 };
 
-QVariant DataControlOffer::retrieveData(const QString &mimeType, QVariant::Type type) const
+QStringList DataControlOffer::formats() const
 {
-    Q_UNUSED(type);
-
-    QString mime = mimeType;
-    if (!m_receivedFormats.contains(mimeType)) {
-        if (mimeType == QStringLiteral("text/plain") && m_receivedFormats.contains(utf8Text())) {
-            mime = utf8Text();
-        } else {
-            return QVariant();
+    QStringList formats;
+    for (const QString &format : m_receivedFormats) {
+        if (m_data.contains(format)) {
+            formats << format;
         }
     }
+    if (m_data.contains(utf8Text()) && !formats.contains(QLatin1String("text/plain"))) {
+        formats << QStringLiteral("text/plain");
+    }
+    return formats;
+}
 
-    int pipeFds[2];
-    if (pipe(pipeFds) != 0) {
-        return QVariant();
+QStringList DataControlOffer::formatsToPrefetch() const
+{
+    static const QStringList interesting = {
+        utf8Text(),
+        QStringLiteral("text/plain"),
+        QStringLiteral("text/uri-list"),
+        QStringLiteral("application/x-kde4-urilist"),
+        QStringLiteral("application/x-kde-cutselection"),
+        QStringLiteral("application/x-kio-metadata"),
+        QStringLiteral("application/x-qt-image"),
+        QStringLiteral("x-kde-passwordManagerHint"),
+        QStringLiteral("x-kde-force-image-copy"),
+    };
+
+    QStringList formats;
+    for (const QString &format : m_receivedFormats) {
+        if (!interesting.contains(format)) {
+            continue;
+        }
+        // we serve text/plain from the utf-8 variant anyway
+        if (format == QLatin1String("text/plain") && m_receivedFormats.contains(utf8Text())) {
+            continue;
+        }
+        formats << format;
     }
+    return formats;
+}
 
-    auto t = const_cast<DataControlOffer *>(this);
-    t->receive(mime, pipeFds[1]);
+void DataControlOffer::prefetch()
+{
+    for (const QString &mime : formatsToPrefetch()) {
+        int pipeFds[2];
+        if (pipe2(pipeFds, O_CLOEXEC) != 0) {
+            continue;
+        }
+        // only our end is non-blocking, the source gets a regular pipe to write to
+        fcntl(pipeFds[0], F_SETFL, fcntl(pipeFds[0], F_GETFL) | O_NONBLOCK);
 
-    close(pipeFds[1]);
+        receive(mime, pipeFds[1]);
+        close(pipeFds[1]);
 
-    /*
-     * Ideally we need to introduce a non-blocking QMimeData object
-     * Or a non-blocking constructor to QMimeData with the mimetypes that are relevant
-     *
-     * However this isn't actually any worse than X.
-     */
+        auto reader = new DataControlOfferReader(pipeFds[0], this);
+        ++m_pendingReads;
+        connect(reader, &DataControlOfferReader::finished, this, [this, reader, mime](bool success) {
+            if (success) {
+                m_data.insert(mime, reader->data());
+            }
+            // not a pending read anymore, see the timeout handler
+            reader->setParent(nullptr);
+            reader->deleteLater();
+            if (--m_pendingReads == 0) {
+                finishPrefetch();
+            }
+        });
+    }
+
+    if (m_pendingReads == 0) {
+        finishPrefetch();
+        return;
+    }
 
     QPlatformNativeInterface *native = qApp->platformNativeInterface();
     auto display = static_cast<struct ::wl_display *>(native->nativeResourceForIntegration("wl_display"));
     wl_display_flush(display);
+    m_timeout.start();
+}
 
-    QFile readPipe;
-    if (readPipe.open(pipeFds[0], QIODevice::ReadOnly)) {
-        QByteArray data;
-        if (readData(pipeFds[0], data)) {
-            close(pipeFds[0]);
-            return data;
-        }
-        close(pipeFds[0]);
-    }
-    return QVariant();
+void DataControlOffer::finishPrefetch()
+{
+    m_timeout.stop();
+    m_pendingReads = 0;
+    Q_EMIT ready();
 }
 
-// reads data from a file descriptor with a timeout of 1 second
-// true if data is read successfully
-bool DataControlOffer::readData(int fd, QByteArray &data)
+QVariant DataControlOffer::retrieveData(const QString &mimeType, QVariant::Type type) const
 {
-    pollfd pfds[1];
-    pfds[0].fd = fd;
-    pfds[0].events = POLLIN;
+    Q_UNUSED(type);
 
-    while (true) {
-        const int ready = poll(pfds, 1, 1000);
-        if (ready < 0) {
-            if (errno != EINTR) {
-                qWarning("DataControlOffer: poll() failed: %s", strerror(errno));
-                return false;
-            }
-        } else if (ready == 0) {
-            qWarning("DataControlOffer: timeout reading from pipe");
-            return false;
-        } else {
-            char buf[4096];
-            int n = read(fd, buf, sizeof buf);
-
-            if (n < 0) {
-                qWarning("DataControlOffer: read() failed: %s", strerror(errno));
-                return false;
-            } else if (n == 0) {
-                return true;
-            } else if (n > 0) {
-                data.append(buf, n);
-            }
-        }
+    // Never read synchronously here, a slow or malicious source would block us
+    auto it = m_data.constFind(mimeType);
+    if (it == m_data.constEnd() && mimeType == QLatin1String("text/plain")) {
+        it = m_data.constFind(utf8Text());
+    }
+    if (it == m_data.constEnd()) {
+        return QVariant();
     }
+    return *it;
 }
 
 class DataControlSource : public QObject, public QtWayland::zwlr_data_control_source_v1
@@ -273,36 +391,73 @@ protected:
 
     void zwlr_data_control_device_v1_selection(struct ::zwlr_data_control_offer_v1 *id) override
     {
-        if (!id) {
-            m_receivedSelection.reset();
-        } else {
-            auto deriv = QtWayland::zwlr_data_control_offer_v1::fromObject(id);
-            auto offer = dynamic_cast<DataControlOffer *>(deriv); // dynamic because of the dual inheritance
-            m_receivedSelection.reset(offer);
-        }
-        emit receivedSelectionChanged();
+        receiveOffer(id, QClipboard::Clipboard);
     }
 
     void zwlr_data_control_device_v1_primary_selection(struct ::zwlr_data_control_offer_v1 *id) override
     {
-        if (!id) {
-            m_receivedPrimarySelection.reset();
-        } else {
-            auto deriv = QtWayland::zwlr_data_control_offer_v1::fromObject(id);
-            auto offer = dynamic_cast<DataControlOffer *>(deriv); // dynamic because of the dual inheritance
-            m_receivedPrimarySelection.reset(offer);
-        }
-        emit receivedPrimarySelectionChanged();
+        receiveOffer(id, QClipboard::Selection);
     }
 
 private:
+    void receiveOffer(struct ::zwlr_data_control_offer_v1 *id, QClipboard::Mode mode);
+    void setReceived(QClipboard::Mode mode);
+
     std::unique_ptr<DataControlSource> m_selection; // selection set locally
     std::unique_ptr<DataControlOffer> m_receivedSelection; // latest selection set from externally to here
+    std::unique_ptr<DataControlOffer> m_pendingSelection; // newer selection whose data is still being read
 
     std::unique_ptr<DataControlSource> m_primarySelection; // selection set locally
     std::unique_ptr<DataControlOffer> m_receivedPrimarySelection; // latest selection set from externally to here
+    std::unique_ptr<DataControlOffer> m_pendingPrimarySelection; // newer selection whose data is still being read
 };
 
+void DataControlDevice::receiveOffer(struct ::zwlr_data_control_offer_v1 *id, QClipboard::Mode mode)
+{
+    auto &pending = mode == QClipboard::Clipboard ? m_pendingSelection : m_pendingPrimarySelection;
+    // a newer selection cancels whatever we were still reading
+    pending.reset();
+
+    if (!id) {
+        (mode == QClipboard::Clipboard ? m_receivedSelection : m_receivedPrimarySelection).reset();
+        if (mode == QClipboard::Clipboard) {
+            Q_EMIT receivedSelectionChanged();
+        } else {
+            Q_EMIT receivedPrimarySelectionChanged();
+        }
+        return;
+    }
+
+    auto deriv = QtWayland::zwlr_data_control_offer_v1::fromObject(id);
+    pending.reset(dynamic_cast<DataControlOffer *>(deriv)); // dynamic because of the dual inheritance
+
+    // Data we set ourselves is served from our own source, reading it back
+    // would only make us wait for ourselves.
+    const bool ownData = mode == QClipboard::Clipboard ? (m_selection || QGuiApplication::clipboard()->ownsClipboard())
+                                                       : (m_primarySelection || QGuiApplication::clipboard()->ownsSelection());
+    if (ownData) {
+        setReceived(mode);
+        return;
+    }
+
+    // only announce the new selection once its data is there
+    connect(pending.get(), &DataControlOffer::ready, this, [this, mode]() {
+        setReceived(mode);
+    });
+    pending->prefetch();
+}
+
+void DataControlDevice::setReceived(QClipboard::Mode mode)
+{
+    if (mode == QClipboard::Clipboard) {
+        m_receivedSelection = std::move(m_pendingSelection);
+        Q_EMIT receivedSelectionChanged();
+    } else {
+        m_receivedPrimarySelection = std::move(m_pendingPrimarySelection);
+        Q_EMIT receivedPrimarySelectionChanged();
+    }
+}
+
 void DataControlDevice::setSelection(std::unique_ptr<DataControlSource> selection)
 {
     m_selection = std::move(selection);
@@ -31,6 +31,14 @@
 #include "history.h"
 #include "historystringitem.h"
 
+namespace
+{
+// Matching actions automatically against anything longer is not worth it: nobody wants
+// to open a whole document as a URL and running dozens of regexes over it takes a while.
+// When asked for by hand, everything is matched.
+const int s_maxMatchLength = 4096;
+}
+
 URLGrabber::URLGrabber(History *history)
     : m_myCurrentAction(nullptr)
     , m_myMenu(nullptr)
@@ -120,13 +128,15 @@ const ActionList &URLGrabber::matchingActions(const QString &clipData, bool auto
 {
     m_myMatches.clear();
 
+    if (automatically_invoked && clipData.length() > s_maxMatchLength) {
+        return m_myMatches;
+    }
+
     matchingMimeActions(clipData);
 
     // now look for matches in custom user actions
-    QRegularExpression re;
-    foreach (ClipAction *action, m_myActions) {
-        re.setPattern(action->actionRegexPattern());
-        const QRegularExpressionMatch match = re.match(clipData);
+    for (ClipAction *action : qAsConst(m_myActions)) {
+        const QRegularExpressionMatch match = action->actionRegex().match(clipData);
         if (match.hasMatch() && (action->automatic() || !automatically_invoked)) {
             action->setActionCapturedTexts(match.capturedTexts());
             m_myMatches.append(action);
@@ -357,18 +367,18 @@ ClipCommand::ClipCommand(const QString &_command,
 }
 
 ClipAction::ClipAction(const QString &regExp, const QString &description, bool automatic)
-    : m_regexPattern(regExp)
-    , m_myDescription(description)
+    : m_myDescription(description)
     , m_automatic(automatic)
 {
+    setActionRegexPattern(regExp);
 }
 
 ClipAction::ClipAction(KSharedConfigPtr kc, const QString &group)
-    : m_regexPattern(kc->group(group).readEntry("Regexp"))
-    , m_myDescription(kc->group(group).readEntry("Description"))
+    : m_myDescription(kc->group(group).readEntry("Description"))
     , m_automatic(kc->group(group).readEntry("Automatic", QVariant(true)).toBool())
 {
     KConfigGroup cg(kc, group);
+    setActionRegexPattern(cg.readEntry("Regexp"));
 
     int num = cg.readEntry("Number of commands", 0);
 
@@ -390,6 +400,17 @@ ClipAction::~ClipAction()
     m_myCommands.clear();
 }
 
+void ClipAction::setActionRegexPattern(const QString &pattern)
+{
+    m_regexPattern = pattern;
+    m_regex.setPattern(pattern);
+    // compile (and JIT) it right away rather than on the first clipboard change
+    m_regex.optimize();
+    if (!m_regex.isValid()) {
+        qCDebug(KLIPPER_LOG) << "Invalid action regular expression" << pattern << m_regex.errorString();
+    }
+}
+
 void ClipAction::addCommand(const ClipCommand &cmd)
 {
     if (cmd.command.isEmpty() && cmd.serviceStorageId.isEmpty())
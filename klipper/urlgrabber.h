@@ -6,6 +6,7 @@
 #pragma once
 
 #include <QHash>
+#include <QRegularExpression>
 #include <QSharedPointer>
 #include <QStringList>
 
@@ -38,6 +39,13 @@ public:
     void checkNewData(QSharedPointer<const HistoryItem> item);
     void invokeAction(QSharedPointer<const HistoryItem> item);
 
+    /**
+     * The actions matching @p clipData, without executing or offering them.
+     * Only automatic actions match if @p automatically_invoked is set.
+     * The list is valid until the next call.
+     */
+    const ActionList &matchingActions(const QString &clipData, bool automatically_invoked);
+
     ActionList actionList() const
     {
         return m_myActions;
@@ -75,7 +83,6 @@ public:
     }
 
 private:
-    const ActionList &matchingActions(const QString &, bool automatically_invoked);
     void execute(const ClipAction *action, int commandIdx) const;
     bool isAvoidedWindow() const;
     void actionMenu(QSharedPointer<const HistoryItem> item, bool automatically_invoked);
@@ -150,9 +157,15 @@ public:
     {
         return m_regexPattern;
     }
-    void setActionRegexPattern(const QString &pattern)
+    void setActionRegexPattern(const QString &pattern);
+
+    /**
+     * The compiled form of actionRegexPattern(), built once
+     * instead of on every clipboard change
+     */
+    const QRegularExpression &actionRegex() const
     {
-        m_regexPattern = pattern;
+        return m_regex;
     }
 
     QStringList actionCapturedTexts() const
@@ -217,6 +230,7 @@ public:
 
 private:
     QString m_regexPattern;
+    QRegularExpression m_regex;
     QStringList m_regexCapturedTexts;
     QString m_myDescription;
     QList<ClipCommand> m_myCommands;
@@ -8,12 +8,14 @@
 #include "abstractnotificationsmodel_p.h"
 #include "debug.h"
 
+#include "notificationhistory_p.h"
 #include "utils_p.h"
 
 #include "notification_p.h"
 
 #include <QDebug>
 #include <QProcess>
+#include <QtConcurrent>
 
 #include <KShell>
 
@@ -21,9 +23,31 @@
 #include <functional>
 
 static const int s_notificationsLimit = 1000;
+// Notifications whose fallback timeouts end within the same slot expire together
+static const int s_notificationTimeoutSlot = 1000;
+// How many notifications are read from the history at a time
+static const int s_historyPageSize = 50;
+// Changes to the history within this many milliseconds are written together
+static const int s_historyWriteInterval = 1000;
 
 using namespace NotificationManager;
 
+// The roles that change when a notification expires
+static QVector<int> expiredRoles()
+{
+    // clang-format off
+    return {
+        Notifications::ExpiredRole,
+        // TODO only emit those if actually changed?
+        Notifications::ActionNamesRole,
+        Notifications::ActionLabelsRole,
+        Notifications::HasDefaultActionRole,
+        Notifications::DefaultActionLabelRole,
+        Notifications::ConfigurableRole
+    };
+    // clang-format on
+}
+
 AbstractNotificationsModel::Private::Private(AbstractNotificationsModel *q)
     : q(q)
     , lastRead(QDateTime::currentDateTimeUtc())
@@ -34,7 +58,7 @@ AbstractNotificationsModel::Private::Private(AbstractNotificationsModel *q)
         QVector<int> rowsToBeRemoved;
         rowsToBeRemoved.reserve(pendingRemovals.count());
         for (uint id : qAsConst(pendingRemovals)) {
-            int row = q->rowOfNotification(id); // oh the complexity...
+            int row = q->rowOfNotification(id);
             if (row == -1) {
                 continue;
             }
@@ -43,12 +67,26 @@ AbstractNotificationsModel::Private::Private(AbstractNotificationsModel *q)
 
         removeRows(rowsToBeRemoved);
     });
+
+    notificationTimeoutClock.start();
+    notificationTimeoutTimer.setSingleShot(true);
+    notificationTimeoutTimer.setTimerType(Qt::CoarseTimer);
+    connect(&notificationTimeoutTimer, &QTimer::timeout, q, [this] {
+        expireDueNotifications();
+    });
+
+    historyWriteTimer.setSingleShot(true);
+    historyWriteTimer.setInterval(s_historyWriteInterval);
+    connect(&historyWriteTimer, &QTimer::timeout, q, [this] {
+        writeHistory();
+    });
+    // One writer, so the batches hit the disk in the order they were queued
+    historyWriter.setMaxThreadCount(1);
 }
 
 AbstractNotificationsModel::Private::~Private()
 {
-    qDeleteAll(notificationTimeouts);
-    notificationTimeouts.clear();
+    waitForHistory();
 }
 
 void AbstractNotificationsModel::Private::onNotificationAdded(const Notification &notification)
@@ -60,16 +98,23 @@ void AbstractNotificationsModel::Private::onNotificationAdded(const Notification
         qCDebug(NOTIFICATIONMANAGER) << "Reached the notification limit of" << s_notificationsLimit << ", discarding the oldest" << cleanupCount
                                      << "notifications";
         q->beginRemoveRows(QModelIndex(), 0, cleanupCount - 1);
+        // TODO close gracefully?
         for (int i = 0; i < cleanupCount; ++i) {
-            notifications.removeAt(0);
-            // TODO close gracefully?
+            removeNotificationTimeout(notifications.at(i).id());
+            // They stay in the history and can be fetched again
+            historyKeys.remove(notifications.at(i).id());
         }
+        notifications.remove(0, cleanupCount);
+        updateRowIndex(0);
         q->endRemoveRows();
+
+        historyCursor = nextHistoryKey;
     }
 
     setupNotificationTimeout(notification);
 
     q->beginInsertRows(QModelIndex(), notifications.count(), notifications.count());
+    rowIndex.insert(notification.id(), notifications.count());
     notifications.append(std::move(notification));
     q->endInsertRows();
 }
@@ -98,7 +143,17 @@ void AbstractNotificationsModel::Private::onNotificationReplaced(uint replacedId
     newNotification.setDismissed(oldNotification.dismissed());
     newNotification.setRead(oldNotification.read());
 
+    if (newNotification.id() != replacedId) {
+        rowIndex.remove(replacedId);
+        rowIndex.insert(newNotification.id(), row);
+    }
+
     notifications[row] = newNotification;
+
+    // Replacing an expired notification replaces it in the history, too
+    removeFromHistory(replacedId);
+    saveToHistory(row);
+
     const QModelIndex idx = q->index(row, 0);
     emit q->dataChanged(idx, idx);
 }
@@ -123,17 +178,15 @@ void AbstractNotificationsModel::Private::onNotificationRemoved(uint removedId,
         // unless it is "resident" which we don't support
         notification.setActions(QStringList());
 
-        // clang-format off
-        emit q->dataChanged(idx, idx, {
-            Notifications::ExpiredRole,
-            // TODO only emit those if actually changed?
-            Notifications::ActionNamesRole,
-            Notifications::ActionLabelsRole,
-            Notifications::HasDefaultActionRole,
-            Notifications::DefaultActionLabelRole,
-            Notifications::ConfigurableRole
-        });
-        // clang-format on
+        saveToHistory(row);
+
+        // Announced together with the others expiring at the same time
+        if (expiringNotifications) {
+            expiredNotifications.append(removedId);
+            return;
+        }
+
+        emit q->dataChanged(idx, idx, expiredRoles());
 
         return;
     }
@@ -142,9 +195,7 @@ void AbstractNotificationsModel::Private::onNotificationRemoved(uint removedId,
     // some apps are notorious for closing a bunch of notifications at once
     // causing newer notifications to move up and have a dialogs created for them
     // just to then be discarded causing excess CPU usage
-    if (!pendingRemovals.contains(removedId)) {
-        pendingRemovals.append(removedId);
-    }
+    pendingRemovals.insert(removedId);
 
     if (!pendingRemovalTimer.isActive()) {
         pendingRemovalTimer.start();
@@ -159,22 +210,91 @@ void AbstractNotificationsModel::Private::setupNotificationTimeout(const Notific
         return;
     }
 
-    QTimer *timer = notificationTimeouts.value(notification.id());
-    if (!timer) {
-        timer = new QTimer();
-        timer->setSingleShot(true);
+    removeNotificationTimeout(notification.id());
 
-        connect(timer, &QTimer::timeout, q, [this, timer] {
-            const uint id = timer->property("notificationId").toUInt();
-            q->expire(id);
-        });
-        notificationTimeouts.insert(notification.id(), timer);
+    const qint64 timeout = 60000 /*1min*/ + (notification.timeout() == -1 ? 120000 /*2min, max configurable default timeout*/ : notification.timeout());
+    // Round up to the end of the slot so that bursts of notifications expire in one go
+    const qint64 deadline = (notificationTimeoutClock.elapsed() + timeout + s_notificationTimeoutSlot - 1) / s_notificationTimeoutSlot * s_notificationTimeoutSlot;
+
+    notificationDeadlines.insert(notification.id(), deadline);
+    notificationTimeouts.insert(deadline, notification.id());
+
+    if (!notificationTimeoutTimer.isActive() || notificationTimeouts.firstKey() == deadline) {
+        scheduleNotificationTimeouts();
+    }
+}
+
+void AbstractNotificationsModel::Private::removeNotificationTimeout(uint notificationId)
+{
+    const auto it = notificationDeadlines.find(notificationId);
+    if (it == notificationDeadlines.end()) {
+        return;
+    }
+
+    notificationTimeouts.remove(it.value(), notificationId);
+    notificationDeadlines.erase(it);
+
+    // The timer is left running, if it was for this one it finds nothing due and is armed again
+    if (notificationTimeouts.isEmpty()) {
+        notificationTimeoutTimer.stop();
+    }
+}
+
+void AbstractNotificationsModel::Private::scheduleNotificationTimeouts()
+{
+    if (notificationTimeouts.isEmpty()) {
+        notificationTimeoutTimer.stop();
+        return;
+    }
+
+    const qint64 remaining = notificationTimeouts.firstKey() - notificationTimeoutClock.elapsed();
+    notificationTimeoutTimer.start(static_cast<int>(qMax<qint64>(0, remaining)));
+}
+
+void AbstractNotificationsModel::Private::expireDueNotifications()
+{
+    const qint64 now = notificationTimeoutClock.elapsed();
+
+    QVector<uint> dueNotifications;
+
+    auto it = notificationTimeouts.begin();
+    while (it != notificationTimeouts.end() && it.key() <= now) {
+        dueNotifications.append(it.value());
+        notificationDeadlines.remove(it.value());
+        it = notificationTimeouts.erase(it);
+    }
+
+    expiringNotifications = true;
+    for (uint id : qAsConst(dueNotifications)) {
+        q->expire(id);
+    }
+    expiringNotifications = false;
+
+    QVector<int> expiredRows;
+    expiredRows.reserve(expiredNotifications.count());
+    for (uint id : qAsConst(expiredNotifications)) {
+        const int row = q->rowOfNotification(id);
+        if (row != -1) {
+            expiredRows.append(row);
+        }
+    }
+    expiredNotifications.clear();
+
+    std::sort(expiredRows.begin(), expiredRows.end());
+
+    // Announce contiguous rows as one change
+    for (int i = 0; i < expiredRows.count();) {
+        int last = i;
+        while (last + 1 < expiredRows.count() && expiredRows.at(last + 1) <= expiredRows.at(last) + 1) {
+            ++last;
+        }
+
+        emit q->dataChanged(q->index(expiredRows.at(i), 0), q->index(expiredRows.at(last), 0), expiredRoles());
+
+        i = last + 1;
     }
 
-    timer->stop();
-    timer->setProperty("notificationId", notification.id());
-    timer->setInterval(60000 /*1min*/ + (notification.timeout() == -1 ? 120000 /*2min, max configurable default timeout*/ : notification.timeout()));
-    timer->start();
+    scheduleNotificationTimeouts();
 }
 
 void AbstractNotificationsModel::Private::removeRows(const QVector<int> &rows)
@@ -207,31 +327,139 @@ void AbstractNotificationsModel::Private::removeRows(const QVector<int> &rows)
 
     for (int i = clearQueue.count() - 1; i >= 0; --i) {
         const auto &range = clearQueue.at(i);
+        const int count = range.second - range.first + 1;
 
         q->beginRemoveRows(QModelIndex(), range.first, range.second);
-        for (int j = range.second; j >= range.first; --j) {
-            notifications.removeAt(j);
-            ++rowsRemoved;
+        for (int j = range.first; j <= range.second; ++j) {
+            rowIndex.remove(notifications.at(j).id());
+            removeFromHistory(notifications.at(j).id());
         }
+        notifications.remove(range.first, count);
+        rowsRemoved += count;
+        // Rows after the removed ones moved up. Rather than renumbering them for every range,
+        // this is done once at the end, unless someone asks for a row in the meantime.
+        staleRowIndexFrom = range.first;
         q->endRemoveRows();
     }
 
+    if (staleRowIndexFrom != -1) {
+        updateRowIndex(staleRowIndexFrom);
+    }
+
     Q_ASSERT(rowsRemoved == rowsToBeRemoved.count());
 
     pendingRemovals.clear();
 }
 
-int AbstractNotificationsModel::rowOfNotification(uint id) const
+void AbstractNotificationsModel::Private::updateRowIndex(int fromRow)
+{
+    staleRowIndexFrom = -1;
+
+    if (fromRow == 0) {
+        rowIndex.clear();
+        rowIndex.reserve(notifications.count());
+    }
+
+    for (int row = fromRow; row < notifications.count(); ++row) {
+        rowIndex.insert(notifications.at(row).id(), row);
+    }
+}
+
+void AbstractNotificationsModel::Private::saveToHistory(int row)
 {
-    auto it = std::find_if(d->notifications.constBegin(), d->notifications.constEnd(), [id](const Notification &item) {
-        return item.id() == id;
+    if (!history) {
+        return;
+    }
+
+    const Notification &notification = notifications.at(row);
+    // Transient notifications are not meant to be kept around
+    if (!notification.expired() || notification.transient()) {
+        return;
+    }
+
+    removeFromHistory(notification.id());
+
+    const quint64 key = nextHistoryKey++;
+    historyKeys.insert(notification.id(), key);
+    pendingHistoryAdds.insert(key, notification);
+    historyWriteTimer.start();
+}
+
+void AbstractNotificationsModel::Private::removeFromHistory(uint notificationId)
+{
+    const auto it = historyKeys.find(notificationId);
+    if (it == historyKeys.end()) {
+        return;
+    }
+
+    // No need to write what's gone again already
+    if (!pendingHistoryAdds.remove(it.value())) {
+        pendingHistoryRemovals.append(it.value());
+        historyWriteTimer.start();
+    }
+    historyKeys.erase(it);
+}
+
+void AbstractNotificationsModel::Private::writeHistory()
+{
+    historyWriteTimer.stop();
+    if (!history || (pendingHistoryAdds.isEmpty() && pendingHistoryRemovals.isEmpty())) {
+        return;
+    }
+
+    // The images are hashed and encoded by the writer, too
+    QtConcurrent::run(&historyWriter, [history = history, added = qExchange(pendingHistoryAdds, {}), removed = qExchange(pendingHistoryRemovals, {})] {
+        history->write(added, removed);
     });
+}
+
+void AbstractNotificationsModel::Private::waitForHistory()
+{
+    writeHistory();
+    historyWriter.waitForDone();
+}
+
+void AbstractNotificationsModel::Private::fetchHistory(int count)
+{
+    // Don't read in more than would be discarded again with the next notification
+    count = qMin(count, s_notificationsLimit - notifications.count());
+    if (!history || count <= 0) {
+        return;
+    }
 
-    if (it == d->notifications.constEnd()) {
-        return -1;
+    // Whatever was removed from the history must be gone from the journal before reading it
+    waitForHistory();
+
+    QSet<quint64> loadedKeys;
+    loadedKeys.reserve(historyKeys.count());
+    for (quint64 key : qAsConst(historyKeys)) {
+        loadedKeys.insert(key);
+    }
+
+    const auto entries = history->read(historyCursor, count, loadedKeys);
+    if (entries.isEmpty()) {
+        return;
     }
 
-    return std::distance(d->notifications.constBegin(), it);
+    // They are older than anything we have
+    q->beginInsertRows(QModelIndex(), 0, entries.count() - 1);
+    notifications.insert(0, entries.count(), Notification());
+    for (int i = 0; i < entries.count(); ++i) {
+        Notification &notification = notifications[i];
+        notification = entries.at(i).second;
+        notification.d->id = nextHistoryId--;
+        historyKeys.insert(notification.id(), entries.at(i).first);
+    }
+    updateRowIndex(0);
+    q->endInsertRows();
+}
+
+int AbstractNotificationsModel::rowOfNotification(uint id) const
+{
+    if (d->staleRowIndexFrom != -1) {
+        d->updateRowIndex(d->staleRowIndexFrom);
+    }
+    return d->rowIndex.value(id, -1);
 }
 
 AbstractNotificationsModel::AbstractNotificationsModel()
@@ -379,6 +607,11 @@ bool AbstractNotificationsModel::setData(const QModelIndex &index, const QVarian
     case Notifications::ExpiredRole:
         if (value.toBool() != notification.expired()) {
             notification.setExpired(value.toBool());
+            if (notification.expired()) {
+                d->saveToHistory(index.row());
+            } else {
+                d->removeFromHistory(notification.id());
+            }
             dirty = true;
         }
         break;
@@ -405,6 +638,24 @@ QHash<int, QByteArray> AbstractNotificationsModel::roleNames() const
     return Utils::roleNames();
 }
 
+bool AbstractNotificationsModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !d->history || d->notifications.count() >= s_notificationsLimit) {
+        return false;
+    }
+
+    return d->history->hasEntriesBefore(d->historyCursor);
+}
+
+void AbstractNotificationsModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid()) {
+        return;
+    }
+
+    d->fetchHistory(s_historyPageSize);
+}
+
 void AbstractNotificationsModel::startTimeout(uint notificationId)
 {
     const int row = rowOfNotification(notificationId);
@@ -423,11 +674,23 @@ void AbstractNotificationsModel::startTimeout(uint notificationId)
 
 void AbstractNotificationsModel::stopTimeout(uint notificationId)
 {
-    delete d->notificationTimeouts.take(notificationId);
+    d->removeNotificationTimeout(notificationId);
 }
 
 void AbstractNotificationsModel::clear(Notifications::ClearFlags flags)
 {
+    // This also covers what hasn't been loaded from the history
+    if (flags.testFlag(Notifications::ClearExpired) && d->history) {
+        d->historyWriteTimer.stop();
+        d->pendingHistoryAdds.clear();
+        d->pendingHistoryRemovals.clear();
+        QtConcurrent::run(&d->historyWriter, [history = d->history] {
+            history->clear();
+        });
+        d->historyKeys.clear();
+        d->historyCursor = d->nextHistoryKey;
+    }
+
     if (d->notifications.isEmpty()) {
         return;
     }
@@ -465,6 +728,29 @@ void AbstractNotificationsModel::setupNotificationTimeout(const Notification &no
     d->setupNotificationTimeout(notification);
 }
 
+void AbstractNotificationsModel::loadHistory(const QString &directory)
+{
+    if (d->history && d->history->directory() == directory) {
+        return;
+    }
+
+    // Whatever is left goes to the old history
+    d->waitForHistory();
+
+    d->history.reset(new NotificationHistory(directory));
+    d->history->load();
+    d->historyKeys.clear();
+    d->nextHistoryKey = d->history->nextKey();
+    d->historyCursor = d->nextHistoryKey;
+
+    d->fetchHistory(s_historyPageSize);
+}
+
+bool AbstractNotificationsModel::isInHistory(uint notificationId) const
+{
+    return d->historyKeys.contains(notificationId);
+}
+
 const QVector<Notification> &AbstractNotificationsModel::notifications()
 {
     return d->notifications;
@@ -32,6 +32,9 @@ public:
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QHash<int, QByteArray> roleNames() const override;
 
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
     virtual void expire(uint notificationId) = 0;
     virtual void close(uint notificationId) = 0;
 
@@ -57,6 +60,18 @@ protected:
     void onNotificationRemoved(uint notificationId, Server::CloseReason reason);
 
     void setupNotificationTimeout(const Notification &notification);
+
+    /**
+     * Keeps expired notifications in an on-disk history in @p directory.
+     * The most recent ones are loaded right away, older ones through fetchMore().
+     */
+    void loadHistory(const QString &directory);
+    /**
+     * Whether the notification is an expired one kept in the history.
+     * The server is done with those, it doesn't know the ids of the ones read from disk either.
+     */
+    bool isInHistory(uint notificationId) const;
+
     const QVector<Notification> &notifications();
     int rowOfNotification(uint id) const;
 
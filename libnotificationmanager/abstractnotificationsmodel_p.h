@@ -10,12 +10,23 @@
 #include "server.h"
 
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMultiMap>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include <QTimer>
 
+#include <limits>
+
 class QTimer;
 
 namespace NotificationManager
 {
+class NotificationHistory;
+
 class Q_DECL_HIDDEN AbstractNotificationsModel::Private
 {
 public:
@@ -27,21 +38,58 @@ public:
     void onNotificationRemoved(uint notificationId, Server::CloseReason reason);
 
     void setupNotificationTimeout(const Notification &notification);
+    void removeNotificationTimeout(uint notificationId);
+    void scheduleNotificationTimeouts();
+    void expireDueNotifications();
 
     void removeRows(const QVector<int> &rows);
+    void updateRowIndex(int fromRow);
+
+    void saveToHistory(int row);
+    void removeFromHistory(uint notificationId);
+    void fetchHistory(int count);
+    void writeHistory();
+    void waitForHistory();
 
     AbstractNotificationsModel *q;
 
     QVector<Notification> notifications;
+    QHash<uint /*notificationId*/, int /*row*/> rowIndex;
+    // While removing rows, the ones from here on are not renumbered yet
+    int staleRowIndexFrom = -1;
     // Fallback timeout to ensure all notifications expire eventually
     // otherwise when it isn't shown to the user and doesn't expire
     // an app might wait indefinitely for the notification to do so
-    QHash<uint /*notificationId*/, QTimer *> notificationTimeouts;
+    // A single timer is armed for the earliest deadline of all of them.
+    QHash<uint /*notificationId*/, qint64 /*deadline*/> notificationDeadlines;
+    QMultiMap<qint64 /*deadline*/, uint /*notificationId*/> notificationTimeouts;
+    QElapsedTimer notificationTimeoutClock;
+    QTimer notificationTimeoutTimer;
 
-    QVector<uint /*notificationId*/> pendingRemovals;
+    // Notifications expired by the timeout, to announce in one go
+    bool expiringNotifications = false;
+    QVector<uint /*notificationId*/> expiredNotifications;
+
+    QSet<uint /*notificationId*/> pendingRemovals;
     QTimer pendingRemovalTimer;
 
     QDateTime lastRead;
+
+    // Expired notifications are kept on disk, only the most recent ones are loaded
+    QSharedPointer<NotificationHistory> history;
+    QHash<uint /*notificationId*/, quint64 /*key*/> historyKeys;
+    // Keys are handed out here, so a notification is part of the history before it is written
+    quint64 nextHistoryKey = 1;
+    // Notifications in the history older than this have not been looked at yet
+    quint64 historyCursor = 0;
+    // Changes to the history are written in batches on a thread of their own, in order
+    QMap<quint64 /*key*/, Notification> pendingHistoryAdds;
+    QVector<quint64 /*key*/> pendingHistoryRemovals;
+    QTimer historyWriteTimer;
+    QThreadPool historyWriter;
+    // Notifications read from the history get ids counting down from the top
+    // so they don't clash with the ones handed out by the server
+    uint nextHistoryId = std::numeric_limits<uint>::max();
 };
 
 }
@@ -6,7 +6,11 @@
 */
 
 #include <QDebug>
+#include <QDir>
+#include <QImage>
 #include <QObject>
+#include <QStandardPaths>
+#include <QTemporaryDir>
 #include <QtTest>
 
 #include "notification.h"
@@ -23,12 +27,23 @@ public:
     {
     }
 private Q_SLOTS:
+    void initTestCase();
+
     void parse_data();
     void parse();
 
     void compressNotificationRemoval();
+    void rowOfNotification();
+    void history();
 };
 
+void NotificationTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    // Start without a history in case the model gets to serve notifications
+    QDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/notificationmanager")).removeRecursively();
+}
+
 void NotificationTest::parse_data()
 {
     QTest::addColumn<QString>("messageIn");
@@ -93,6 +108,16 @@ void NotificationTest::compressNotificationRemoval()
     QSignalSpy rowsRemovedSpy(model.data(), &QAbstractItemModel::rowsRemoved);
     QVERIFY(rowsRemovedSpy.isValid());
 
+    // The remaining rows must be found where they are whenever a removal is announced
+    int misplacedRows = 0;
+    connect(model.data(), &QAbstractItemModel::rowsRemoved, model.data(), [&model, &misplacedRows] {
+        for (int row = 0; row < model->rowCount(); ++row) {
+            if (model->rowOfNotification(model->index(row, 0).data(Notifications::IdRole).toUInt()) != row) {
+                ++misplacedRows;
+            }
+        }
+    });
+
     for (uint i = 1; i <= notificationCount; ++i) {
         Notification notification{i};
         notification.setSummary(QStringLiteral("Notification %1").arg(i));
@@ -122,6 +147,7 @@ void NotificationTest::compressNotificationRemoval()
 
     QCOMPARE(removedCount, notificationCount - 1);
     QCOMPARE(model->rowCount(), 1);
+    QCOMPARE(misplacedRows, 0);
 
     rowsRemovedSpy.clear();
 
@@ -139,6 +165,141 @@ void NotificationTest::compressNotificationRemoval()
     QCOMPARE(model->rowCount(), 0);
 }
 
+void NotificationTest::rowOfNotification()
+{
+    auto model = NotificationsModel::createNotificationsModel();
+
+    const uint firstId = 1;
+    const uint count = 1100;
+
+    for (uint id = firstId; id < firstId + count; ++id) {
+        model->onNotificationAdded(Notification{id});
+    }
+
+    // Reaching the limit of 1000 notifications discarded the oldest 500
+    QCOMPARE(model->rowCount(), 600);
+    QCOMPARE(model->rowOfNotification(firstId), -1);
+    QCOMPARE(model->rowOfNotification(firstId + 499), -1);
+
+    for (int row = 0; row < model->rowCount(); ++row) {
+        const uint id = firstId + 500 + row;
+        QCOMPARE(model->index(row, 0).data(Notifications::IdRole).toUInt(), id);
+        QCOMPARE(model->rowOfNotification(id), row);
+    }
+
+    Notification replacement{firstId + 600};
+    replacement.setSummary(QStringLiteral("Replacement"));
+    model->onNotificationReplaced(firstId + 600, replacement);
+    QCOMPARE(model->rowOfNotification(firstId + 600), 100);
+    QCOMPARE(model->index(100, 0).data(Notifications::SummaryRole).toString(), QStringLiteral("Replacement"));
+
+    // Remove every other notification in one go
+    for (uint id = firstId + 500; id < firstId + count; id += 2) {
+        model->onNotificationRemoved(id, Server::CloseReason::Revoked);
+    }
+
+    QTRY_COMPARE(model->rowCount(), 300);
+
+    for (int row = 0; row < model->rowCount(); ++row) {
+        const uint id = firstId + 501 + row * 2;
+        QCOMPARE(model->index(row, 0).data(Notifications::IdRole).toUInt(), id);
+        QCOMPARE(model->rowOfNotification(id), row);
+    }
+
+    QCOMPARE(model->rowOfNotification(firstId + 500), -1);
+}
+
+void NotificationTest::history()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    const uint count = 120;
+    const uint dismissedId = 5;
+    const int pageSize = 50;
+
+    QImage image(16, 16, QImage::Format_ARGB32);
+    image.fill(Qt::red);
+
+    {
+        auto model = NotificationsModel::createNotificationsModel();
+        model->loadHistory(directory.path());
+        QCOMPARE(model->rowCount(), 0);
+
+        for (uint id = 1; id <= count; ++id) {
+            Notification notification{id};
+            notification.setSummary(QStringLiteral("Notification %1").arg(id));
+            if (id % 2) {
+                notification.setImage(image);
+            }
+            model->onNotificationAdded(notification);
+            model->onNotificationRemoved(id, Server::CloseReason::Expired);
+        }
+
+        model->onNotificationRemoved(dismissedId, Server::CloseReason::DismissedByUser);
+        QTRY_COMPARE(model->rowCount(), int(count) - 1);
+    }
+
+    // All of them share a single image file
+    QCOMPARE(QDir(directory.path() + QLatin1String("/images")).entryList(QDir::Files).count(), 1);
+
+    {
+        auto model = NotificationsModel::createNotificationsModel();
+        model->loadHistory(directory.path());
+
+        // Only the most recent ones are loaded right away
+        QCOMPARE(model->rowCount(), pageSize);
+        QCOMPARE(model->index(pageSize - 1, 0).data(Notifications::SummaryRole).toString(), QStringLiteral("Notification %1").arg(count));
+
+        while (model->canFetchMore(QModelIndex())) {
+            model->fetchMore(QModelIndex());
+        }
+        QCOMPARE(model->rowCount(), int(count) - 1);
+
+        uint id = 1;
+        for (int row = 0; row < model->rowCount(); ++row, ++id) {
+            if (id == dismissedId) {
+                ++id;
+            }
+
+            const QModelIndex idx = model->index(row, 0);
+            QCOMPARE(idx.data(Notifications::SummaryRole).toString(), QStringLiteral("Notification %1").arg(id));
+            QVERIFY(idx.data(Notifications::ExpiredRole).toBool());
+            QCOMPARE(idx.data(Notifications::ImageRole).value<QImage>().size(), id % 2 ? image.size() : QSize(0, 0));
+            QCOMPARE(model->rowOfNotification(idx.data(Notifications::IdRole).toUInt()), row);
+        }
+
+        // Closing one from the history doesn't go through the server, which never heard of its id
+        QSignalSpy removedSpy(&Server::self(), &Server::notificationRemoved);
+        QVERIFY(removedSpy.isValid());
+        model->close(model->index(0, 0).data(Notifications::IdRole).toUInt());
+        QTRY_COMPARE(model->rowCount(), int(count) - 2);
+        QVERIFY(removedSpy.isEmpty());
+    }
+
+    {
+        auto model = NotificationsModel::createNotificationsModel();
+        model->loadHistory(directory.path());
+
+        while (model->canFetchMore(QModelIndex())) {
+            model->fetchMore(QModelIndex());
+        }
+        // The one closed is gone from disk, too
+        QCOMPARE(model->rowCount(), int(count) - 2);
+        QCOMPARE(model->index(0, 0).data(Notifications::SummaryRole).toString(), QStringLiteral("Notification 2"));
+
+        model->clear(Notifications::ClearExpired);
+        QCOMPARE(model->rowCount(), 0);
+    }
+
+    {
+        auto model = NotificationsModel::createNotificationsModel();
+        model->loadHistory(directory.path());
+        QCOMPARE(model->rowCount(), 0);
+        QVERIFY(!model->canFetchMore(QModelIndex()));
+    }
+}
+
 } // namespace NotificationManager
 
 QTEST_GUILESS_MAIN(NotificationManager::NotificationTest)
@@ -135,6 +135,7 @@ private:
     friend class NotificationsModel;
     friend class AbstractNotificationsModel;
     friend class ServerPrivate;
+    friend class NotificationHistory;
 
     class Private;
     Private *d;
@@ -0,0 +1,538 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "notificationhistory_p.h"
+
+#include "debug.h"
+#include "notification.h"
+#include "notification_p.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+using namespace NotificationManager;
+
+namespace
+{
+const quint32 s_magic = 0x4e4f5448; // "NOTH"
+const quint32 s_version = 1;
+const qint64 s_headerSize = 2 * sizeof(quint32);
+// type + payload length + payload checksum
+const qint64 s_recordHeaderSize = sizeof(quint8) + 2 * sizeof(quint32);
+// Don't bother compacting small journals, rewriting them is cheap but pointless
+const qint64 s_minCompactionSize = 64 * 1024;
+// The oldest notifications are dropped beyond this
+const int s_historyLimit = 1000;
+const QDataStream::Version s_streamVersion = QDataStream::Qt_5_12;
+
+quint32 checksum(const QByteArray &data)
+{
+    return qChecksum(data.constData(), data.size());
+}
+
+QByteArray fileHeader()
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream << s_magic << s_version;
+    return header;
+}
+}
+
+NotificationHistory::NotificationHistory(const QString &directory)
+    : m_directory(directory)
+    , m_fileName(directory + QLatin1String("/history.journal"))
+{
+}
+
+NotificationHistory::~NotificationHistory()
+{
+}
+
+QString NotificationHistory::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/notificationmanager");
+}
+
+QString NotificationHistory::imageFileName(const QByteArray &hash) const
+{
+    return m_directory + QLatin1String("/images/") + QString::fromLatin1(hash.toHex()) + QLatin1String(".png");
+}
+
+QByteArray NotificationHistory::notificationRecord(quint64 key, const Notification &notification, const QByteArray &imageHash)
+{
+    const Notification::Private *d = notification.d;
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(s_streamVersion);
+    // The index only needs the key and image, keep them in front
+    stream << key << imageHash << d->created << d->updated << d->read;
+    stream << d->summary << d->body << d->rawBody << d->icon;
+    stream << d->applicationName << d->applicationIconName << d->originName;
+    // Store what was looked up for the service and notifyrc, so loading doesn't have to do that again
+    stream << d->desktopEntry << d->serviceName << d->configurableService;
+    stream << d->notifyRcName << d->eventId << d->configurableNotifyRc;
+    stream << d->category << d->urls << qint32(d->urgency);
+    return record(NotificationRecord, payload);
+}
+
+QByteArray NotificationHistory::record(RecordType type, const QByteArray &payload)
+{
+    QByteArray data;
+    data.reserve(s_recordHeaderSize + payload.size());
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << quint8(type) << quint32(payload.size()) << checksum(payload);
+    data.append(payload);
+    return data;
+}
+
+void NotificationHistory::reset()
+{
+    m_file.close();
+    m_fileSize = 0;
+    m_entries.clear();
+    m_liveSize = 0;
+}
+
+bool NotificationHistory::load()
+{
+    QMutexLocker locker(&m_mutex);
+    return loadJournal();
+}
+
+bool NotificationHistory::loadJournal()
+{
+    static const char failed_load_warning[] = "Failed to load notification history.";
+    reset();
+    m_readOnly = false;
+
+    if (QFileInfo(m_fileName).size() == 0) {
+        return false;
+    }
+    // Until it's been read there is no telling what we would throw away by writing to it
+    m_readOnly = true;
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_load_warning << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != s_magic || version != s_version) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_load_warning << "Unknown file format";
+        return false;
+    }
+
+    const qint64 size = file.size();
+    qint64 goodEnd = s_headerSize;
+    while (!stream.atEnd()) {
+        const qint64 offset = file.pos();
+        quint8 type = 0;
+        quint32 length = 0;
+        quint32 crc = 0;
+        stream >> type >> length >> crc;
+        const qint64 payloadOffset = offset + s_recordHeaderSize;
+        if (stream.status() != QDataStream::Ok || length > size - payloadOffset) {
+            break;
+        }
+        const QByteArray payload = file.read(length);
+        if (payload.size() != int(length) || checksum(payload) != crc) {
+            break;
+        }
+        const qint64 recordSize = s_recordHeaderSize + length;
+        goodEnd = offset + recordSize;
+
+        // Only the key and image are needed for the index, the rest is decoded when the notification is read
+        QDataStream payloadStream(payload);
+        payloadStream.setVersion(s_streamVersion);
+        quint64 key = 0;
+        payloadStream >> key;
+        m_nextKey = qMax(m_nextKey, key + 1);
+
+        switch (type) {
+        case NotificationRecord: {
+            RecordRef ref{offset, recordSize, QByteArray()};
+            payloadStream >> ref.imageHash;
+            m_liveSize += ref.size - m_entries.value(key).size;
+            m_entries.insert(key, ref);
+            break;
+        }
+        case RemoveRecord:
+            m_liveSize -= m_entries.take(key).size;
+            break;
+        default:
+            qCWarning(NOTIFICATIONMANAGER) << failed_load_warning << "Skipping unknown record type" << type;
+            break;
+        }
+    }
+    file.close();
+
+    if (goodEnd < size) {
+        qCWarning(NOTIFICATIONMANAGER) << "Notification history has a corrupt tail, dropping" << (size - goodEnd) << "bytes";
+        if (!QFile::resize(m_fileName, goodEnd)) {
+            qCWarning(NOTIFICATIONMANAGER) << failed_load_warning << "Could not truncate journal";
+        }
+    }
+    m_fileSize = goodEnd;
+    m_readOnly = false;
+
+    // The limit might have been reached right before it got compacted
+    trim();
+    return true;
+}
+
+bool NotificationHistory::openForAppend()
+{
+    if (m_file.isOpen()) {
+        return true;
+    }
+    if (m_readOnly) {
+        return false;
+    }
+    if (m_fileSize < s_headerSize && QFileInfo(m_fileName).size() > 0 && !loadJournal()) {
+        // Never start over on top of something we haven't read
+        return false;
+    }
+    if (!QDir().mkpath(m_directory + QLatin1String("/images"))) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to create notification history directory" << m_directory;
+        return false;
+    }
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to open notification history" << m_file.errorString();
+        return false;
+    }
+    if (m_fileSize < s_headerSize) {
+        // There is no journal yet, or just an empty file
+        m_entries.clear();
+        m_liveSize = 0;
+        if (!m_file.resize(0) || m_file.write(fileHeader()) != s_headerSize) {
+            qCWarning(NOTIFICATIONMANAGER) << "Failed to write notification history" << m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+    m_fileSize = m_file.size();
+    return true;
+}
+
+bool NotificationHistory::append(const QByteArray &data, RecordRef *ref)
+{
+    if (m_file.write(data) != data.size()) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to append to notification history" << m_file.errorString();
+        recover();
+        return false;
+    }
+    if (ref) {
+        ref->offset = m_fileSize;
+        ref->size = data.size();
+    }
+    m_fileSize += data.size();
+    return true;
+}
+
+bool NotificationHistory::flush()
+{
+    if (!m_file.flush()) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to write notification history" << m_file.errorString();
+        recover();
+        return false;
+    }
+    return true;
+}
+
+void NotificationHistory::recover()
+{
+    // We can't tell how much of the last write made it to disk. Read the journal
+    // again rather than starting over, a torn record at its end gets cut off then.
+    m_file.close();
+    loadJournal();
+}
+
+void NotificationHistory::trim()
+{
+    // Dropped records are left for the compaction to get rid of
+    while (m_entries.count() > s_historyLimit) {
+        m_liveSize -= m_entries.first().size;
+        m_entries.erase(m_entries.begin());
+    }
+}
+
+bool NotificationHistory::needsCompaction() const
+{
+    const qint64 dead = m_fileSize - s_headerSize - m_liveSize;
+    return dead > s_minCompactionSize && dead > m_liveSize;
+}
+
+QByteArray NotificationHistory::storeImage(const QImage &image)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    {
+        QByteArray geometry;
+        QDataStream stream(&geometry, QIODevice::WriteOnly);
+        stream << image.size() << qint32(image.format()) << qint32(image.bytesPerLine());
+        hash.addData(geometry);
+    }
+    hash.addData(reinterpret_cast<const char *>(image.constBits()), int(image.sizeInBytes()));
+    const QByteArray result = hash.result();
+
+    const QString fileName = imageFileName(result);
+    if (QFile::exists(fileName)) {
+        return result;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || !image.save(&file, "PNG") || !file.commit()) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to store notification image" << fileName << file.errorString();
+        return QByteArray();
+    }
+    return result;
+}
+
+void NotificationHistory::appendNotification(quint64 key, const Notification &notification)
+{
+    m_nextKey = qMax(m_nextKey, key + 1);
+    if (!openForAppend()) {
+        return;
+    }
+
+    const QImage image = notification.image();
+    const QByteArray imageHash = image.isNull() ? QByteArray() : storeImage(image);
+
+    RecordRef ref;
+    ref.imageHash = imageHash;
+    if (append(notificationRecord(key, notification, imageHash), &ref)) {
+        m_entries.insert(key, ref);
+        m_liveSize += ref.size;
+    }
+}
+
+void NotificationHistory::appendRemoval(quint64 key)
+{
+    if (!m_entries.contains(key) || !openForAppend()) {
+        return;
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(s_streamVersion);
+    stream << key;
+    if (append(record(RemoveRecord, payload))) {
+        m_liveSize -= m_entries.take(key).size;
+    }
+}
+
+void NotificationHistory::write(const QMap<quint64, Notification> &added, const QVector<quint64> &removed)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // A failed append reads the journal back and closes it, the next one opens it again
+    for (auto it = added.constBegin(); it != added.constEnd(); ++it) {
+        appendNotification(it.key(), it.value());
+    }
+    for (quint64 key : removed) {
+        appendRemoval(key);
+    }
+    trim();
+
+    if (m_file.isOpen() && flush() && needsCompaction()) {
+        compact();
+    }
+}
+
+quint64 NotificationHistory::nextKey() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_nextKey;
+}
+
+bool NotificationHistory::hasEntriesBefore(quint64 before) const
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_entries.isEmpty() && m_entries.firstKey() < before;
+}
+
+QVector<std::pair<quint64, Notification>> NotificationHistory::read(quint64 &before, int count, const QSet<quint64> &skip)
+{
+    static const char failed_read_warning[] = "Failed to read notification history.";
+
+    QMutexLocker locker(&m_mutex);
+
+    QVector<std::pair<quint64, Notification>> notifications;
+    if (m_entries.isEmpty() || m_entries.firstKey() >= before || count <= 0) {
+        return notifications;
+    }
+
+    // records may still sit in the buffer of the appending file
+    if (m_file.isOpen()) {
+        m_file.flush();
+    }
+
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_read_warning << file.errorString();
+        return notifications;
+    }
+
+    notifications.reserve(count);
+    // Notifications of one application tend to have the same image, share it between them
+    QHash<QByteArray, QImage> images;
+
+    auto it = m_entries.lowerBound(before);
+    while (it != m_entries.begin() && notifications.count() < count) {
+        --it;
+        before = it.key();
+
+        if (skip.contains(it.key())) {
+            continue;
+        }
+
+        const RecordRef &ref = it.value();
+        if (!file.seek(ref.offset)) {
+            qCWarning(NOTIFICATIONMANAGER) << failed_read_warning << file.errorString();
+            break;
+        }
+        const QByteArray data = file.read(ref.size);
+        const QByteArray payload = data.mid(s_recordHeaderSize);
+
+        QDataStream headerStream(data);
+        quint8 type = 0;
+        quint32 length = 0;
+        quint32 crc = 0;
+        headerStream >> type >> length >> crc;
+        if (data.size() != ref.size || type != NotificationRecord || payload.size() != int(length) || checksum(payload) != crc) {
+            qCWarning(NOTIFICATIONMANAGER) << failed_read_warning << "Corrupt record for" << it.key();
+            continue;
+        }
+
+        Notification notification;
+        Notification::Private *d = notification.d;
+
+        QDataStream stream(payload);
+        stream.setVersion(s_streamVersion);
+        quint64 key = 0;
+        QByteArray imageHash;
+        qint32 urgency = 0;
+        stream >> key >> imageHash >> d->created >> d->updated >> d->read;
+        stream >> d->summary >> d->body >> d->rawBody >> d->icon;
+        stream >> d->applicationName >> d->applicationIconName >> d->originName;
+        stream >> d->desktopEntry >> d->serviceName >> d->configurableService;
+        stream >> d->notifyRcName >> d->eventId >> d->configurableNotifyRc;
+        stream >> d->category >> d->urls >> urgency;
+        d->urgency = static_cast<Notifications::Urgency>(urgency);
+        d->expired = true;
+
+        if (!imageHash.isEmpty()) {
+            auto imageIt = images.find(imageHash);
+            if (imageIt == images.end()) {
+                imageIt = images.insert(imageHash, QImage(imageFileName(imageHash), "PNG"));
+            }
+            d->image = imageIt.value();
+        }
+
+        notifications.append({key, notification});
+    }
+
+    std::reverse(notifications.begin(), notifications.end());
+    return notifications;
+}
+
+bool NotificationHistory::compact()
+{
+    static const char failed_compact_warning[] = "Failed to compact notification history.";
+    m_file.close();
+
+    // live records are copied over verbatim, there is no need to decode and re-encode them
+    QFile oldFile(m_fileName);
+    if (!oldFile.open(QIODevice::ReadOnly)) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_compact_warning << oldFile.errorString();
+        return false;
+    }
+
+    QSaveFile newFile(m_fileName);
+    if (!newFile.open(QIODevice::WriteOnly)) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_compact_warning << newFile.errorString();
+        return false;
+    }
+
+    QMap<quint64, RecordRef> newEntries;
+    qint64 pos = newFile.write(fileHeader());
+
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const RecordRef &oldRef = it.value();
+        QByteArray data;
+        if (oldFile.seek(oldRef.offset)) {
+            data = oldFile.read(oldRef.size);
+        }
+        if (data.size() != oldRef.size) {
+            qCWarning(NOTIFICATIONMANAGER) << failed_compact_warning << "Dropping unreadable record for" << it.key();
+            continue;
+        }
+        newEntries.insert(it.key(), RecordRef{pos, oldRef.size, oldRef.imageHash});
+        pos += newFile.write(data);
+    }
+    oldFile.close();
+
+    if (!newFile.commit()) {
+        qCWarning(NOTIFICATIONMANAGER) << failed_compact_warning << newFile.errorString();
+        // the old file is still intact, and so is what we know about it
+        return false;
+    }
+
+    m_entries = newEntries;
+    m_liveSize = pos - s_headerSize;
+    m_fileSize = pos;
+
+    removeUnusedImages();
+    return true;
+}
+
+void NotificationHistory::removeUnusedImages()
+{
+    QSet<QString> used;
+    for (const RecordRef &ref : qAsConst(m_entries)) {
+        if (!ref.imageHash.isEmpty()) {
+            used.insert(QString::fromLatin1(ref.imageHash.toHex()) + QLatin1String(".png"));
+        }
+    }
+
+    QDir images(m_directory + QLatin1String("/images"));
+    const QStringList fileNames = images.entryList({QStringLiteral("*.png")}, QDir::Files);
+    for (const QString &fileName : fileNames) {
+        if (!used.contains(fileName)) {
+            images.remove(fileName);
+        }
+    }
+}
+
+bool NotificationHistory::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    reset();
+    m_readOnly = false;
+    m_nextKey = 1;
+
+    QDir directory(m_directory);
+    if (directory.exists() && !directory.removeRecursively()) {
+        qCWarning(NOTIFICATIONMANAGER) << "Failed to remove notification history" << m_directory;
+        return false;
+    }
+    return true;
+}
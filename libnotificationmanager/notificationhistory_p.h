@@ -0,0 +1,146 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include <utility>
+
+class QImage;
+
+namespace NotificationManager
+{
+class Notification;
+
+/**
+ * Append-only on-disk store for the notification history.
+ *
+ * Every notification is written exactly once as its own checksummed record,
+ * keyed by an ever increasing number. Removing one only appends a tombstone
+ * for its key. Just the offsets of the records still in the history are kept
+ * in memory, the notifications themselves are read back a page at a time.
+ *
+ * The history is capped at a fixed number of notifications, the oldest ones
+ * are dropped. Once the superseded records outweigh the live ones the journal
+ * is compacted into a fresh file.
+ *
+ * Images are stored next to the journal, named after the hash of their pixels,
+ * so an application sending the same image over and over again only takes up
+ * space for it once. Images no longer used are deleted when compacting.
+ *
+ * A torn record at the end of the file (e.g. after a crash in the middle of
+ * an append) fails its checksum and is cut off when loading. After a failed
+ * write the journal is loaded again for the same reason. A journal which
+ * can't be read is never written to, until it is cleared.
+ *
+ * All methods can be called from any thread, so that writing, which hashes
+ * and encodes the images, can be left to a worker thread.
+ */
+class Q_DECL_HIDDEN NotificationHistory
+{
+public:
+    explicit NotificationHistory(const QString &directory);
+    ~NotificationHistory();
+
+    /**
+     * Where the history of the notification server is kept.
+     */
+    static QString defaultDirectory();
+
+    QString directory() const
+    {
+        return m_directory;
+    }
+
+    /**
+     * Reads the index of the journal from disk.
+     * @return false if there is no usable journal
+     */
+    bool load();
+
+    /**
+     * Appends the notifications in @p added under their keys, which must be larger than
+     * any key in the history, and drops those in @p removed. Everything is flushed at once.
+     */
+    void write(const QMap<quint64, Notification> &added, const QVector<quint64> &removed);
+
+    /**
+     * Removes the journal and all images from disk.
+     */
+    bool clear();
+
+    /**
+     * Larger than all keys in the history, where the keys of new notifications start.
+     */
+    quint64 nextKey() const;
+
+    /**
+     * Whether there are notifications in the history with a key smaller than @p before.
+     */
+    bool hasEntriesBefore(quint64 before) const;
+
+    /**
+     * Reads up to @p count of the most recent notifications with a key smaller than
+     * @p before, leaving out those in @p skip. @p before is moved to the oldest key looked at.
+     * @return the notifications with their keys, oldest first
+     */
+    QVector<std::pair<quint64, Notification>> read(quint64 &before, int count, const QSet<quint64> &skip);
+
+private:
+    enum RecordType : quint8 {
+        NotificationRecord = 1,
+        RemoveRecord = 2,
+    };
+    struct RecordRef {
+        qint64 offset = 0;
+        qint64 size = 0;
+        QByteArray imageHash;
+    };
+
+    bool loadJournal();
+    bool openForAppend();
+    void appendNotification(quint64 key, const Notification &notification);
+    void appendRemoval(quint64 key);
+    bool append(const QByteArray &data, RecordRef *ref = nullptr);
+    bool flush();
+    void recover();
+    void trim();
+    bool needsCompaction() const;
+    bool compact();
+    void removeUnusedImages();
+    void reset();
+
+    QString imageFileName(const QByteArray &hash) const;
+    QByteArray storeImage(const QImage &image);
+
+    static QByteArray notificationRecord(quint64 key, const Notification &notification, const QByteArray &imageHash);
+    static QByteArray record(RecordType type, const QByteArray &payload);
+
+    mutable QMutex m_mutex;
+    QString m_directory;
+    QString m_fileName;
+    QFile m_file;
+    qint64 m_fileSize = 0;
+    /**
+     * Notification records in the current file which are still part of the history
+     */
+    QMap<quint64, RecordRef> m_entries;
+    qint64 m_liveSize = 0;
+    quint64 m_nextKey = 1;
+    /**
+     * The journal exists but could not be read, so it must not be written either
+     */
+    bool m_readOnly = false;
+};
+
+} // namespace NotificationManager
@@ -832,3 +832,21 @@ QHash<int, QByteArray> Notifications::roleNames() const
 {
     return Utils::roleNames();
 }
+
+bool Notifications::canFetchMore(const QModelIndex &parent) const
+{
+    // The notification history can't be reached through the concatenated model, ask it directly
+    if (!parent.isValid() && d->notificationsModel) {
+        return d->notificationsModel->canFetchMore(QModelIndex());
+    }
+    return QSortFilterProxyModel::canFetchMore(parent);
+}
+
+void Notifications::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid() && d->notificationsModel) {
+        d->notificationsModel->fetchMore(QModelIndex());
+        return;
+    }
+    QSortFilterProxyModel::fetchMore(parent);
+}
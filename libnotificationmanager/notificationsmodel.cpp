@@ -8,6 +8,7 @@
 #include "notificationsmodel.h"
 #include "abstractnotificationsmodel_p.h"
 #include "notification_p.h"
+#include "notificationhistory_p.h"
 #include "server.h"
 
 #include "debug.h"
@@ -49,11 +50,25 @@ NotificationsModel::NotificationsModel()
             }
         }
     });
+    // Only the process serving the notifications keeps a history of them
+    connect(&Server::self(), &Server::validChanged, this, [this] {
+        if (Server::self().isValid()) {
+            loadHistory(NotificationHistory::defaultDirectory());
+        }
+    });
     Server::self().init();
+    if (Server::self().isValid()) {
+        loadHistory(NotificationHistory::defaultDirectory());
+    }
 }
 
 void NotificationsModel::expire(uint notificationId)
 {
+    // It has expired already
+    if (isInHistory(notificationId)) {
+        return;
+    }
+
     if (rowOfNotification(notificationId) > -1) {
         Server::self().closeNotification(notificationId, Server::CloseReason::Expired);
     }
@@ -61,6 +76,12 @@ void NotificationsModel::expire(uint notificationId)
 
 void NotificationsModel::close(uint notificationId)
 {
+    // Nobody but us knows about it anymore, just drop it from the history
+    if (isInHistory(notificationId)) {
+        onNotificationRemoved(notificationId, Server::CloseReason::DismissedByUser);
+        return;
+    }
+
     if (rowOfNotification(notificationId) > -1) {
         Server::self().closeNotification(notificationId, Server::CloseReason::DismissedByUser);
     }
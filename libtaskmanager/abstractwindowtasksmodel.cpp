@@ -40,4 +40,21 @@ AbstractWindowTasksModel::~AbstractWindowTasksModel()
 {
 }
 
+void AbstractWindowTasksModel::stackingOrderChanged(const std::function<bool(int row)> &moved)
+{
+    const int count = rowCount();
+    int first = -1;
+
+    for (int row = 0; row <= count; ++row) {
+        const bool changed = row < count && moved(row);
+
+        if (changed && first == -1) {
+            first = row;
+        } else if (!changed && first != -1) {
+            Q_EMIT dataChanged(index(first, 0), index(row - 1, 0), QVector<int>{StackingOrder});
+            first = -1;
+        }
+    }
+}
+
 }
@@ -10,6 +10,8 @@
 
 #include "taskmanager_export.h"
 
+#include <functional>
+
 namespace TaskManager
 {
 /**
@@ -30,6 +32,18 @@ class TASKMANAGER_EXPORT AbstractWindowTasksModel : public AbstractTasksModel
 public:
     explicit AbstractWindowTasksModel(QObject *parent = nullptr);
     ~AbstractWindowTasksModel() override;
+
+protected:
+    /**
+     * Announces a change of the StackingOrder data role for the rows @p moved
+     * returns true for, one dataChanged() per run of consecutive rows.
+     *
+     * Raising or lowering a window only moves the windows between its old and
+     * new position, so this is usually much less than all of them.
+     *
+     * @param moved Whether the position of the window in a row changed.
+     */
+    void stackingOrderChanged(const std::function<bool(int row)> &moved);
 };
 
 }
@@ -0,0 +1,69 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QObject>
+#include <QSignalSpy>
+#include <QTest>
+
+#include "syntheticwindowtasksmodel.h"
+
+using namespace TaskManager;
+
+class AbstractWindowTasksModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testStackingOrderChanged();
+};
+
+void AbstractWindowTasksModelTest::testStackingOrderChanged()
+{
+    SyntheticWindowTasksModel model;
+    model.addWindows(10, 10);
+
+    QSignalSpy dataChangedSpy(&model, &QAbstractItemModel::dataChanged);
+    QVERIFY(dataChangedSpy.isValid());
+
+    auto verifyChanged = [&](int first, int last) {
+        const QList<QVariant> arguments = dataChangedSpy.takeFirst();
+        QCOMPARE(arguments.at(0).toModelIndex().row(), first);
+        QCOMPARE(arguments.at(1).toModelIndex().row(), last);
+        QCOMPARE(arguments.at(2).value<QVector<int>>(), QVector<int>{AbstractTasksModel::StackingOrder});
+    };
+
+    // Raising the top window doesn't move anything.
+    model.raiseWindow(9);
+    QVERIFY(dataChangedSpy.isEmpty());
+
+    // The raised window and those above it move.
+    model.raiseWindow(7);
+    QCOMPARE(dataChangedSpy.count(), 1);
+    verifyChanged(7, 9);
+    QCOMPARE(model.index(7, 0).data(AbstractTasksModel::StackingOrder).toInt(), 9);
+    QCOMPARE(model.index(8, 0).data(AbstractTasksModel::StackingOrder).toInt(), 7);
+    QCOMPARE(model.index(9, 0).data(AbstractTasksModel::StackingOrder).toInt(), 8);
+
+    // Every window is above the bottom one.
+    model.raiseWindow(0);
+    QCOMPARE(dataChangedSpy.count(), 1);
+    verifyChanged(0, 9);
+
+    // Rows 1 to 4 stay below row 5 and are left out, splitting the change in two.
+    model.raiseWindow(5);
+    QCOMPARE(dataChangedSpy.count(), 2);
+    verifyChanged(0, 0);
+    verifyChanged(5, 9);
+
+    for (int row = 1; row < 5; ++row) {
+        QCOMPARE(model.index(row, 0).data(AbstractTasksModel::StackingOrder).toInt(), row - 1);
+    }
+    QCOMPARE(model.index(5, 0).data(AbstractTasksModel::StackingOrder).toInt(), 9);
+}
+
+QTEST_MAIN(AbstractWindowTasksModelTest)
+
+#include "abstractwindowtasksmodeltest.moc"
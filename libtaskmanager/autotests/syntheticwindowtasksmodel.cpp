@@ -0,0 +1,320 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "syntheticwindowtasksmodel.h"
+
+#include <QRect>
+
+using namespace TaskManager;
+
+SyntheticWindowTasksModel::SyntheticWindowTasksModel(QObject *parent)
+    : AbstractWindowTasksModel(parent)
+{
+}
+
+SyntheticWindowTasksModel::~SyntheticWindowTasksModel()
+{
+}
+
+QVariant SyntheticWindowTasksModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_windows.count()) {
+        return QVariant();
+    }
+
+    const Window &window = m_windows.at(index.row());
+
+    if (role == Qt::DisplayRole) {
+        return window.title;
+    } else if (role == AppId) {
+        return QStringLiteral("app%1").arg(window.app);
+    } else if (role == AppName) {
+        return QStringLiteral("App %1").arg(window.app);
+    } else if (role == LauncherUrl || role == LauncherUrlWithoutIcon) {
+        return launcherUrl(window.app);
+    } else if (role == WinIdList) {
+        return QVariantList{window.id};
+    } else if (role == IsWindow) {
+        return true;
+    } else if (role == IsActive) {
+        return window.id == m_activeId;
+    } else if (role == IsClosable || role == IsMovable || role == IsResizable || role == IsMaximizable || role == IsMinimizable
+               || role == IsVirtualDesktopsChangeable) {
+        return true;
+    } else if (role == IsMinimized) {
+        return window.minimized;
+    } else if (role == IsMaximized || role == IsHidden || role == IsKeepAbove || role == IsKeepBelow || role == IsFullScreen || role == IsShaded) {
+        return false;
+    } else if (role == VirtualDesktops) {
+        return windowDesktops(window);
+    } else if (role == IsOnAllVirtualDesktops) {
+        return m_desktops.isEmpty();
+    } else if (role == Geometry || role == ScreenGeometry) {
+        return QRect(0, 0, 1920, 1080);
+    } else if (role == Activities) {
+        return windowActivities(window);
+    } else if (role == IsDemandingAttention || role == SkipTaskbar || role == SkipPager) {
+        return false;
+    } else if (role == StackingOrder) {
+        return m_stackingOrder.value(window.id, -1);
+    }
+
+    return QVariant();
+}
+
+int SyntheticWindowTasksModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_windows.count();
+}
+
+void SyntheticWindowTasksModel::requestActivate(const QModelIndex &index)
+{
+    if (!index.isValid() || index.model() != this || index.row() >= m_windows.count()) {
+        return;
+    }
+
+    const quint32 previousId = m_activeId;
+    m_activeId = m_windows.at(index.row()).id;
+
+    for (int i = 0; i < m_windows.count(); ++i) {
+        if (m_windows.at(i).id == previousId) {
+            Q_EMIT dataChanged(this->index(i, 0), this->index(i, 0), {IsActive});
+            break;
+        }
+    }
+
+    Q_EMIT dataChanged(index, index, {IsActive});
+}
+
+void SyntheticWindowTasksModel::requestToggleMinimized(const QModelIndex &index)
+{
+    if (!index.isValid() || index.model() != this || index.row() >= m_windows.count()) {
+        return;
+    }
+
+    Window &window = m_windows[index.row()];
+    window.minimized = !window.minimized;
+
+    Q_EMIT dataChanged(index, index, {IsMinimized});
+}
+
+void SyntheticWindowTasksModel::requestVirtualDesktops(const QModelIndex &index, const QVariantList &desktops)
+{
+    if (!index.isValid() || index.model() != this || index.row() >= m_windows.count() || desktops.isEmpty()) {
+        return;
+    }
+
+    const int desktop = m_desktops.indexOf(desktops.first());
+
+    if (desktop == -1) {
+        return;
+    }
+
+    m_windows[index.row()].desktop = desktop;
+
+    Q_EMIT dataChanged(index, index, {VirtualDesktops});
+}
+
+void SyntheticWindowTasksModel::requestActivities(const QModelIndex &index, const QStringList &activities)
+{
+    if (!index.isValid() || index.model() != this || index.row() >= m_windows.count() || activities.isEmpty()) {
+        return;
+    }
+
+    const int activity = m_activities.indexOf(activities.first());
+
+    if (activity == -1) {
+        return;
+    }
+
+    m_windows[index.row()].activity = activity;
+
+    Q_EMIT dataChanged(index, index, {Activities});
+}
+
+QUrl SyntheticWindowTasksModel::launcherUrl(int app)
+{
+    return QUrl(QStringLiteral("applications:app%1.desktop").arg(app));
+}
+
+void SyntheticWindowTasksModel::setVirtualDesktops(const QVariantList &desktops)
+{
+    m_desktops = desktops;
+
+    if (!m_windows.isEmpty()) {
+        Q_EMIT dataChanged(index(0, 0), index(m_windows.count() - 1, 0), {VirtualDesktops, IsOnAllVirtualDesktops});
+    }
+}
+
+QVariantList SyntheticWindowTasksModel::virtualDesktops() const
+{
+    return m_desktops;
+}
+
+void SyntheticWindowTasksModel::setActivities(const QStringList &activities)
+{
+    m_activities = activities;
+
+    if (!m_windows.isEmpty()) {
+        Q_EMIT dataChanged(index(0, 0), index(m_windows.count() - 1, 0), {Activities});
+    }
+}
+
+QStringList SyntheticWindowTasksModel::activities() const
+{
+    return m_activities;
+}
+
+void SyntheticWindowTasksModel::addWindows(int count, int apps)
+{
+    if (count <= 0 || apps <= 0) {
+        return;
+    }
+
+    const int first = m_windows.count();
+
+    beginInsertRows(QModelIndex(), first, first + count - 1);
+
+    m_windows.reserve(first + count);
+
+    for (int i = first; i < first + count; ++i) {
+        Window window;
+        window.id = m_nextId++;
+        window.app = i % apps;
+        window.title = QStringLiteral("Window %1 of app %2").arg(window.id).arg(window.app);
+        window.desktop = i;
+        window.activity = i;
+        m_windows.append(window);
+        m_stackingOrder.insert(window.id, m_stackingOrder.count());
+    }
+
+    endInsertRows();
+}
+
+void SyntheticWindowTasksModel::removeWindows(int count)
+{
+    count = qMin(count, m_windows.count());
+
+    if (count <= 0) {
+        return;
+    }
+
+    const int first = m_windows.count() - count;
+
+    beginRemoveRows(QModelIndex(), first, m_windows.count() - 1);
+
+    for (int i = first; i < m_windows.count(); ++i) {
+        m_stackingOrder.remove(m_windows.at(i).id);
+    }
+
+    // Close the gaps, as window systems do
+    QVector<quint32> order(m_stackingOrder.count() + count, 0);
+
+    for (auto it = m_stackingOrder.constBegin(); it != m_stackingOrder.constEnd(); ++it) {
+        order[it.value()] = it.key();
+    }
+
+    order.removeAll(0);
+
+    for (int i = 0; i < order.count(); ++i) {
+        m_stackingOrder.insert(order.at(i), i);
+    }
+
+    m_windows.resize(first);
+    endRemoveRows();
+}
+
+void SyntheticWindowTasksModel::clear()
+{
+    if (m_windows.isEmpty()) {
+        return;
+    }
+
+    beginResetModel();
+    m_windows.clear();
+    m_stackingOrder.clear();
+    m_activeId = 0;
+    endResetModel();
+}
+
+void SyntheticWindowTasksModel::churnTitles()
+{
+    ++m_titleGeneration;
+
+    for (int i = 0; i < m_windows.count(); ++i) {
+        Window &window = m_windows[i];
+        window.title = QStringLiteral("Window %1 of app %2 (%3)").arg(window.id).arg(window.app).arg(m_titleGeneration);
+
+        Q_EMIT dataChanged(index(i, 0), index(i, 0), {Qt::DisplayRole});
+    }
+}
+
+void SyntheticWindowTasksModel::rotateVirtualDesktops()
+{
+    if (m_desktops.isEmpty()) {
+        return;
+    }
+
+    for (int i = 0; i < m_windows.count(); ++i) {
+        ++m_windows[i].desktop;
+
+        Q_EMIT dataChanged(index(i, 0), index(i, 0), {VirtualDesktops});
+    }
+}
+
+void SyntheticWindowTasksModel::rotateActivities()
+{
+    if (m_activities.isEmpty()) {
+        return;
+    }
+
+    for (int i = 0; i < m_windows.count(); ++i) {
+        ++m_windows[i].activity;
+
+        Q_EMIT dataChanged(index(i, 0), index(i, 0), {Activities});
+    }
+}
+
+void SyntheticWindowTasksModel::raiseWindow(int row)
+{
+    if (row < 0 || row >= m_windows.count()) {
+        return;
+    }
+
+    const QHash<quint32, int> oldStackingOrder = m_stackingOrder;
+    const int position = m_stackingOrder.value(m_windows.at(row).id);
+
+    for (auto it = m_stackingOrder.begin(); it != m_stackingOrder.end(); ++it) {
+        if (it.value() > position) {
+            --it.value();
+        }
+    }
+
+    m_stackingOrder.insert(m_windows.at(row).id, m_stackingOrder.count() - 1);
+
+    stackingOrderChanged([this, &oldStackingOrder](int row) {
+        const quint32 id = m_windows.at(row).id;
+        return oldStackingOrder.value(id) != m_stackingOrder.value(id);
+    });
+}
+
+QVariantList SyntheticWindowTasksModel::windowDesktops(const Window &window) const
+{
+    if (m_desktops.isEmpty()) {
+        return QVariantList();
+    }
+
+    return QVariantList{m_desktops.at(window.desktop % m_desktops.count())};
+}
+
+QStringList SyntheticWindowTasksModel::windowActivities(const Window &window) const
+{
+    if (m_activities.isEmpty()) {
+        return QStringList();
+    }
+
+    return QStringList{m_activities.at(window.activity % m_activities.count())};
+}
@@ -0,0 +1,99 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QUrl>
+#include <QVector>
+
+#include "abstractwindowtasksmodel.h"
+
+/**
+ * A window tasks model backed by made up windows, for testing and
+ * benchmarking the model chain without an X or Wayland server.
+ *
+ * Window i belongs to app i % apps. Apps are identified as "appN" and
+ * use launcherUrl(N) as their launcher URL. Windows are spread over the
+ * configured virtual desktops and activities the same way. New windows
+ * are stacked on top of the existing ones.
+ */
+class SyntheticWindowTasksModel : public TaskManager::AbstractWindowTasksModel
+{
+    Q_OBJECT
+
+public:
+    explicit SyntheticWindowTasksModel(QObject *parent = nullptr);
+    ~SyntheticWindowTasksModel() override;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    void requestActivate(const QModelIndex &index) override;
+    void requestToggleMinimized(const QModelIndex &index) override;
+    void requestVirtualDesktops(const QModelIndex &index, const QVariantList &desktops) override;
+    void requestActivities(const QModelIndex &index, const QStringList &activities) override;
+
+    static QUrl launcherUrl(int app);
+
+    void setVirtualDesktops(const QVariantList &desktops);
+    QVariantList virtualDesktops() const;
+
+    void setActivities(const QStringList &activities);
+    QStringList activities() const;
+
+    /**
+     * Appends windows for the given number of apps in one batch.
+     */
+    void addWindows(int count, int apps);
+    /**
+     * Removes the last windows in one batch.
+     */
+    void removeWindows(int count);
+    void clear();
+
+    /**
+     * Gives every window a new title, one change signal per window, as
+     * windowing systems report them.
+     */
+    void churnTitles();
+    /**
+     * Moves all windows to the next virtual desktop, one change signal per window.
+     */
+    void rotateVirtualDesktops();
+    /**
+     * Moves all windows to the next activity, one change signal per window.
+     */
+    void rotateActivities();
+    /**
+     * Moves the window in @p row to the top of the stacking order.
+     */
+    void raiseWindow(int row);
+
+private:
+    struct Window {
+        quint32 id = 0;
+        int app = 0;
+        QString title;
+        int desktop = 0;
+        int activity = 0;
+        bool minimized = false;
+    };
+
+    QVariantList windowDesktops(const Window &window) const;
+    QStringList windowActivities(const Window &window) const;
+
+    QVector<Window> m_windows;
+    QVariantList m_desktops;
+    QStringList m_activities;
+    quint32 m_nextId = 1;
+    quint32 m_activeId = 0;
+    int m_titleGeneration = 0;
+    /**
+     * Position of each window in the stacking order, from bottom to top
+     */
+    QHash<quint32, int> m_stackingOrder;
+};
@@ -0,0 +1,258 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QObject>
+#include <QStandardItemModel>
+#include <QTest>
+
+#include "abstracttasksmodel.h"
+#include "debugstatistics_p.h"
+#include "launchertasksmodel_p.h"
+#include "taskfilterproxymodel.h"
+
+using namespace TaskManager;
+
+class TaskFilterProxyModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void shouldSkipFilterForIrrelevantRoles();
+    void shouldFilterChangedRows();
+    void shouldFilterRowsInsertedWhileHandlingChange();
+    void shouldFilterByVirtualDesktop();
+    void shouldFilterByActivity();
+    void shouldFilterByManyVirtualDesktops();
+
+private:
+    static QStandardItem *task(const QString &name, bool minimized = false);
+    static QStandardItem *task(const QString &name, const QVariantList &desktops, const QStringList &activities);
+    static QStringList names(const TaskFilterProxyModel &model);
+
+    static constexpr int s_tasks = 100;
+};
+
+QStandardItem *TaskFilterProxyModelTest::task(const QString &name, bool minimized)
+{
+    auto item = new QStandardItem(name);
+    item->setData(true, AbstractTasksModel::IsWindow);
+    item->setData(minimized, AbstractTasksModel::IsMinimized);
+    return item;
+}
+
+QStandardItem *TaskFilterProxyModelTest::task(const QString &name, const QVariantList &desktops, const QStringList &activities)
+{
+    auto item = task(name);
+    item->setData(desktops, AbstractTasksModel::VirtualDesktops);
+    item->setData(activities, AbstractTasksModel::Activities);
+    return item;
+}
+
+QStringList TaskFilterProxyModelTest::names(const TaskFilterProxyModel &model)
+{
+    QStringList names;
+
+    for (int i = 0; i < model.rowCount(); ++i) {
+        names << model.index(i, 0).data().toString();
+    }
+
+    return names;
+}
+
+void TaskFilterProxyModelTest::initTestCase()
+{
+    qApp->setProperty("org.kde.KActivities.core.disableAutostart", true);
+}
+
+void TaskFilterProxyModelTest::shouldSkipFilterForIrrelevantRoles()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_tasks; ++i) {
+        source.appendRow(task(QString::number(i), i % 2));
+    }
+
+    TaskFilterProxyModel model;
+    model.setFilterNotMinimized(true);
+    model.setSourceModel(&source);
+
+    QCOMPARE(model.rowCount(), s_tasks / 2);
+
+    const qulonglong filterRuns = DebugStatistics::of(&model).value(QStringLiteral("filterRuns")).toULongLong();
+
+    // Window titles aren't filtered by, minimized or not.
+    for (int i = 0; i < s_tasks; ++i) {
+        source.item(i)->setText(QStringLiteral("Title %1").arg(i));
+    }
+
+    const QVariantMap statistics = DebugStatistics::of(&model);
+    QCOMPARE(statistics.value(QStringLiteral("filterRuns")).toULongLong(), filterRuns);
+    QVERIFY(statistics.value(QStringLiteral("filterSkips")).toULongLong() >= qulonglong(s_tasks));
+
+    QCOMPARE(model.rowCount(), s_tasks / 2);
+
+    for (int i = 0; i < model.rowCount(); ++i) {
+        QVERIFY(!model.index(i, 0).data(AbstractTasksModel::IsMinimized).toBool());
+        QCOMPARE(model.index(i, 0).data().toString(), QStringLiteral("Title %1").arg(i * 2));
+    }
+}
+
+void TaskFilterProxyModelTest::shouldFilterChangedRows()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_tasks; ++i) {
+        source.appendRow(task(QString::number(i)));
+    }
+
+    TaskFilterProxyModel model;
+    model.setFilterNotMinimized(true);
+    model.setSourceModel(&source);
+
+    QCOMPARE(model.rowCount(), s_tasks);
+
+    source.item(0)->setData(true, AbstractTasksModel::IsMinimized);
+    QCOMPARE(model.rowCount(), s_tasks - 1);
+
+    source.item(0)->setData(false, AbstractTasksModel::IsMinimized);
+    QCOMPARE(model.rowCount(), s_tasks);
+
+    // Without roles, any of them may have changed.
+    source.item(1)->setData(true, AbstractTasksModel::IsMinimized);
+    const qulonglong filterSkips = DebugStatistics::of(&model).value(QStringLiteral("filterSkips")).toULongLong();
+    Q_EMIT source.dataChanged(source.index(0, 0), source.index(s_tasks - 1, 0));
+
+    QCOMPARE(DebugStatistics::of(&model).value(QStringLiteral("filterSkips")).toULongLong(), filterSkips);
+    QCOMPARE(model.rowCount(), s_tasks - 1);
+}
+
+void TaskFilterProxyModelTest::shouldFilterRowsInsertedWhileHandlingChange()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_tasks; ++i) {
+        source.appendRow(task(QString::number(i)));
+    }
+
+    TaskFilterProxyModel model;
+    model.setFilterNotMinimized(true);
+    model.setSourceModel(&source);
+
+    bool inserted = false;
+
+    connect(&model, &QAbstractItemModel::dataChanged, this, [&source, &inserted]() {
+        if (!inserted) {
+            inserted = true;
+            source.appendRow(task(QStringLiteral("minimized"), true /* minimized */));
+            source.appendRow(task(QStringLiteral("shown")));
+        }
+    });
+
+    source.item(0)->setText(QStringLiteral("Title"));
+
+    QVERIFY(inserted);
+    QCOMPARE(model.rowCount(), s_tasks + 1);
+    QCOMPARE(model.index(s_tasks, 0).data().toString(), QStringLiteral("shown"));
+}
+
+void TaskFilterProxyModelTest::shouldFilterByVirtualDesktop()
+{
+    QStandardItemModel source;
+    source.appendRow(task(QStringLiteral("one"), {1}, {}));
+    source.appendRow(task(QStringLiteral("two"), {2}, {}));
+    source.appendRow(task(QStringLiteral("one and two"), {1, 2}, {}));
+    source.appendRow(task(QStringLiteral("three"), {3}, {}));
+    source.appendRow(task(QStringLiteral("nowhere"), {}, {}));
+    source.appendRow(task(QStringLiteral("all"), {3}, {}));
+    source.item(5)->setData(true, AbstractTasksModel::IsOnAllVirtualDesktops);
+
+    TaskFilterProxyModel model;
+    model.setSourceModel(&source);
+    model.setFilterByVirtualDesktop(true);
+    model.setVirtualDesktop(1);
+
+    QCOMPARE(names(model), (QStringList{QStringLiteral("one"), QStringLiteral("one and two"), QStringLiteral("nowhere"), QStringLiteral("all")}));
+
+    const qulonglong partialRefilters = DebugStatistics::of(&model).value(QStringLiteral("partialRefilters")).toULongLong();
+
+    model.setVirtualDesktop(2);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("two"), QStringLiteral("one and two"), QStringLiteral("nowhere"), QStringLiteral("all")}));
+    QCOMPARE(DebugStatistics::of(&model).value(QStringLiteral("partialRefilters")).toULongLong(), partialRefilters + 1);
+
+    // Tasks moving to other desktops are filtered by where they are now.
+    source.item(3)->setData(QVariantList{2}, AbstractTasksModel::VirtualDesktops);
+    QCOMPARE(names(model),
+             (QStringList{QStringLiteral("two"), QStringLiteral("one and two"), QStringLiteral("three"), QStringLiteral("nowhere"), QStringLiteral("all")}));
+
+    source.item(0)->setData(true, AbstractTasksModel::IsDemandingAttention);
+    model.setVirtualDesktop(3);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("one"), QStringLiteral("nowhere"), QStringLiteral("all")}));
+
+    model.setDemandingAttentionSkipsFilters(false);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("nowhere"), QStringLiteral("all")}));
+
+    source.insertRow(0, task(QStringLiteral("new"), {3}, {}));
+    QCOMPARE(names(model), (QStringList{QStringLiteral("new"), QStringLiteral("nowhere"), QStringLiteral("all")}));
+
+    model.setVirtualDesktop(QVariant());
+    QCOMPARE(model.rowCount(), source.rowCount());
+}
+
+void TaskFilterProxyModelTest::shouldFilterByActivity()
+{
+    const QString a = QStringLiteral("activity-a");
+    const QString b = QStringLiteral("activity-b");
+
+    QStandardItemModel source;
+    source.appendRow(task(QStringLiteral("a"), {}, {a}));
+    source.appendRow(task(QStringLiteral("b"), {}, {b}));
+    source.appendRow(task(QStringLiteral("everywhere"), {}, {QStringLiteral(NULL_UUID)}));
+    source.appendRow(task(QStringLiteral("none"), {}, {}));
+
+    TaskFilterProxyModel model;
+    model.setSourceModel(&source);
+    model.setFilterByActivity(true);
+    model.setActivity(a);
+
+    QCOMPARE(names(model), (QStringList{QStringLiteral("a"), QStringLiteral("everywhere"), QStringLiteral("none")}));
+
+    model.setActivity(b);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("b"), QStringLiteral("everywhere"), QStringLiteral("none")}));
+
+    source.item(0)->setData(QStringList{a, b}, AbstractTasksModel::Activities);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("everywhere"), QStringLiteral("none")}));
+
+    source.removeRow(1);
+    model.setActivity(a);
+    QCOMPARE(names(model), (QStringList{QStringLiteral("a"), QStringLiteral("everywhere"), QStringLiteral("none")}));
+}
+
+void TaskFilterProxyModelTest::shouldFilterByManyVirtualDesktops()
+{
+    // More desktops than there are bits for.
+    static constexpr int desktops = 100;
+
+    QStandardItemModel source;
+
+    for (int i = 0; i < desktops; ++i) {
+        source.appendRow(task(QString::number(i), {QStringLiteral("desktop-%1").arg(i)}, {}));
+    }
+
+    TaskFilterProxyModel model;
+    model.setSourceModel(&source);
+    model.setFilterByVirtualDesktop(true);
+
+    for (int i = desktops - 1; i >= 0; --i) {
+        model.setVirtualDesktop(QStringLiteral("desktop-%1").arg(i));
+        QCOMPARE(names(model), QStringList{QString::number(i)});
+    }
+}
+
+QTEST_MAIN(TaskFilterProxyModelTest)
+
+#include "taskfilterproxymodeltest.moc"
@@ -0,0 +1,189 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QObject>
+#include <QStandardItemModel>
+#include <QTest>
+#include <QUrl>
+
+#include "abstracttasksmodel.h"
+#include "taskgroupingproxymodel.h"
+
+using namespace TaskManager;
+
+class TaskGroupingProxyModelTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void shouldGroupManyWindows();
+    void shouldGroupInsertedWindows();
+    void shouldNotGroupWithLaunchers();
+    void shouldRegroupAfterRemovals();
+
+private:
+    static QStandardItem *task(int app, bool isWindow = true);
+    static void verifyGrouping(const TaskGroupingProxyModel &model, const QStandardItemModel &source, int groups);
+
+    static constexpr int s_windows = 1000;
+    static constexpr int s_apps = 20;
+};
+
+QStandardItem *TaskGroupingProxyModelTest::task(int app, bool isWindow)
+{
+    auto item = new QStandardItem;
+    item->setData(QStringLiteral("org.kde.app%1").arg(app), AbstractTasksModel::AppId);
+    item->setData(QUrl(QStringLiteral("applications:org.kde.app%1.desktop").arg(app)), AbstractTasksModel::LauncherUrlWithoutIcon);
+    item->setData(isWindow, AbstractTasksModel::IsWindow);
+    return item;
+}
+
+void TaskGroupingProxyModelTest::verifyGrouping(const TaskGroupingProxyModel &model, const QStandardItemModel &source, int groups)
+{
+    QCOMPARE(model.rowCount(), groups);
+
+    int mapped = 0;
+
+    for (int i = 0; i < model.rowCount(); ++i) {
+        const QModelIndex parent = model.index(i, 0);
+        const QString appId = model.mapToSource(parent).data(AbstractTasksModel::AppId).toString();
+
+        for (int j = 0; j < model.rowCount(parent); ++j) {
+            const QModelIndex child = model.index(j, 0, parent);
+            QCOMPARE(child.parent(), parent);
+            QCOMPARE(model.mapToSource(child).data(AbstractTasksModel::AppId).toString(), appId);
+        }
+
+        mapped += qMax(1, model.rowCount(parent));
+    }
+
+    QCOMPARE(mapped, source.rowCount());
+
+    for (int i = 0; i < source.rowCount(); ++i) {
+        const QModelIndex proxyIndex = model.mapFromSource(source.index(i, 0));
+        QVERIFY(proxyIndex.isValid());
+        QCOMPARE(model.mapToSource(proxyIndex).row(), i);
+    }
+}
+
+void TaskGroupingProxyModelTest::initTestCase()
+{
+    qApp->setProperty("org.kde.KActivities.core.disableAutostart", true);
+}
+
+void TaskGroupingProxyModelTest::shouldGroupManyWindows()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_windows; ++i) {
+        source.appendRow(task(i % s_apps));
+    }
+
+    TaskGroupingProxyModel model;
+    model.setSourceModel(&source);
+
+    verifyGrouping(model, source, s_apps);
+
+    for (int i = 0; i < s_apps; ++i) {
+        QCOMPARE(model.rowCount(model.index(i, 0)), s_windows / s_apps);
+    }
+}
+
+void TaskGroupingProxyModelTest::shouldGroupInsertedWindows()
+{
+    QStandardItemModel source;
+    TaskGroupingProxyModel model;
+    model.setSourceModel(&source);
+
+    for (int i = 0; i < s_windows; ++i) {
+        source.appendRow(task(i % s_apps));
+    }
+
+    verifyGrouping(model, source, s_apps);
+
+    // Rows inserted in front shift everything that was mapped so far.
+    source.insertRow(0, task(5));
+    source.insertRow(0, task(s_apps));
+
+    verifyGrouping(model, source, s_apps + 1);
+    QCOMPARE(model.rowCount(model.mapFromSource(source.index(1, 0)).parent()), s_windows / s_apps + 1);
+}
+
+void TaskGroupingProxyModelTest::shouldNotGroupWithLaunchers()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_apps; ++i) {
+        source.appendRow(task(i, false /* isWindow */));
+    }
+
+    TaskGroupingProxyModel model;
+    model.setSourceModel(&source);
+
+    for (int i = 0; i < s_windows; ++i) {
+        source.appendRow(task(i % s_apps));
+    }
+
+    // A group for the windows of each app, next to its launcher.
+    verifyGrouping(model, source, s_apps * 2);
+
+    for (int i = 0; i < s_apps; ++i) {
+        QCOMPARE(model.rowCount(model.index(i, 0)), 0);
+        QCOMPARE(model.rowCount(model.index(s_apps + i, 0)), s_windows / s_apps);
+    }
+}
+
+void TaskGroupingProxyModelTest::shouldRegroupAfterRemovals()
+{
+    QStandardItemModel source;
+
+    for (int i = 0; i < s_windows; ++i) {
+        source.appendRow(task(i % s_apps));
+    }
+
+    TaskGroupingProxyModel model;
+    model.setSourceModel(&source);
+
+    // Removing the first window of every app leaves the groups in place.
+    source.removeRows(0, s_apps);
+    verifyGrouping(model, source, s_apps);
+
+    for (int i = 0; i < s_apps; ++i) {
+        QCOMPARE(model.rowCount(model.index(i, 0)), s_windows / s_apps - 1);
+    }
+
+    // New windows still find the group of their app.
+    source.appendRow(task(0));
+    QCOMPARE(model.rowCount(model.index(0, 0)), s_windows / s_apps);
+
+    // Closing all windows of an app removes its group.
+    const QString appId = source.index(0, 0).data(AbstractTasksModel::AppId).toString();
+
+    for (int i = source.rowCount() - 1; i >= 0; --i) {
+        if (source.index(i, 0).data(AbstractTasksModel::AppId).toString() == appId) {
+            source.removeRow(i);
+        }
+    }
+
+    verifyGrouping(model, source, s_apps - 1);
+
+    // Down to a single window per app, there are no groups left.
+    while (source.rowCount() > s_apps - 1) {
+        source.removeRow(0);
+    }
+
+    verifyGrouping(model, source, s_apps - 1);
+
+    for (int i = 0; i < model.rowCount(); ++i) {
+        QCOMPARE(model.rowCount(model.index(i, 0)), 0);
+    }
+}
+
+QTEST_MAIN(TaskGroupingProxyModelTest)
+
+#include "taskgroupingproxymodeltest.moc"
@@ -0,0 +1,340 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QObject>
+#include <QStandardPaths>
+#include <QTest>
+
+#include "syntheticwindowtasksmodel.h"
+#include "tasksmodel.h"
+#include "windowtasksmodel.h"
+#include "windowtasksmodel_p.h"
+
+using namespace TaskManager;
+
+class TasksModelBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void benchmarkPopulate_data();
+    void benchmarkPopulate();
+    void benchmarkVirtualDesktopSwitch_data();
+    void benchmarkVirtualDesktopSwitch();
+    void benchmarkActivitySwitch_data();
+    void benchmarkActivitySwitch();
+    void benchmarkMoveWindowsToDesktop_data();
+    void benchmarkMoveWindowsToDesktop();
+    void benchmarkToggleGrouping_data();
+    void benchmarkToggleGrouping();
+    void benchmarkTitleChurn_data();
+    void benchmarkTitleChurn();
+    void benchmarkSort_data();
+    void benchmarkSort();
+    void benchmarkInsertSorted_data();
+    void benchmarkInsertSorted();
+    void benchmarkManualMove_data();
+    void benchmarkManualMove();
+    void benchmarkPinLaunchers_data();
+    void benchmarkPinLaunchers();
+
+private:
+    static void addSizes();
+    static void addSortModes();
+    static QStringList launcherList();
+    /**
+     * Sets up a model the way a grouping task manager has it.
+     */
+    static void setupModel(TasksModel &model);
+
+    static constexpr int s_apps = 20;
+
+    SyntheticWindowTasksModel *m_windows = nullptr;
+};
+
+void TasksModelBenchmark::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    qApp->setProperty("org.kde.KActivities.core.disableAutostart", true);
+
+    m_windows = new SyntheticWindowTasksModel(this);
+    setWindowTasksModelSourceOverride(m_windows);
+}
+
+void TasksModelBenchmark::cleanupTestCase()
+{
+    setWindowTasksModelSourceOverride(nullptr);
+}
+
+void TasksModelBenchmark::init()
+{
+    m_windows->clear();
+    m_windows->setVirtualDesktops({QStringLiteral("desktop-1"), QStringLiteral("desktop-2"), QStringLiteral("desktop-3"), QStringLiteral("desktop-4")});
+    m_windows->setActivities({QStringLiteral("activity-1"), QStringLiteral("activity-2"), QStringLiteral("activity-3")});
+}
+
+void TasksModelBenchmark::addSizes()
+{
+    QTest::addColumn<int>("size");
+    QTest::newRow("10") << 10;
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+}
+
+void TasksModelBenchmark::addSortModes()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<TasksModel::SortMode>("sortMode");
+
+    const QVector<std::pair<const char *, TasksModel::SortMode>> sortModes{{"alpha", TasksModel::SortAlpha},
+                                                                           {"desktop", TasksModel::SortVirtualDesktop},
+                                                                           {"activity", TasksModel::SortActivity},
+                                                                           {"manual", TasksModel::SortManual}};
+
+    for (const auto &sortMode : sortModes) {
+        for (const int size : {10, 100, 1000}) {
+            QTest::addRow("%s-%d", sortMode.first, size) << size << sortMode.second;
+        }
+    }
+}
+
+QStringList TasksModelBenchmark::launcherList()
+{
+    QStringList launchers;
+
+    for (int i = 0; i < s_apps; ++i) {
+        launchers << SyntheticWindowTasksModel::launcherUrl(i).toString();
+    }
+
+    return launchers;
+}
+
+void TasksModelBenchmark::setupModel(TasksModel &model)
+{
+    model.setGroupMode(TasksModel::GroupApplications);
+    model.setSortMode(TasksModel::SortAlpha);
+
+    // TasksModel assembles its model chain from the event loop.
+    QTRY_VERIFY(model.sourceModel());
+}
+
+void TasksModelBenchmark::benchmarkPopulate_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkPopulate()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+
+    QBENCHMARK {
+        m_windows->addWindows(size, s_apps);
+        m_windows->clear();
+    }
+}
+
+void TasksModelBenchmark::benchmarkVirtualDesktopSwitch_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkVirtualDesktopSwitch()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    model.setFilterByVirtualDesktop(true);
+    m_windows->addWindows(size, s_apps);
+
+    const QVariantList desktops = m_windows->virtualDesktops();
+    int desktop = 0;
+
+    QBENCHMARK {
+        model.setVirtualDesktop(desktops.at(desktop++ % desktops.count()));
+    }
+}
+
+void TasksModelBenchmark::benchmarkActivitySwitch_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkActivitySwitch()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    model.setFilterByActivity(true);
+    m_windows->addWindows(size, s_apps);
+
+    const QStringList activities = m_windows->activities();
+    int activity = 0;
+
+    QBENCHMARK {
+        model.setActivity(activities.at(activity++ % activities.count()));
+    }
+}
+
+void TasksModelBenchmark::benchmarkMoveWindowsToDesktop_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkMoveWindowsToDesktop()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    model.setFilterByVirtualDesktop(true);
+    model.setVirtualDesktop(m_windows->virtualDesktops().constFirst());
+    m_windows->addWindows(size, s_apps);
+
+    QBENCHMARK {
+        m_windows->rotateVirtualDesktops();
+    }
+}
+
+void TasksModelBenchmark::benchmarkToggleGrouping_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkToggleGrouping()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    m_windows->addWindows(size, s_apps);
+
+    QCOMPARE(model.rowCount(), qMin(size, int(s_apps)));
+
+    QBENCHMARK {
+        model.setGroupMode(TasksModel::GroupDisabled);
+        model.setGroupMode(TasksModel::GroupApplications);
+    }
+}
+
+void TasksModelBenchmark::benchmarkTitleChurn_data()
+{
+    addSortModes();
+}
+
+void TasksModelBenchmark::benchmarkTitleChurn()
+{
+    QFETCH(int, size);
+    QFETCH(TasksModel::SortMode, sortMode);
+
+    TasksModel model;
+    setupModel(model);
+    model.setSortMode(sortMode);
+    m_windows->addWindows(size, s_apps);
+
+    QBENCHMARK {
+        m_windows->churnTitles();
+    }
+}
+
+void TasksModelBenchmark::benchmarkSort_data()
+{
+    addSortModes();
+}
+
+void TasksModelBenchmark::benchmarkSort()
+{
+    QFETCH(int, size);
+    QFETCH(TasksModel::SortMode, sortMode);
+
+    TasksModel model;
+    setupModel(model);
+    model.setGroupMode(TasksModel::GroupDisabled);
+    m_windows->addWindows(size, s_apps);
+
+    QBENCHMARK {
+        model.setSortMode(TasksModel::SortDisabled);
+        model.setSortMode(sortMode);
+    }
+}
+
+void TasksModelBenchmark::benchmarkInsertSorted_data()
+{
+    addSortModes();
+}
+
+void TasksModelBenchmark::benchmarkInsertSorted()
+{
+    QFETCH(int, size);
+    QFETCH(TasksModel::SortMode, sortMode);
+
+    TasksModel model;
+    setupModel(model);
+    model.setSortMode(sortMode);
+    model.setLauncherList(launcherList());
+    m_windows->addWindows(size, s_apps);
+
+    QBENCHMARK {
+        m_windows->addWindows(1, s_apps);
+        m_windows->removeWindows(1);
+    }
+}
+
+void TasksModelBenchmark::benchmarkManualMove_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkManualMove()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    model.setGroupMode(TasksModel::GroupDisabled);
+    model.setSortMode(TasksModel::SortManual);
+    model.setSeparateLaunchers(false);
+    model.setLauncherList(launcherList());
+    m_windows->addWindows(size, s_apps);
+
+    QBENCHMARK {
+        QVERIFY(model.move(0, model.rowCount() - 1));
+    }
+}
+
+void TasksModelBenchmark::benchmarkPinLaunchers_data()
+{
+    addSizes();
+}
+
+void TasksModelBenchmark::benchmarkPinLaunchers()
+{
+    QFETCH(int, size);
+
+    TasksModel model;
+    setupModel(model);
+    model.setLaunchInPlace(true);
+    m_windows->addWindows(size, s_apps);
+
+    const QStringList launchers = launcherList();
+
+    QBENCHMARK {
+        model.setLauncherList(launchers);
+        model.setLauncherList(QStringList());
+    }
+}
+
+QTEST_MAIN(TasksModelBenchmark)
+
+#include "tasksmodelbenchmark.moc"
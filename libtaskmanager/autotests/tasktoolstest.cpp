@@ -38,11 +38,17 @@ private Q_SLOTS:
     void shouldFindApp();
     void shouldFindDefaultApp();
     void shouldCompareLauncherUrls();
+    void shouldCacheWindowUrls();
+    void shouldMatchWindowMetadata_data();
+    void shouldMatchWindowMetadata();
+    void shouldMatchCommandLines_data();
+    void shouldMatchCommandLines();
 
 private:
     QString appLinkPath();
     void fillReferenceAppData();
     void createAppLink();
+    void createMatchingApps();
     void createIcon();
 
     AppData m_referenceAppData;
@@ -69,6 +75,7 @@ void TaskToolsTest::initTestCase()
     createIcon();
     fillReferenceAppData();
     createAppLink();
+    createMatchingApps();
 
     QFile::remove(KSycoca::absoluteFilePath());
     KSycoca::self()->ensureCacheValid();
@@ -125,6 +132,96 @@ void TaskToolsTest::shouldCompareLauncherUrls()
     QVERIFY(!launcherUrlsMatch(QUrl(c), QUrl(d), IgnoreQueryItems));
 }
 
+void TaskToolsTest::shouldCacheWindowUrls()
+{
+    KSharedConfig::Ptr rulesConfig = KSharedConfig::openConfig(QStringLiteral("taskmanagerrulesrc"));
+    const QString cachePath = m_tempDir.path() + QLatin1String("/cache/libtaskmanager/windowurls");
+
+    QCOMPARE(windowUrlFromMetadata(QStringLiteral("org.kde.konversation"), 0, rulesConfig), m_referenceAppData.url);
+    QCOMPARE(windowUrlFromMetadata(QStringLiteral("org.kde.konversation"), 0, rulesConfig), m_referenceAppData.url);
+    QTRY_VERIFY(QFile::exists(cachePath));
+
+    // Not knowing what a window belongs to is cached as well ...
+    QVERIFY(windowUrlFromMetadata(QStringLiteral("quassel"), 0, rulesConfig).isEmpty());
+
+    const QString quasselPath = m_tempDir.path() + QLatin1String("/data/applications/quasselclient.desktop");
+    KDesktopFile file(quasselPath);
+    KConfigGroup group = file.desktopGroup();
+    group.writeEntry(QLatin1String("Type"), QStringLiteral("Application"));
+    group.writeEntry(QLatin1String("Name"), QStringLiteral("Quassel IRC"));
+    group.writeEntry(QLatin1String("Exec"), QStringLiteral("quasselclient"));
+    group.writeEntry(QLatin1String("StartupWMClass"), QStringLiteral("quassel"));
+    file.sync();
+
+    QFile::remove(KSycoca::absoluteFilePath());
+    KSycoca::self()->ensureCacheValid();
+
+    // ... until the sycoca database changes.
+    QCOMPARE(windowUrlFromMetadata(QStringLiteral("quassel"), 0, rulesConfig), QUrl(QStringLiteral("applications:quasselclient.desktop")));
+
+    QVERIFY(QFile::remove(quasselPath));
+    QFile::remove(KSycoca::absoluteFilePath());
+    KSycoca::self()->ensureCacheValid();
+}
+
+void TaskToolsTest::shouldMatchWindowMetadata_data()
+{
+    QTest::addColumn<QString>("appId");
+    QTest::addColumn<QString>("wmClass");
+    QTest::addColumn<QUrl>("url");
+
+    QTest::newRow("StartupWMClass before DesktopEntryName") << QStringLiteral("fooapp") << QString() << QUrl(QStringLiteral("applications:startupwmclass.desktop"));
+    QTest::newRow("StartupWMClass ignoring case") << QStringLiteral("FOOAPP") << QString() << QUrl(QStringLiteral("applications:startupwmclass.desktop"));
+    QTest::newRow("StartupWMClass of WM_CLASS name") << QStringLiteral("unknown") << QStringLiteral("QuxWindow") << QUrl(QStringLiteral("applications:qux.desktop"));
+    QTest::newRow("DesktopEntryName before Name") << QStringLiteral("barapp") << QString() << QUrl(QStringLiteral("applications:barapp.desktop"));
+    QTest::newRow("DesktopEntryName ignoring case") << QStringLiteral("BarApp") << QString() << QUrl(QStringLiteral("applications:barapp.desktop"));
+    QTest::newRow("Name") << QStringLiteral("Bar") << QString() << QUrl(QStringLiteral("applications:barapp.desktop"));
+    QTest::newRow("NoDisplay skipped") << QStringLiteral("hiddenapp") << QString() << QUrl(QStringLiteral("applications:shownhidden.desktop"));
+    QTest::newRow("Exec required") << QStringLiteral("noexecclass") << QString() << QUrl();
+    QTest::newRow("reverse domain name") << QStringLiteral("dragonplayer") << QString() << QUrl(QStringLiteral("applications:org.kde.dragonplayer.desktop"));
+    QTest::newRow("no match") << QStringLiteral("nosuchapp") << QString() << QUrl();
+}
+
+void TaskToolsTest::shouldMatchWindowMetadata()
+{
+    QFETCH(QString, appId);
+    QFETCH(QString, wmClass);
+    QFETCH(QUrl, url);
+
+    KSharedConfig::Ptr rulesConfig = KSharedConfig::openConfig(QStringLiteral("taskmanagerrulesrc"));
+
+    QCOMPARE(windowUrlFromMetadata(appId, 0, rulesConfig, wmClass), url);
+}
+
+void TaskToolsTest::shouldMatchCommandLines_data()
+{
+    QTest::addColumn<QString>("cmdLine");
+    QTest::addColumn<QString>("menuId");
+
+    QTest::newRow("Exec") << QStringLiteral("fooapp") << QStringLiteral("fooapp.desktop");
+    QTest::newRow("Exec ignoring case") << QStringLiteral("FOOAPP") << QStringLiteral("fooapp.desktop");
+    QTest::newRow("Exec with arguments") << QStringLiteral("barapp --new-window") << QStringLiteral("barapp.desktop");
+    QTest::newRow("path") << QStringLiteral("/usr/bin/fooapp") << QStringLiteral("fooapp.desktop");
+    QTest::newRow("path with arguments") << QStringLiteral("/usr/bin/fooapp --new-window") << QStringLiteral("fooapp.desktop");
+    QTest::newRow("no match") << QStringLiteral("/nonexistent/nosuchapp --foo") << QString();
+}
+
+void TaskToolsTest::shouldMatchCommandLines()
+{
+    QFETCH(QString, cmdLine);
+    QFETCH(QString, menuId);
+
+    KSharedConfig::Ptr rulesConfig = KSharedConfig::openConfig(QStringLiteral("taskmanagerrulesrc"));
+    const KService::List services = servicesFromCmdLine(cmdLine, QString(), rulesConfig);
+
+    if (menuId.isEmpty()) {
+        QVERIFY(services.isEmpty());
+    } else {
+        QVERIFY(!services.isEmpty());
+        QCOMPARE(services.first()->menuId(), menuId);
+    }
+}
+
 QString TaskToolsTest::appLinkPath()
 {
     return QString(m_tempDir.path() + QLatin1String("/data/applications/org.kde.konversation.desktop"));
@@ -157,6 +254,43 @@ void TaskToolsTest::createAppLink()
     QVERIFY(KDesktopFile::isDesktopFile(appLinkPath()));
 }
 
+void TaskToolsTest::createMatchingApps()
+{
+    // Services set up so that each one is only found by one of the steps of
+    // windowUrlFromMetadata(), and only if the steps come in the right order.
+    const QVector<QPair<QString, QMap<QString, QString>>> apps{
+        {QStringLiteral("startupwmclass"), {{QStringLiteral("Name"), QStringLiteral("Startup WM Class")}, {QStringLiteral("StartupWMClass"), QStringLiteral("FooApp")}}},
+        {QStringLiteral("fooapp"), {{QStringLiteral("Name"), QStringLiteral("Foo")}}},
+        {QStringLiteral("qux"), {{QStringLiteral("Name"), QStringLiteral("Qux")}, {QStringLiteral("StartupWMClass"), QStringLiteral("quxwindow")}}},
+        {QStringLiteral("barapp"), {{QStringLiteral("Name"), QStringLiteral("Bar")}}},
+        {QStringLiteral("named"), {{QStringLiteral("Name"), QStringLiteral("barapp")}}},
+        {QStringLiteral("hiddenapp"), {{QStringLiteral("Name"), QStringLiteral("Hidden")}, {QStringLiteral("NoDisplay"), QStringLiteral("true")}}},
+        {QStringLiteral("shownhidden"), {{QStringLiteral("Name"), QStringLiteral("hiddenapp")}}},
+        {QStringLiteral("noexec"), {{QStringLiteral("Name"), QStringLiteral("No Exec")}, {QStringLiteral("StartupWMClass"), QStringLiteral("noexecclass")}}},
+        {QStringLiteral("org.kde.dragonplayer"), {{QStringLiteral("Name"), QStringLiteral("Dragon Player")}}},
+    };
+
+    for (const auto &app : apps) {
+        const QString path = m_tempDir.path() + QLatin1String("/data/applications/") + app.first + QLatin1String(".desktop");
+
+        KDesktopFile file(path);
+        KConfigGroup group = file.desktopGroup();
+        group.writeEntry(QLatin1String("Type"), QStringLiteral("Application"));
+
+        if (app.first != QLatin1String("noexec")) {
+            group.writeEntry(QLatin1String("Exec"), app.first);
+        }
+
+        for (auto it = app.second.constBegin(); it != app.second.constEnd(); ++it) {
+            group.writeEntry(it.key(), it.value());
+        }
+
+        file.sync();
+
+        QVERIFY(QFile::exists(path));
+    }
+}
+
 void TaskToolsTest::createIcon()
 {
     // FIXME KIconLoaderPrivate::initIconThemes: Error: standard icon theme "oxygen" not found!
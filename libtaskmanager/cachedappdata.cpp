@@ -0,0 +1,105 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "cachedappdata.h"
+
+#include <KSycoca>
+
+#include <QHash>
+
+#include <utility>
+
+namespace TaskManager
+{
+class AppDataCache : public QObject
+{
+public:
+    AppDataCache()
+    {
+        void (KSycoca::*myDatabaseChangeSignal)(const QStringList &) = &KSycoca::databaseChanged;
+        connect(KSycoca::self(), myDatabaseChangeSignal, this, [this](const QStringList &changedResources) {
+            if (changedResources.contains(QLatin1String("services")) || changedResources.contains(QLatin1String("apps"))
+                || changedResources.contains(QLatin1String("xdgdata-apps"))) {
+                for (auto &entry : entries) {
+                    entry.stale = true;
+                }
+            }
+        });
+    }
+
+    struct Entry {
+        AppData data;
+        int references = 0;
+        bool stale = false;
+    };
+
+    QHash<QUrl, Entry> entries;
+};
+
+Q_GLOBAL_STATIC(AppDataCache, s_appDataCache)
+
+CachedAppData::CachedAppData(const QUrl &url)
+    : m_url(url)
+{
+    // Nothing to share past the end of the process.
+    if (s_appDataCache.isDestroyed()) {
+        m_data = appDataFromUrl(url);
+        return;
+    }
+
+    AppDataCache::Entry &entry = s_appDataCache->entries[url];
+
+    if (!entry.references || entry.stale) {
+        entry.data = appDataFromUrl(url);
+        entry.stale = false;
+    }
+
+    ++entry.references;
+    m_referenced = true;
+    m_data = entry.data;
+}
+
+CachedAppData::CachedAppData(const CachedAppData &other)
+    : m_referenced(other.m_referenced)
+    , m_url(other.m_url)
+    , m_data(other.m_data)
+{
+    if (m_referenced && !s_appDataCache.isDestroyed()) {
+        ++s_appDataCache->entries[m_url].references;
+    }
+}
+
+CachedAppData::~CachedAppData()
+{
+    if (!m_referenced || s_appDataCache.isDestroyed()) {
+        return;
+    }
+
+    auto it = s_appDataCache->entries.find(m_url);
+
+    if (it != s_appDataCache->entries.end() && !--it->references) {
+        s_appDataCache->entries.erase(it);
+    }
+}
+
+CachedAppData &CachedAppData::operator=(const CachedAppData &other)
+{
+    if (this != &other) {
+        CachedAppData copy(other);
+        std::swap(m_referenced, copy.m_referenced);
+        std::swap(m_url, copy.m_url);
+        std::swap(m_data, copy.m_data);
+    }
+
+    return *this;
+}
+
+int CachedAppData::cacheSize()
+{
+    return s_appDataCache.isDestroyed() ? 0 : s_appDataCache->entries.count();
+}
+
+}
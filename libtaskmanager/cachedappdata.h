@@ -0,0 +1,54 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include "tasktools.h"
+
+namespace TaskManager
+{
+/*
+ * A reference to the app data for a launcher URL in a cache shared by all
+ * task models in the process.
+ *
+ * The first reference to a URL resolves it with appDataFromUrl(), decoding
+ * icons just once; the entry is dropped along with the last reference to it.
+ * Entries are resolved anew when referenced after the sycoca database changed.
+ *
+ * Holders may adjust their copy of the data, e.g. to fill in a fallback icon,
+ * without affecting the cached entry.
+ */
+class CachedAppData
+{
+public:
+    explicit CachedAppData(const QUrl &url = QUrl());
+    CachedAppData(const CachedAppData &other);
+    ~CachedAppData();
+
+    CachedAppData &operator=(const CachedAppData &other);
+
+    const AppData &data() const
+    {
+        return m_data;
+    }
+
+    AppData &data()
+    {
+        return m_data;
+    }
+
+    /**
+     * Number of URLs in the shared cache.
+     */
+    static int cacheSize();
+
+private:
+    bool m_referenced = false;
+    QUrl m_url;
+    AppData m_data;
+};
+
+}
@@ -0,0 +1,111 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "changedrolesgate.h"
+
+#include <QAbstractItemModel>
+
+namespace TaskManager
+{
+ChangedRolesGate::ChangedRolesGate(const QVector<int> &filterRoles)
+    : m_filterRoles(filterRoles.cbegin(), filterRoles.cend())
+{
+}
+
+ChangedRolesGate::~ChangedRolesGate()
+{
+    for (const auto &connection : qAsConst(m_connections)) {
+        QObject::disconnect(connection);
+    }
+
+    QObject::disconnect(m_closeConnection);
+}
+
+void ChangedRolesGate::setModel(QAbstractItemModel *model, QObject *context)
+{
+    for (const auto &connection : qAsConst(m_connections)) {
+        QObject::disconnect(connection);
+    }
+
+    m_connections.clear();
+    QObject::disconnect(m_closeConnection);
+    m_open = false;
+
+    m_model = model;
+    m_context = context;
+
+    if (!m_model) {
+        return;
+    }
+
+    m_connections << QObject::connect(m_model,
+                                      &QAbstractItemModel::dataChanged,
+                                      m_context,
+                                      [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+                                          m_topLeft = topLeft;
+                                          m_bottomRight = bottomRight;
+
+                                          // No roles means any of them may have changed.
+                                          m_open = !roles.isEmpty();
+
+                                          for (int role : roles) {
+                                              if (m_filterRoles.contains(role)) {
+                                                  m_open = false;
+                                                  break;
+                                              }
+                                          }
+                                      });
+
+    // Rows which appear while the change is being handled, e.g. because a
+    // handler further down the chain reacts to it, need to be filtered.
+    const auto close = [this]() {
+        m_open = false;
+    };
+
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsAboutToBeInserted, m_context, close);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsAboutToBeRemoved, m_context, close);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsAboutToBeMoved, m_context, close);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::layoutAboutToBeChanged, m_context, close);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::modelAboutToBeReset, m_context, close);
+
+    connectClose();
+}
+
+void ChangedRolesGate::connectClose()
+{
+    QObject::disconnect(m_closeConnection);
+
+    if (!m_model) {
+        return;
+    }
+
+    m_closeConnection = QObject::connect(m_model, &QAbstractItemModel::dataChanged, m_context, [this]() {
+        m_open = false;
+    });
+}
+
+bool ChangedRolesGate::skipFilter(const QModelIndex &sourceIndex)
+{
+    // Proxies further down the chain can only be told about the change as a
+    // whole, as their rows don't line up with those of the watched model.
+    const bool inRange = sourceIndex.model() != m_model
+        || (sourceIndex.parent() == m_topLeft.parent() && sourceIndex.row() >= m_topLeft.row() && sourceIndex.row() <= m_bottomRight.row());
+
+    if (m_open && inRange) {
+        ++m_filterSkips;
+        return true;
+    }
+
+    ++m_filterRuns;
+    return false;
+}
+
+QVariantMap ChangedRolesGate::statistics() const
+{
+    return QVariantMap{{QStringLiteral("filterRuns"), m_filterRuns}, {QStringLiteral("filterSkips"), m_filterSkips}};
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QMetaObject>
+#include <QModelIndex>
+#include <QSet>
+#include <QVariantMap>
+#include <QVector>
+
+class QAbstractItemModel;
+
+namespace TaskManager
+{
+/*
+ * Tells a filtering proxy whether the dataChanged() signal it is handling only
+ * concerns roles its filterAcceptsRow() doesn't look at, so it can keep rows
+ * where they are instead of running them through the filter again.
+ *
+ * The gate opens on dataChanged() of the watched model before the proxy gets
+ * to handle the signal and closes once it is done, or as soon as the watched
+ * model starts changing rows or layout in between.
+ */
+class ChangedRolesGate
+{
+public:
+    explicit ChangedRolesGate(const QVector<int> &filterRoles);
+    ~ChangedRolesGate();
+
+    /**
+     * Starts watching @p model. Needs to be called before the proxy connects to
+     * the signals of @p model, i.e. before QSortFilterProxyModel::setSourceModel().
+     *
+     * @param context the proxy, scoping the connections
+     */
+    void setModel(QAbstractItemModel *model, QObject *context);
+
+    /**
+     * (Re)connects closing the gate after the proxy handled a dataChanged() signal.
+     * Needs to be called whenever the proxy connected to the watched model anew.
+     */
+    void connectClose();
+
+    /**
+     * Whether the change being handled can't affect filtering @p sourceIndex.
+     * Counts the filter run or skip.
+     */
+    bool skipFilter(const QModelIndex &sourceIndex);
+
+    QVariantMap statistics() const;
+
+private:
+    QSet<int> m_filterRoles;
+    QAbstractItemModel *m_model = nullptr;
+    QObject *m_context = nullptr;
+    QVector<QMetaObject::Connection> m_connections;
+    QMetaObject::Connection m_closeConnection;
+    bool m_open = false;
+    QModelIndex m_topLeft;
+    QModelIndex m_bottomRight;
+
+    quint64 m_filterRuns = 0;
+    quint64 m_filterSkips = 0;
+};
+
+}
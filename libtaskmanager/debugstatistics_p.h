@@ -0,0 +1,55 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QVariantMap>
+
+#include "taskmanager_export.h"
+
+namespace TaskManager
+{
+class TaskFilterProxyModel;
+class TaskGroupingProxyModel;
+class TasksModel;
+class XWindowTasksModel;
+
+/**
+ * Counters of the work the models did so far, for autotests and benchmarks
+ * to measure. The keys may change at any time.
+ */
+class TASKMANAGER_EXPORT DebugStatistics
+{
+public:
+    /**
+     * How much filtering, grouping and sorting work the model and the
+     * proxies it is built from did, keyed by layer ("filter", "grouping",
+     * "tasks").
+     */
+    static QVariantMap of(const TasksModel *model);
+
+    /**
+     * Counts of the rows run through the filter, of those kept where they
+     * were because only roles the filter doesn't use changed, of the
+     * resorts done and of the desktop or activity switches which only
+     * refiltered the rows they affect.
+     */
+    static QVariantMap of(const TaskFilterProxyModel *model);
+
+    /**
+     * Counts of full regroupings, of tasks checked for a group to join and
+     * of app id or launcher URL changes the grouping had to follow.
+     */
+    static QVariantMap of(const TaskGroupingProxyModel *model);
+
+    /**
+     * How many window system events came in and how many of them were
+     * passed on to the model after batching.
+     */
+    static QVariantMap of(const XWindowTasksModel *model);
+};
+
+}
@@ -5,6 +5,7 @@
 */
 
 #include "launchertasksmodel.h"
+#include "cachedappdata.h"
 #include "tasktools.h"
 
 #include <KDesktopFile>
@@ -61,7 +62,7 @@ public:
         }
     }
 
-    QHash<QUrl, AppData> appDataCache;
+    QHash<QUrl, CachedAppData> appDataCache;
     QTimer sycocaChangeTimer;
 
     void init();
@@ -117,14 +118,18 @@ AppData LauncherTasksModel::Private::appData(const QUrl &url)
     const auto &it = appDataCache.constFind(url);
 
     if (it != appDataCache.constEnd()) {
-        return *it;
+        return it->data();
     }
 
-    const AppData &data = appDataFromUrl(url, QIcon::fromTheme(QLatin1String("unknown")));
+    CachedAppData data(url);
+
+    if (data.data().icon.isNull()) {
+        data.data().icon = QIcon::fromTheme(QLatin1String("unknown"));
+    }
 
     appDataCache.insert(url, data);
 
-    return data;
+    return data.data();
 }
 
 bool LauncherTasksModel::Private::requestAddLauncherToActivities(const QUrl &_url, const QStringList &_activities)
@@ -0,0 +1,134 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "serviceindex.h"
+
+#include <KServiceTypeTrader>
+#include <KSycoca>
+
+#include <QFileInfo>
+
+namespace TaskManager
+{
+Q_GLOBAL_STATIC(ServiceIndex, s_serviceIndex)
+
+ServiceIndex *ServiceIndex::self()
+{
+    return s_serviceIndex();
+}
+
+ServiceIndex::ServiceIndex()
+    : QObject()
+{
+    void (KSycoca::*myDatabaseChangeSignal)(const QStringList &) = &KSycoca::databaseChanged;
+    connect(KSycoca::self(), myDatabaseChangeSignal, this, [this](const QStringList &changedResources) {
+        if (changedResources.contains(QLatin1String("services")) || changedResources.contains(QLatin1String("apps"))
+            || changedResources.contains(QLatin1String("xdgdata-apps"))) {
+            m_dirty = true;
+        }
+    });
+}
+
+ServiceIndex::~ServiceIndex() = default;
+
+bool ServiceIndex::propertyFromName(const QString &name, Property *property)
+{
+    // The trader language matches property names case-sensitively.
+    if (name == QLatin1String("StartupWMClass")) {
+        *property = StartupWMClass;
+    } else if (name == QLatin1String("DesktopEntryName")) {
+        *property = DesktopEntryName;
+    } else if (name == QLatin1String("Name")) {
+        *property = Name;
+    } else if (name == QLatin1String("Exec")) {
+        *property = Exec;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+KService::List ServiceIndex::services(Property property, const QString &value, Visibility visibility)
+{
+    ensureIndex();
+
+    KService::List services = m_index[property].value(value.toCaseFolded());
+
+    if (visibility == DisplayedServices) {
+        QMutableListIterator<KService::Ptr> it(services);
+
+        while (it.hasNext()) {
+            if (it.next()->property(QStringLiteral("NoDisplay"), QVariant::Bool).toBool()) {
+                it.remove();
+            }
+        }
+    }
+
+    return services;
+}
+
+KService::List ServiceIndex::servicesByDesktopEntrySuffix(const QString &suffix)
+{
+    ensureIndex();
+
+    return m_desktopEntrySuffixes.value(suffix);
+}
+
+void ServiceIndex::ensureIndex()
+{
+    // Have KSycoca notice a rebuilt database, like a trader query would.
+    KSycoca::self()->ensureCacheValid();
+
+    const QDateTime &timestamp = QFileInfo(KSycoca::absoluteFilePath()).lastModified();
+
+    if (m_dirty || timestamp != m_databaseTimestamp) {
+        m_databaseTimestamp = timestamp;
+        rebuild();
+    }
+}
+
+void ServiceIndex::rebuild()
+{
+    for (auto &index : m_index) {
+        index.clear();
+    }
+
+    m_desktopEntrySuffixes.clear();
+
+    // Unconstrained, the trader hands out all applications in the order a
+    // constrained query would list the ones it matches.
+    const KService::List services = KServiceTypeTrader::self()->query(QStringLiteral("Application"));
+
+    for (const KService::Ptr &service : services) {
+        if (service->exec().isEmpty()) {
+            continue;
+        }
+
+        const QString values[PropertyCount] = {
+            service->property(QStringLiteral("StartupWMClass"), QVariant::String).toString(),
+            service->desktopEntryName(),
+            service->name(),
+            service->exec(),
+        };
+
+        for (int i = 0; i < PropertyCount; ++i) {
+            if (!values[i].isEmpty()) {
+                m_index[i][values[i].toCaseFolded()].append(service);
+            }
+        }
+
+        const QString &desktopEntryName = service->desktopEntryName();
+
+        for (int dot = desktopEntryName.indexOf(QLatin1Char('.')); dot != -1; dot = desktopEntryName.indexOf(QLatin1Char('.'), dot + 1)) {
+            m_desktopEntrySuffixes[desktopEntryName.mid(dot + 1)].append(service);
+        }
+    }
+
+    m_dirty = false;
+}
+
+}
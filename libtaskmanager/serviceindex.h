@@ -0,0 +1,79 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+
+#include <KService>
+
+namespace TaskManager
+{
+/*
+ * Hash lookups for the application services the task models match windows
+ * and startups against.
+ *
+ * Answers the same as KServiceTypeTrader queries of the form
+ * "exist Exec and ('value' =~ Property)" for the properties which are indexed,
+ * in the same order, without evaluating the constraint against every
+ * installed application. Rebuilt whenever the sycoca database changes.
+ */
+class ServiceIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Property {
+        StartupWMClass = 0,
+        DesktopEntryName,
+        Name,
+        Exec,
+        PropertyCount,
+    };
+
+    enum Visibility {
+        AllServices,
+        /**
+         * Only services without NoDisplay=true, i.e. "(not exist NoDisplay or not NoDisplay)"
+         */
+        DisplayedServices,
+    };
+
+    static ServiceIndex *self();
+
+    /**
+     * Maps a trader property name to an indexed property.
+     * @return false if @p name isn't indexed
+     */
+    static bool propertyFromName(const QString &name, Property *property);
+
+    /**
+     * Services with an Exec line whose @p property equals @p value, ignoring case.
+     */
+    KService::List services(Property property, const QString &value, Visibility visibility = AllServices);
+
+    /**
+     * Services with an Exec line whose DesktopEntryName ends with '.' followed by @p suffix,
+     * e.g. org.kde.dragonplayer for dragonplayer.
+     */
+    KService::List servicesByDesktopEntrySuffix(const QString &suffix);
+
+    ServiceIndex();
+    ~ServiceIndex() override;
+
+private:
+    void ensureIndex();
+    void rebuild();
+
+    QHash<QString, KService::List> m_index[PropertyCount];
+    QHash<QString, KService::List> m_desktopEntrySuffixes;
+    QDateTime m_databaseTimestamp;
+    bool m_dirty = true;
+};
+
+}
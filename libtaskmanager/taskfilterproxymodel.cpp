@@ -6,8 +6,9 @@
 
 #include "taskfilterproxymodel.h"
 #include "abstracttasksmodel.h"
-
-#include "launchertasksmodel_p.h"
+#include "changedrolesgate.h"
+#include "debugstatistics_p.h"
+#include "taskplacementindex.h"
 
 namespace TaskManager
 {
@@ -22,6 +23,14 @@ public:
     QRect screenGeometry;
     QString activity;
 
+    TaskPlacementIndex placements;
+    quint64 virtualDesktopBit = 0;
+    quint64 activityBit = 0;
+
+    // While set, only these source rows are run through acceptsRow(); the
+    // others keep their current mapping.
+    const QSet<int> *refilterRows = nullptr;
+
     bool filterByVirtualDesktop = false;
     bool filterByScreen = false;
     bool filterByActivity = false;
@@ -32,16 +41,118 @@ public:
     bool filterSkipPager = false;
 
     bool demandingAttentionSkipsFilters = true;
+
+    // The roles acceptsRow() looks at.
+    ChangedRolesGate gate{{AbstractTasksModel::SkipTaskbar,
+                           AbstractTasksModel::SkipPager,
+                           AbstractTasksModel::IsOnAllVirtualDesktops,
+                           AbstractTasksModel::IsDemandingAttention,
+                           AbstractTasksModel::VirtualDesktops,
+                           AbstractTasksModel::ScreenGeometry,
+                           AbstractTasksModel::Activities,
+                           AbstractTasksModel::IsMinimized,
+                           AbstractTasksModel::IsMaximized,
+                           AbstractTasksModel::IsHidden}};
+    quint64 resorts = 0;
+    quint64 partialRefilters = 0;
+
+    bool skipsFilters(const TaskPlacementIndex::Placement &placement) const;
+    bool acceptsVirtualDesktop(const QModelIndex &sourceIndex);
+    bool acceptsActivity(const QModelIndex &sourceIndex);
+    bool refilter(TaskFilterProxyModel *q, quint64 oldBit, quint64 newBit, bool activities);
 };
 
 TaskFilterProxyModel::Private::Private(TaskFilterProxyModel *)
 {
 }
 
+bool TaskFilterProxyModel::Private::skipsFilters(const TaskPlacementIndex::Placement &placement) const
+{
+    return demandingAttentionSkipsFilters && placement.demandsAttention;
+}
+
+bool TaskFilterProxyModel::Private::acceptsVirtualDesktop(const QModelIndex &sourceIndex)
+{
+    const TaskPlacementIndex::Placement &placement = placements.placement(sourceIndex.row());
+
+    if (placement.onAllVirtualDesktops || skipsFilters(placement)) {
+        return true;
+    }
+
+    if (placement.exactVirtualDesktops && virtualDesktopBit) {
+        return placement.virtualDesktops & virtualDesktopBit;
+    }
+
+    return sourceIndex.data(AbstractTasksModel::VirtualDesktops).toList().contains(virtualDesktop);
+}
+
+bool TaskFilterProxyModel::Private::acceptsActivity(const QModelIndex &sourceIndex)
+{
+    const TaskPlacementIndex::Placement &placement = placements.placement(sourceIndex.row());
+
+    if (placement.onAllActivities || skipsFilters(placement)) {
+        return true;
+    }
+
+    if (placement.exactActivities && activityBit) {
+        return placement.activities & activityBit;
+    }
+
+    return sourceIndex.data(AbstractTasksModel::Activities).toStringList().contains(activity);
+}
+
+bool TaskFilterProxyModel::Private::refilter(TaskFilterProxyModel *q, quint64 oldBit, quint64 newBit, bool activities)
+{
+    // Without bits for both the old and the new desktop or activity, it's not
+    // known which rows are affected.
+    if (!oldBit || !newBit || !q->sourceModel()) {
+        return false;
+    }
+
+    QSet<int> rows;
+
+    for (int row = 0; row < q->sourceModel()->rowCount(); ++row) {
+        const TaskPlacementIndex::Placement &placement = placements.placement(row);
+
+        if (skipsFilters(placement)) {
+            continue;
+        }
+
+        const bool onAll = activities ? placement.onAllActivities : placement.onAllVirtualDesktops;
+        const bool exact = activities ? placement.exactActivities : placement.exactVirtualDesktops;
+        const quint64 mask = activities ? placement.activities : placement.virtualDesktops;
+
+        if (onAll) {
+            continue;
+        }
+
+        // A task on both or neither of them stays in or out.
+        if (!exact || bool(mask & oldBit) != bool(mask & newBit)) {
+            rows.insert(row);
+        }
+    }
+
+    ++partialRefilters;
+
+    // QSortFilterProxyModel has no way to refilter just some rows, so
+    // invalidateFilter() still visits all of them. The rows not in the set
+    // are answered from their current mapping, which spares reading their
+    // role data.
+    // TODO: Use QSortFilterProxyModel::invalidateRowsFilter() with Qt 6.
+    refilterRows = &rows;
+    q->invalidateFilter();
+    refilterRows = nullptr;
+
+    return true;
+}
+
 TaskFilterProxyModel::TaskFilterProxyModel(QObject *parent)
     : QSortFilterProxyModel(parent)
     , d(new Private(this))
 {
+    connect(this, &QAbstractItemModel::layoutAboutToBeChanged, this, [this]() {
+        ++d->resorts;
+    });
 }
 
 TaskFilterProxyModel::~TaskFilterProxyModel()
@@ -52,7 +163,10 @@ void TaskFilterProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
 {
     d->sourceTasksModel = dynamic_cast<AbstractTasksModelIface *>(sourceModel);
 
+    d->gate.setModel(sourceModel, this);
+    d->placements.setModel(sourceModel, this);
     QSortFilterProxyModel::setSourceModel(sourceModel);
+    d->gate.connectClose();
 }
 
 QVariant TaskFilterProxyModel::virtualDesktop() const
@@ -63,9 +177,12 @@ QVariant TaskFilterProxyModel::virtualDesktop() const
 void TaskFilterProxyModel::setVirtualDesktop(const QVariant &desktop)
 {
     if (d->virtualDesktop != desktop) {
+        const quint64 oldBit = d->virtualDesktop.isNull() ? 0 : d->virtualDesktopBit;
+
         d->virtualDesktop = desktop;
+        d->virtualDesktopBit = desktop.isNull() ? 0 : d->placements.virtualDesktopBit(desktop);
 
-        if (d->filterByVirtualDesktop) {
+        if (d->filterByVirtualDesktop && !d->refilter(this, oldBit, d->virtualDesktopBit, false /* activities */)) {
             invalidateFilter();
         }
 
@@ -99,9 +216,12 @@ QString TaskFilterProxyModel::activity() const
 void TaskFilterProxyModel::setActivity(const QString &activity)
 {
     if (d->activity != activity) {
+        const quint64 oldBit = d->activity.isEmpty() ? 0 : d->activityBit;
+
         d->activity = activity;
+        d->activityBit = activity.isEmpty() ? 0 : d->placements.activityBit(activity);
 
-        if (d->filterByActivity) {
+        if (d->filterByActivity && !d->refilter(this, oldBit, d->activityBit, true /* activities */)) {
             invalidateFilter();
         }
 
@@ -277,15 +397,8 @@ bool TaskFilterProxyModel::acceptsRow(int sourceRow) const
     }
 
     // Filter by virtual desktop.
-    if (d->filterByVirtualDesktop && !d->virtualDesktop.isNull()) {
-        if (!sourceIdx.data(AbstractTasksModel::IsOnAllVirtualDesktops).toBool()
-            && (!d->demandingAttentionSkipsFilters || !sourceIdx.data(AbstractTasksModel::IsDemandingAttention).toBool())) {
-            const QVariantList &virtualDesktops = sourceIdx.data(AbstractTasksModel::VirtualDesktops).toList();
-
-            if (!virtualDesktops.isEmpty() && !virtualDesktops.contains(d->virtualDesktop)) {
-                return false;
-            }
-        }
+    if (d->filterByVirtualDesktop && !d->virtualDesktop.isNull() && !d->acceptsVirtualDesktop(sourceIdx)) {
+        return false;
     }
 
     // Filter by screen.
@@ -298,18 +411,8 @@ bool TaskFilterProxyModel::acceptsRow(int sourceRow) const
     }
 
     // Filter by activity.
-    if (d->filterByActivity && !d->activity.isEmpty()) {
-        if (!d->demandingAttentionSkipsFilters || !sourceIdx.data(AbstractTasksModel::IsDemandingAttention).toBool()) {
-            const QVariant &activities = sourceIdx.data(AbstractTasksModel::Activities);
-
-            if (!activities.isNull()) {
-                const QStringList l = activities.toStringList();
-
-                if (!l.isEmpty() && !l.contains(NULL_UUID) && !l.contains(d->activity)) {
-                    return false;
-                }
-            }
-        }
+    if (d->filterByActivity && !d->activity.isEmpty() && !d->acceptsActivity(sourceIdx)) {
+        return false;
     }
 
     // Filter not minimized.
@@ -342,9 +445,28 @@ bool TaskFilterProxyModel::acceptsRow(int sourceRow) const
     return true;
 }
 
+QVariantMap DebugStatistics::of(const TaskFilterProxyModel *model)
+{
+    QVariantMap statistics = model->d->gate.statistics();
+    statistics.insert(QStringLiteral("resorts"), model->d->resorts);
+    statistics.insert(QStringLiteral("partialRefilters"), model->d->partialRefilters);
+
+    return statistics;
+}
+
 bool TaskFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
-    Q_UNUSED(sourceParent)
+    const QModelIndex &sourceIndex = sourceModel()->index(sourceRow, 0, sourceParent);
+
+    // Switching desktop or activity only affects some rows; the others stay in or out.
+    if (d->refilterRows && !d->refilterRows->contains(sourceRow)) {
+        return mapFromSource(sourceIndex).isValid();
+    }
+
+    // Only roles we don't filter by changed; the row stays in or out.
+    if (d->gate.skipFilter(sourceIndex)) {
+        return mapFromSource(sourceIndex).isValid();
+    }
 
     return acceptsRow(sourceRow);
 }
@@ -318,6 +318,7 @@ protected:
 
 private:
     class Private;
+    friend class DebugStatistics;
     QScopedPointer<Private> d;
 };
 
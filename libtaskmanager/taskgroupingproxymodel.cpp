@@ -6,9 +6,15 @@
 
 #include "taskgroupingproxymodel.h"
 #include "abstracttasksmodel.h"
+#include "debugstatistics_p.h"
 #include "tasktools.h"
 
+#include <QHash>
 #include <QSet>
+#include <QUrl>
+
+#include <algorithm>
+#include <functional>
 
 namespace TaskManager
 {
@@ -26,6 +32,30 @@ public:
 
     QVector<QVector<int> *> rowMap;
 
+    // What appsMatch() compares, for the first source row of each entry in rowMap.
+    struct AppKey {
+        QString appId;
+        QUrl launcherUrl;
+    };
+    QHash<const QVector<int> *, AppKey> appKeys;
+    QHash<QString, QSet<QVector<int> *>> entriesByAppId;
+    QHash<QUrl, QSet<QVector<int> *>> entriesByLauncherUrl;
+
+    // Where each source row and each entry of rowMap can be found. Rebuilt
+    // from rowMap when needed after it was changed in ways not patched in
+    // place; that's plain int work, unlike the data() calls it saves.
+    struct Location {
+        int row = -1;
+        int child = -1;
+    };
+    QVector<Location> sourceRowLocations;
+    QHash<const QVector<int> *, int> entryRows;
+    bool locationsDirty = true;
+
+    quint64 rebuilds = 0;
+    quint64 regroupChecks = 0;
+    quint64 appKeyUpdates = 0;
+
     QSet<QString> blacklistedAppIds;
     QSet<QString> blacklistedLauncherUrls;
 
@@ -42,6 +72,18 @@ public:
     void sourceDataChanged(QModelIndex topLeft, QModelIndex bottomRight, const QVector<int> &roles = QVector<int>());
     void adjustMap(int anchor, int delta);
 
+    void indexEntry(QVector<int> *entry);
+    void unindexEntry(const QVector<int> *entry);
+    void clearIndex();
+    /**
+     * Entries whose first source row appsMatch() would match with @p sourceIndex
+     */
+    QSet<QVector<int> *> matchingEntries(const QModelIndex &sourceIndex) const;
+
+    void updateLocations();
+    Location locate(int sourceRow);
+    int rowOf(const QVector<int> *entry);
+
     void rebuildMap();
     bool shouldGroupTasks();
     void checkGrouping(bool silent = false);
@@ -120,7 +162,16 @@ void TaskGroupingProxyModel::Private::sourceRowsInserted(const QModelIndex &pare
     for (int i = start; i <= end; ++i) {
         if (!shouldGroup || !tryToGroup(q->sourceModel()->index(i, 0))) {
             q->beginInsertRows(QModelIndex(), rowMap.count(), rowMap.count());
-            rowMap.append(new QVector<int>{i});
+            auto entry = new QVector<int>{i};
+            rowMap.append(entry);
+            indexEntry(entry);
+            if (!locationsDirty) {
+                if (i >= sourceRowLocations.count()) {
+                    sourceRowLocations.resize(i + 1);
+                }
+                sourceRowLocations[i] = Location{rowMap.count() - 1, 0};
+                entryRows.insert(entry, rowMap.count() - 1);
+            }
             q->endInsertRows();
         }
     }
@@ -136,39 +187,52 @@ void TaskGroupingProxyModel::Private::sourceRowsAboutToBeRemoved(const QModelInd
     }
 
     for (int i = first; i <= last; ++i) {
-        for (int j = 0; j < rowMap.count(); ++j) {
-            const QVector<int> *sourceRows = rowMap.at(j);
-            const int mapIndex = sourceRows->indexOf(i);
-
-            if (mapIndex != -1) {
-                // Remove top-level item.
-                if (sourceRows->count() == 1) {
-                    q->beginRemoveRows(QModelIndex(), j, j);
-                    delete rowMap.takeAt(j);
-                    q->endRemoveRows();
-                    // Dissolve group.
-                } else if (sourceRows->count() == 2) {
-                    const QModelIndex parent = q->index(j, 0);
-                    q->beginRemoveRows(parent, 0, 1);
-                    rowMap[j]->remove(mapIndex);
-                    q->endRemoveRows();
-
-                    // We're no longer a group parent.
-                    Q_EMIT q->dataChanged(parent, parent);
-                    // Remove group member.
-                } else {
-                    const QModelIndex parent = q->index(j, 0);
-                    q->beginRemoveRows(parent, mapIndex, mapIndex);
-                    rowMap[j]->remove(mapIndex);
-                    q->endRemoveRows();
-
-                    // Various roles of the parent evaluate child data, and the
-                    // child list has changed.
-                    Q_EMIT q->dataChanged(parent, parent);
-                }
+        const Location location = locate(i);
+        const int j = location.row;
+        const int mapIndex = location.child;
+
+        if (j == -1) {
+            continue;
+        }
+
+        const QVector<int> *sourceRows = rowMap.at(j);
+
+        // Remove top-level item.
+        if (sourceRows->count() == 1) {
+            q->beginRemoveRows(QModelIndex(), j, j);
+            unindexEntry(sourceRows);
+            delete rowMap.takeAt(j);
+            locationsDirty = true;
+            q->endRemoveRows();
+            // Dissolve group.
+        } else if (sourceRows->count() == 2) {
+            const QModelIndex parent = q->index(j, 0);
+            q->beginRemoveRows(parent, 0, 1);
+            rowMap[j]->remove(mapIndex);
+            locationsDirty = true;
+            q->endRemoveRows();
 
-                break;
+            if (mapIndex == 0) {
+                indexEntry(rowMap[j]);
             }
+
+            // We're no longer a group parent.
+            Q_EMIT q->dataChanged(parent, parent);
+            // Remove group member.
+        } else {
+            const QModelIndex parent = q->index(j, 0);
+            q->beginRemoveRows(parent, mapIndex, mapIndex);
+            rowMap[j]->remove(mapIndex);
+            locationsDirty = true;
+            q->endRemoveRows();
+
+            if (mapIndex == 0) {
+                indexEntry(rowMap[j]);
+            }
+
+            // Various roles of the parent evaluate child data, and the
+            // child list has changed.
+            Q_EMIT q->dataChanged(parent, parent);
         }
     }
 }
@@ -199,6 +263,8 @@ void TaskGroupingProxyModel::Private::sourceModelReset()
 
 void TaskGroupingProxyModel::Private::sourceDataChanged(QModelIndex topLeft, QModelIndex bottomRight, const QVector<int> &roles)
 {
+    const bool appKeyChanged = roles.isEmpty() || roles.contains(AbstractTasksModel::AppId) || roles.contains(AbstractTasksModel::LauncherUrlWithoutIcon);
+
     for (int i = topLeft.row(); i <= bottomRight.row(); ++i) {
         const QModelIndex &sourceIndex = q->sourceModel()->index(i, 0);
         QModelIndex proxyIndex = q->mapFromSource(sourceIndex);
@@ -207,6 +273,15 @@ void TaskGroupingProxyModel::Private::sourceDataChanged(QModelIndex topLeft, QMo
             return;
         }
 
+        if (appKeyChanged) {
+            ++appKeyUpdates;
+            const Location location = locate(i);
+
+            if (location.child == 0) {
+                indexEntry(rowMap.at(location.row));
+            }
+        }
+
         const QModelIndex parent = proxyIndex.parent();
 
         // If a child item changes, its parent may need an update as well as many of
@@ -224,7 +299,9 @@ void TaskGroupingProxyModel::Private::sourceDataChanged(QModelIndex topLeft, QMo
             && !sourceIndex.data(AbstractTasksModel::IsDemandingAttention).toBool()) {
             if (shouldGroupTasks() && tryToGroup(sourceIndex)) {
                 q->beginRemoveRows(QModelIndex(), proxyIndex.row(), proxyIndex.row());
+                unindexEntry(rowMap.at(proxyIndex.row()));
                 delete rowMap.takeAt(proxyIndex.row());
+                locationsDirty = true;
                 q->endRemoveRows();
             } else {
                 Q_EMIT q->dataChanged(proxyIndex, proxyIndex, roles);
@@ -246,22 +323,141 @@ void TaskGroupingProxyModel::Private::adjustMap(int anchor, int delta)
 
             if (it.value() >= anchor) {
                 it.setValue(it.value() + delta);
+                locationsDirty = true;
             }
         }
     }
 }
 
+void TaskGroupingProxyModel::Private::indexEntry(QVector<int> *entry)
+{
+    unindexEntry(entry);
+
+    const QModelIndex &sourceIndex = q->sourceModel()->index(entry->constFirst(), 0);
+    AppKey key{sourceIndex.data(AbstractTasksModel::AppId).toString(), sourceIndex.data(AbstractTasksModel::LauncherUrlWithoutIcon).toUrl()};
+
+    // Mirror appsMatch(): empty app ids and invalid URLs never match.
+    if (!key.appId.isEmpty()) {
+        entriesByAppId[key.appId].insert(entry);
+    }
+
+    if (key.launcherUrl.isValid()) {
+        entriesByLauncherUrl[key.launcherUrl].insert(entry);
+    }
+
+    appKeys.insert(entry, key);
+}
+
+void TaskGroupingProxyModel::Private::unindexEntry(const QVector<int> *entry)
+{
+    const auto it = appKeys.constFind(entry);
+
+    if (it == appKeys.constEnd()) {
+        return;
+    }
+
+    auto removeFrom = [entry](auto &index, const auto &key) {
+        auto entries = index.find(key);
+
+        if (entries != index.end()) {
+            entries->remove(const_cast<QVector<int> *>(entry));
+
+            if (entries->isEmpty()) {
+                index.erase(entries);
+            }
+        }
+    };
+
+    removeFrom(entriesByAppId, it->appId);
+    removeFrom(entriesByLauncherUrl, it->launcherUrl);
+
+    appKeys.erase(it);
+}
+
+void TaskGroupingProxyModel::Private::clearIndex()
+{
+    appKeys.clear();
+    entriesByAppId.clear();
+    entriesByLauncherUrl.clear();
+    locationsDirty = true;
+}
+
+QSet<QVector<int> *> TaskGroupingProxyModel::Private::matchingEntries(const QModelIndex &sourceIndex) const
+{
+    QSet<QVector<int> *> entries;
+
+    const QString &appId = sourceIndex.data(AbstractTasksModel::AppId).toString();
+
+    if (!appId.isEmpty()) {
+        entries = entriesByAppId.value(appId);
+    }
+
+    const QUrl &launcherUrl = sourceIndex.data(AbstractTasksModel::LauncherUrlWithoutIcon).toUrl();
+
+    if (launcherUrl.isValid()) {
+        entries.unite(entriesByLauncherUrl.value(launcherUrl));
+    }
+
+    return entries;
+}
+
+void TaskGroupingProxyModel::Private::updateLocations()
+{
+    if (!locationsDirty) {
+        return;
+    }
+
+    sourceRowLocations.clear();
+    entryRows.clear();
+    entryRows.reserve(rowMap.count());
+
+    for (int i = 0; i < rowMap.count(); ++i) {
+        const QVector<int> *sourceRows = rowMap.at(i);
+        entryRows.insert(sourceRows, i);
+
+        for (int j = 0; j < sourceRows->count(); ++j) {
+            const int sourceRow = sourceRows->at(j);
+
+            if (sourceRow >= sourceRowLocations.count()) {
+                sourceRowLocations.resize(sourceRow + 1);
+            }
+
+            sourceRowLocations[sourceRow] = Location{i, j};
+        }
+    }
+
+    locationsDirty = false;
+}
+
+TaskGroupingProxyModel::Private::Location TaskGroupingProxyModel::Private::locate(int sourceRow)
+{
+    updateLocations();
+
+    return sourceRowLocations.value(sourceRow);
+}
+
+int TaskGroupingProxyModel::Private::rowOf(const QVector<int> *entry)
+{
+    updateLocations();
+
+    return entryRows.value(entry, -1);
+}
+
 void TaskGroupingProxyModel::Private::rebuildMap()
 {
+    ++rebuilds;
     qDeleteAll(rowMap);
     rowMap.clear();
+    clearIndex();
 
     const int rows = q->sourceModel()->rowCount();
 
     rowMap.reserve(rows);
 
     for (int i = 0; i < rows; ++i) {
-        rowMap.append(new QVector<int>{i});
+        auto entry = new QVector<int>{i};
+        rowMap.append(entry);
+        indexEntry(entry);
     }
 
     checkGrouping(true /* silent */);
@@ -306,7 +502,9 @@ void TaskGroupingProxyModel::Private::checkGrouping(bool silent)
 
             if (tryToGroup(q->sourceModel()->index(rowMap.at(i)->constFirst(), 0), silent)) {
                 q->beginRemoveRows(QModelIndex(), i, i);
+                unindexEntry(rowMap.at(i));
                 delete rowMap.takeAt(i); // Safe since we're iterating backwards.
+                locationsDirty = true;
                 q->endRemoveRows();
             }
         }
@@ -339,6 +537,8 @@ bool TaskGroupingProxyModel::Private::isBlacklisted(const QModelIndex &sourceInd
 
 bool TaskGroupingProxyModel::Private::tryToGroup(const QModelIndex &sourceIndex, bool silent)
 {
+    ++regroupChecks;
+
     // NOTE: We only group window tasks at this time. If this ever changes, the
     // implementation of data() will have to be adjusted significantly, as for
     // many roles it currently falls through to the first child item when dealing
@@ -360,8 +560,21 @@ bool TaskGroupingProxyModel::Private::tryToGroup(const QModelIndex &sourceIndex,
     }
 
     // Meat of the matter: Try to add this source row to a sub-list with source rows
-    // associated with the same application.
-    for (int i = 0; i < rowMap.count(); ++i) {
+    // associated with the same application. Go by the index instead of comparing
+    // with every sub-list, but still pick the first one in rowMap which matches.
+    QVector<int> candidateRows;
+
+    for (const QVector<int> *entry : matchingEntries(sourceIndex)) {
+        candidateRows.append(rowOf(entry));
+    }
+
+    std::sort(candidateRows.begin(), candidateRows.end());
+
+    for (const int i : qAsConst(candidateRows)) {
+        if (i == -1) {
+            continue;
+        }
+
         const QModelIndex &groupRep = q->sourceModel()->index(rowMap.at(i)->constFirst(), 0);
 
         // Don't match a row with itself.
@@ -389,6 +602,15 @@ bool TaskGroupingProxyModel::Private::tryToGroup(const QModelIndex &sourceIndex,
 
             rowMap[i]->append(sourceIndex.row());
 
+            if (!locationsDirty) {
+                if (sourceIndex.row() >= sourceRowLocations.count()) {
+                    sourceRowLocations.resize(sourceIndex.row() + 1);
+                }
+                // The row's own top-level entry, if any, is still around at this point
+                // and gets removed by the caller.
+                sourceRowLocations[sourceIndex.row()] = Location{i, rowMap.at(i)->count() - 1};
+            }
+
             if (!silent) {
                 q->endInsertRows();
 
@@ -413,7 +635,19 @@ void TaskGroupingProxyModel::Private::formGroupFor(const QModelIndex &index)
     // in through grouping.
     const QModelIndex &sourceTarget = q->mapToSource(index);
 
-    for (int i = (rowMap.count() - 1); i >= 0; --i) {
+    QVector<int> candidateRows;
+
+    for (const QVector<int> *entry : matchingEntries(sourceTarget)) {
+        candidateRows.append(rowOf(entry));
+    }
+
+    std::sort(candidateRows.begin(), candidateRows.end(), std::greater<int>());
+
+    for (const int i : qAsConst(candidateRows)) {
+        if (i == -1) {
+            continue;
+        }
+
         const QModelIndex &sourceIndex = q->sourceModel()->index(rowMap.at(i)->constFirst(), 0);
 
         if (!appsMatch(sourceTarget, sourceIndex)) {
@@ -422,7 +656,9 @@ void TaskGroupingProxyModel::Private::formGroupFor(const QModelIndex &index)
 
         if (tryToGroup(sourceIndex)) {
             q->beginRemoveRows(QModelIndex(), i, i);
+            unindexEntry(rowMap.at(i));
             delete rowMap.takeAt(i); // Safe since we're iterating backwards.
+            locationsDirty = true;
             q->endRemoveRows();
         }
     }
@@ -449,6 +685,7 @@ void TaskGroupingProxyModel::Private::breakGroupFor(const QModelIndex &index, bo
     }
 
     rowMap[row]->resize(1);
+    locationsDirty = true;
 
     if (!silent) {
         q->endRemoveRows();
@@ -460,7 +697,9 @@ void TaskGroupingProxyModel::Private::breakGroupFor(const QModelIndex &index, bo
     }
 
     for (int i = 0; i < extraChildren.count(); ++i) {
-        rowMap.append(new QVector<int>{extraChildren.at(i)});
+        auto entry = new QVector<int>{extraChildren.at(i)};
+        rowMap.append(entry);
+        indexEntry(entry);
     }
 
     if (!silent) {
@@ -500,7 +739,7 @@ QModelIndex TaskGroupingProxyModel::parent(const QModelIndex &child) const
     if (child.internalPointer() == nullptr) {
         return QModelIndex();
     } else {
-        const int parentRow = d->rowMap.indexOf(static_cast<QVector<int> *>(child.internalPointer()));
+        const int parentRow = d->rowOf(static_cast<QVector<int> *>(child.internalPointer()));
 
         if (parentRow != -1) {
             return index(parentRow, 0);
@@ -520,28 +759,28 @@ QModelIndex TaskGroupingProxyModel::mapFromSource(const QModelIndex &sourceIndex
         return QModelIndex();
     }
 
-    for (int i = 0; i < d->rowMap.count(); ++i) {
-        const QVector<int> *sourceRows = d->rowMap.at(i);
-        const int childIndex = sourceRows->indexOf(sourceIndex.row());
-        const QModelIndex parent = index(i, 0);
-
-        if (childIndex == 0) {
-            // If the sub-list we found the source row in is larger than 1 (i.e. part
-            // of a group, map to the logical child item instead of the parent item
-            // the source row also stands in for. The parent is therefore unreachable
-            // from mapToSource().
-            if (d->isGroup(i)) {
-                return index(0, 0, parent);
-                // Otherwise map to the top-level item.
-            } else {
-                return parent;
-            }
-        } else if (childIndex != -1) {
-            return index(childIndex, 0, parent);
+    const Private::Location location = d->locate(sourceIndex.row());
+
+    if (location.row == -1) {
+        return QModelIndex();
+    }
+
+    const QModelIndex parent = index(location.row, 0);
+
+    if (location.child == 0) {
+        // If the sub-list we found the source row in is larger than 1 (i.e. part
+        // of a group, map to the logical child item instead of the parent item
+        // the source row also stands in for. The parent is therefore unreachable
+        // from mapToSource().
+        if (d->isGroup(location.row)) {
+            return index(0, 0, parent);
+            // Otherwise map to the top-level item.
+        } else {
+            return parent;
         }
     }
 
-    return QModelIndex();
+    return index(location.child, 0, parent);
 }
 
 QModelIndex TaskGroupingProxyModel::mapToSource(const QModelIndex &proxyIndex) const
@@ -767,7 +1006,9 @@ void TaskGroupingProxyModel::setSourceModel(QAbstractItemModel *sourceModel)
         connect(sourceModel, &QSortFilterProxyModel::modelReset, this, std::bind(&TaskGroupingProxyModel::Private::sourceModelReset, dd));
         connect(sourceModel, &QSortFilterProxyModel::dataChanged, this, std::bind(&TaskGroupingProxyModel::Private::sourceDataChanged, dd, _1, _2, _3));
     } else {
+        qDeleteAll(d->rowMap);
         d->rowMap.clear();
+        d->clearIndex();
     }
 
     endResetModel();
@@ -988,22 +1229,23 @@ void TaskGroupingProxyModel::requestToggleMaximized(const QModelIndex &index)
     } else {
         const bool goalState = !index.data(AbstractTasksModel::IsMaximized).toBool();
 
-        QModelIndexList inStackingOrder;
+        // Look up each child's position once rather than in every comparison.
+        QVector<std::pair<int, QModelIndex>> inStackingOrder;
 
         for (int i = 0; i < rowCount(index); ++i) {
             const QModelIndex &child = this->index(i, 0, index);
 
             if (child.data(AbstractTasksModel::IsMaximized).toBool() != goalState) {
-                inStackingOrder << mapToSource(child);
+                inStackingOrder.append({child.data(AbstractTasksModel::StackingOrder).toInt(), mapToSource(child)});
             }
         }
 
-        std::sort(inStackingOrder.begin(), inStackingOrder.end(), [](const QModelIndex &a, const QModelIndex &b) {
-            return (a.data(AbstractTasksModel::StackingOrder).toInt() < b.data(AbstractTasksModel::StackingOrder).toInt());
+        std::stable_sort(inStackingOrder.begin(), inStackingOrder.end(), [](const std::pair<int, QModelIndex> &a, const std::pair<int, QModelIndex> &b) {
+            return (a.first < b.first);
         });
 
-        for (const QModelIndex &sourceChild : qAsConst(inStackingOrder)) {
-            d->abstractTasksSourceModel->requestToggleMaximized(sourceChild);
+        for (const auto &sourceChild : qAsConst(inStackingOrder)) {
+            d->abstractTasksSourceModel->requestToggleMaximized(sourceChild.second);
         }
     }
 }
@@ -1222,6 +1464,13 @@ void TaskGroupingProxyModel::requestToggleGrouping(const QModelIndex &index)
     emit blacklistedLauncherUrlsChanged();
 }
 
+QVariantMap DebugStatistics::of(const TaskGroupingProxyModel *model)
+{
+    return QVariantMap{{QStringLiteral("rebuilds"), model->d->rebuilds},
+                       {QStringLiteral("regroupChecks"), model->d->regroupChecks},
+                       {QStringLiteral("appKeyUpdates"), model->d->appKeyUpdates}};
+}
+
 }
 
 #include "moc_taskgroupingproxymodel.cpp"
@@ -378,6 +378,7 @@ Q_SIGNALS:
 
 private:
     class Private;
+    friend class DebugStatistics;
     QScopedPointer<Private> d;
 
     Q_PRIVATE_SLOT(d, void sourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last))
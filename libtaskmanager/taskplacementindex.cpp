@@ -0,0 +1,171 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "taskplacementindex.h"
+#include "abstracttasksmodel.h"
+
+#include "launchertasksmodel_p.h"
+
+#include <QAbstractItemModel>
+
+namespace TaskManager
+{
+static const int s_maxIds = 64;
+
+static quint64 bit(QHash<QString, int> &ids, const QString &key)
+{
+    auto it = ids.constFind(key);
+
+    if (it == ids.constEnd()) {
+        if (ids.count() >= s_maxIds) {
+            return 0;
+        }
+
+        it = ids.insert(key, ids.count());
+    }
+
+    return quint64(1) << it.value();
+}
+
+TaskPlacementIndex::TaskPlacementIndex()
+{
+}
+
+TaskPlacementIndex::~TaskPlacementIndex()
+{
+    for (const auto &connection : qAsConst(m_connections)) {
+        QObject::disconnect(connection);
+    }
+}
+
+void TaskPlacementIndex::setModel(QAbstractItemModel *model, QObject *context)
+{
+    for (const auto &connection : qAsConst(m_connections)) {
+        QObject::disconnect(connection);
+    }
+
+    m_connections.clear();
+    m_placements.clear();
+
+    m_model = model;
+
+    if (!m_model) {
+        return;
+    }
+
+    m_placements.resize(m_model->rowCount());
+
+    m_connections << QObject::connect(m_model,
+                                      &QAbstractItemModel::dataChanged,
+                                      context,
+                                      [this](const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles) {
+                                          // No roles means any of them may have changed.
+                                          if (roles.isEmpty() || roles.contains(AbstractTasksModel::VirtualDesktops)
+                                              || roles.contains(AbstractTasksModel::IsOnAllVirtualDesktops) || roles.contains(AbstractTasksModel::Activities)
+                                              || roles.contains(AbstractTasksModel::IsDemandingAttention)) {
+                                              invalidate(topLeft.row(), bottomRight.row());
+                                          }
+                                      });
+
+    const auto reset = [this]() {
+        m_placements.clear();
+        m_placements.resize(m_model->rowCount());
+    };
+
+    // placement() may have been asked about rows the model already has but
+    // didn't announce yet; then the rows don't line up anymore.
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsInserted, context, [this, reset](const QModelIndex &parent, int first, int last) {
+        if (parent.isValid()) {
+            return;
+        }
+
+        if (first <= m_placements.count() && m_placements.count() + (last - first + 1) == m_model->rowCount()) {
+            m_placements.insert(first, last - first + 1, Placement());
+        } else {
+            reset();
+        }
+    });
+
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsRemoved, context, [this, reset](const QModelIndex &parent, int first, int last) {
+        if (parent.isValid()) {
+            return;
+        }
+
+        if (last < m_placements.count() && m_placements.count() - (last - first + 1) == m_model->rowCount()) {
+            m_placements.remove(first, last - first + 1);
+        } else {
+            reset();
+        }
+    });
+
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::rowsMoved, context, reset);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::layoutChanged, context, reset);
+    m_connections << QObject::connect(m_model, &QAbstractItemModel::modelReset, context, reset);
+}
+
+const TaskPlacementIndex::Placement &TaskPlacementIndex::placement(int row)
+{
+    if (row >= m_placements.count()) {
+        m_placements.resize(qMax(row + 1, m_model->rowCount()));
+    }
+
+    Placement &placement = m_placements[row];
+
+    if (placement.valid) {
+        return placement;
+    }
+
+    placement = Placement();
+    placement.valid = true;
+
+    const QModelIndex &index = m_model->index(row, 0);
+
+    placement.demandsAttention = index.data(AbstractTasksModel::IsDemandingAttention).toBool();
+
+    const QVariantList &virtualDesktops = index.data(AbstractTasksModel::VirtualDesktops).toList();
+    placement.onAllVirtualDesktops = index.data(AbstractTasksModel::IsOnAllVirtualDesktops).toBool() || virtualDesktops.isEmpty();
+
+    for (const QVariant &desktop : virtualDesktops) {
+        const quint64 desktopBit = virtualDesktopBit(desktop);
+
+        placement.virtualDesktops |= desktopBit;
+        placement.exactVirtualDesktops = placement.exactVirtualDesktops && desktopBit;
+    }
+
+    const QStringList &activities = index.data(AbstractTasksModel::Activities).toStringList();
+    placement.onAllActivities = activities.isEmpty() || activities.contains(QLatin1String(NULL_UUID));
+
+    for (const QString &activity : activities) {
+        const quint64 activityBit = this->activityBit(activity);
+
+        placement.activities |= activityBit;
+        placement.exactActivities = placement.exactActivities && activityBit;
+    }
+
+    return placement;
+}
+
+quint64 TaskPlacementIndex::virtualDesktopBit(const QVariant &desktop)
+{
+    // X11 desktops are numbers, Wayland ones strings.
+    return bit(m_virtualDesktopIds, desktop.toString());
+}
+
+quint64 TaskPlacementIndex::activityBit(const QString &activity)
+{
+    return bit(m_activityIds, activity);
+}
+
+void TaskPlacementIndex::invalidate(int first, int last)
+{
+    last = qMin(last, m_placements.count() - 1);
+
+    for (int row = qMax(first, 0); row <= last; ++row) {
+        m_placements[row].valid = false;
+    }
+}
+
+}
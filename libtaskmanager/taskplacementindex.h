@@ -0,0 +1,80 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QMetaObject>
+#include <QVariant>
+#include <QVector>
+
+class QAbstractItemModel;
+
+namespace TaskManager
+{
+/*
+ * Keeps the virtual desktops and activities of the tasks in a flat tasks model
+ * as bitmasks, so a filter can test them with bitwise operations instead of
+ * comparing the QVariantList and QStringList data of the tasks.
+ *
+ * Desktop and activity ids are interned to bits in the order they are first
+ * seen. Only the first 64 of each get a bit; tasks on any other are marked
+ * inexact and have to be filtered by their role data.
+ *
+ * The placement of a row is read from the model when it is first asked for and
+ * dropped when one of the roles it is made from changes.
+ */
+class TaskPlacementIndex
+{
+public:
+    struct Placement {
+        quint64 virtualDesktops = 0;
+        quint64 activities = 0;
+        bool onAllVirtualDesktops = false; /**< Also set if the task has no virtual desktops. */
+        bool onAllActivities = false; /**< Also set if the task has no activities. */
+        bool exactVirtualDesktops = true; /**< All of the virtual desktops have a bit. */
+        bool exactActivities = true; /**< All of the activities have a bit. */
+        bool demandsAttention = false;
+        bool valid = false;
+    };
+
+    TaskPlacementIndex();
+    ~TaskPlacementIndex();
+
+    /**
+     * Starts watching @p model. Needs to be called before the proxy connects to
+     * the signals of @p model, i.e. before QSortFilterProxyModel::setSourceModel(),
+     * so placements are up to date when the proxy filters changed rows.
+     *
+     * @param context the proxy, scoping the connections
+     */
+    void setModel(QAbstractItemModel *model, QObject *context);
+
+    const Placement &placement(int row);
+
+    /**
+     * The bit of a virtual desktop, interning it if need be.
+     * Returns 0 if no bit is left for it.
+     */
+    quint64 virtualDesktopBit(const QVariant &desktop);
+
+    /**
+     * The bit of an activity, interning it if need be.
+     * Returns 0 if no bit is left for it.
+     */
+    quint64 activityBit(const QString &activity);
+
+private:
+    void invalidate(int first, int last);
+
+    QAbstractItemModel *m_model = nullptr;
+    QVector<QMetaObject::Connection> m_connections;
+    QVector<Placement> m_placements;
+    QHash<QString, int> m_virtualDesktopIds;
+    QHash<QString, int> m_activityIds;
+};
+
+}
@@ -6,7 +6,10 @@
 
 #include "tasksmodel.h"
 #include "activityinfo.h"
+#include "cachedappdata.h"
+#include "changedrolesgate.h"
 #include "concatenatetasksproxymodel.h"
+#include "debugstatistics_p.h"
 #include "flattentaskgroupsproxymodel.h"
 #include "taskfilterproxymodel.h"
 #include "taskgroupingproxymodel.h"
@@ -23,10 +26,202 @@
 #include <QTimer>
 #include <QUrl>
 
+#include <algorithm>
 #include <numeric>
 
 namespace TaskManager
 {
+/*
+ * The manual sort order: pre-filter rows (i.e. concatProxyModel rows) in the
+ * order they are to be shown in.
+ *
+ * Sort comparators look up the position of rows in the map for every single
+ * comparison, so it keeps an index of those at hand. It also knows how much of
+ * the map is still in the order the last sort left it in, so rows appended
+ * since can be sorted in by binary insertion rather than sorting everything.
+ */
+class ManualSortMap
+{
+public:
+    bool isEmpty() const
+    {
+        return m_rows.isEmpty();
+    }
+
+    int count() const
+    {
+        return m_rows.count();
+    }
+
+    int at(int position) const
+    {
+        return m_rows.at(position);
+    }
+
+    int indexOf(int row) const
+    {
+        updatePositions();
+
+        return m_positions.value(row, -1);
+    }
+
+    /**
+     * Entries in front of this position are in sorted order.
+     */
+    int sortedCount() const
+    {
+        return m_sortedCount;
+    }
+
+    void reserve(int size)
+    {
+        m_rows.reserve(size);
+    }
+
+    void clear()
+    {
+        m_rows.clear();
+        m_positionsDirty = true;
+        m_sortedCount = 0;
+    }
+
+    void append(int row)
+    {
+        m_rows.append(row);
+        m_positionsDirty = true;
+    }
+
+    void replace(int position, int row)
+    {
+        m_rows[position] = row;
+        m_positionsDirty = true;
+        m_sortedCount = qMin(m_sortedCount, position);
+    }
+
+    /**
+     * @param keepsOrder whether the caller knows the move to leave a sorted map sorted
+     */
+    void move(int from, int to, bool keepsOrder = false)
+    {
+        if (from == to) {
+            return;
+        }
+
+        m_rows.move(from, to);
+
+        if (!m_positionsDirty) {
+            for (int i = qMin(from, to); i <= qMax(from, to); ++i) {
+                m_positions[m_rows.at(i)] = i;
+            }
+        }
+
+        if (!keepsOrder) {
+            m_sortedCount = qMin(m_sortedCount, qMin(from, to));
+        }
+    }
+
+    /**
+     * Shifts rows from @p anchor on by @p delta, for rows inserted into the source.
+     */
+    void adjustRows(int anchor, int delta)
+    {
+        for (int &row : m_rows) {
+            if (row >= anchor) {
+                row += delta;
+            }
+        }
+
+        m_positionsDirty = true;
+    }
+
+    /**
+     * Drops rows @p first to @p last and shifts the rows after them, in a single pass.
+     */
+    void removeRows(int first, int last)
+    {
+        const int delta = (last - first) + 1;
+        int kept = 0;
+        int sortedKept = 0;
+
+        for (int i = 0; i < m_rows.count(); ++i) {
+            const int row = m_rows.at(i);
+
+            if (row >= first && row <= last) {
+                continue;
+            }
+
+            if (i < m_sortedCount) {
+                ++sortedKept;
+            }
+
+            m_rows[kept] = (row > last) ? row - delta : row;
+            ++kept;
+        }
+
+        m_rows.resize(kept);
+        m_positionsDirty = true;
+        m_sortedCount = sortedKept;
+    }
+
+    template<typename LessThan>
+    void sort(LessThan lessThan)
+    {
+        // Comparators may consult indexOf(); have them see the order we start from
+        // rather than whatever state the sort leaves the map in half-way.
+        updatePositions();
+
+        QVector<int> rows = m_rows;
+        std::stable_sort(rows.begin(), rows.end(), lessThan);
+        m_rows = rows;
+
+        m_positionsDirty = true;
+        m_sortedCount = m_rows.count();
+    }
+
+    /**
+     * Sorts the entries past sortedCount() into the sorted ones in front of them.
+     */
+    template<typename LessThan>
+    void sortIn(LessThan lessThan)
+    {
+        for (int i = m_sortedCount; i < m_rows.count(); ++i) {
+            const int row = m_rows.at(i);
+            const auto it = std::upper_bound(m_rows.cbegin(), m_rows.cbegin() + i, row, lessThan);
+
+            move(i, it - m_rows.cbegin(), true /* keepsOrder */);
+        }
+
+        m_sortedCount = m_rows.count();
+    }
+
+private:
+    void updatePositions() const
+    {
+        if (!m_positionsDirty) {
+            return;
+        }
+
+        int size = 0;
+
+        for (const int row : m_rows) {
+            size = qMax(size, row + 1);
+        }
+
+        m_positions.fill(-1, size);
+
+        for (int i = 0; i < m_rows.count(); ++i) {
+            m_positions[m_rows.at(i)] = i;
+        }
+
+        m_positionsDirty = false;
+    }
+
+    QVector<int> m_rows;
+    mutable QVector<int> m_positions;
+    mutable bool m_positionsDirty = true;
+    int m_sortedCount = 0;
+};
+
 class Q_DECL_HIDDEN TasksModel::Private
 {
 public:
@@ -54,7 +249,7 @@ public:
     bool launchersEverSet = false;
     bool launcherSortingDirty = false;
     bool launcherCheckNeeded = false;
-    QList<int> sortedPreFilterRows;
+    ManualSortMap sortedPreFilterRows;
     QVector<int> sortRowInsertQueue;
     bool sortRowInsertQueueStale = false;
     QHash<QString, int> activityTaskCounts;
@@ -69,10 +264,21 @@ public:
     bool usedByQml = false;
     bool componentComplete = false;
 
+    // The roles filterAcceptsRow() looks at for the row it is asked about.
+    ChangedRolesGate gate{{AbstractTasksModel::IsGroupParent,
+                           AbstractTasksModel::AppId,
+                           AbstractTasksModel::AppName,
+                           AbstractTasksModel::IsStartup,
+                           AbstractTasksModel::IsLauncher,
+                           AbstractTasksModel::IsWindow,
+                           AbstractTasksModel::LauncherUrlWithoutIcon}};
+    quint64 resorts = 0;
+
     void initModels();
     void initLauncherTasksModel();
     void updateAnyTaskDemandsAttention();
     void updateManualSortMap();
+    void sortInManualSortMap();
     void consolidateManualSortMapForGroup(const QModelIndex &groupingProxyIndex);
     void updateGroupInline();
     QModelIndex preFilterIndex(const QModelIndex &sourceIndex) const;
@@ -214,16 +420,7 @@ void TasksModel::Private::initModels()
             return;
         }
 
-        const int delta = (end - start) + 1;
-        QMutableListIterator<int> it(sortedPreFilterRows);
-
-        while (it.hasNext()) {
-            it.next();
-
-            if (it.value() >= start) {
-                it.setValue(it.value() + delta);
-            }
-        }
+        sortedPreFilterRows.adjustRows(start, (end - start) + 1);
 
         for (int i = start; i <= end; ++i) {
             sortedPreFilterRows.append(i);
@@ -246,7 +443,7 @@ void TasksModel::Private::initModels()
         Q_UNUSED(end)
 
         if (sortMode == SortManual) {
-            updateManualSortMap();
+            sortInManualSortMap();
         }
     });
 
@@ -263,20 +460,7 @@ void TasksModel::Private::initModels()
             sortRowInsertQueueStale = false;
         }
 
-        for (int i = first; i <= last; ++i) {
-            sortedPreFilterRows.removeOne(i);
-        }
-
-        const int delta = (last - first) + 1;
-        QMutableListIterator<int> it(sortedPreFilterRows);
-
-        while (it.hasNext()) {
-            it.next();
-
-            if (it.value() > last) {
-                it.setValue(it.value() - delta);
-            }
-        }
+        sortedPreFilterRows.removeRows(first, last);
     });
 
     filterProxyModel = new TaskFilterProxyModel(q);
@@ -293,6 +477,10 @@ void TasksModel::Private::initModels()
 
     groupingProxyModel = new TaskGroupingProxyModel(q);
     groupingProxyModel->setSourceModel(filterProxyModel);
+    // Follow changes at the grouping proxy rather than at our source model:
+    // flattenGroupsProxyModel doesn't pass on which roles changed. Set up
+    // before either of them connects to groupingProxyModel.
+    gate.setModel(groupingProxyModel, q);
     QObject::connect(groupingProxyModel, &TaskGroupingProxyModel::groupModeChanged, q, &TasksModel::groupModeChanged);
     QObject::connect(groupingProxyModel, &TaskGroupingProxyModel::blacklistedAppIdsChanged, q, &TasksModel::groupingAppIdBlacklistChanged);
     QObject::connect(groupingProxyModel, &TaskGroupingProxyModel::blacklistedLauncherUrlsChanged, q, &TasksModel::groupingLauncherUrlBlacklistChanged);
@@ -520,7 +708,7 @@ void TasksModel::Private::updateManualSortMap()
 
         // Full sort.
         TasksModelLessThan lt(concatProxyModel, q, false);
-        std::stable_sort(sortedPreFilterRows.begin(), sortedPreFilterRows.end(), lt);
+        sortedPreFilterRows.sort(lt);
 
         // Consolidate sort map entries for groups.
         if (q->groupMode() != GroupDisabled) {
@@ -540,7 +728,7 @@ void TasksModel::Private::updateManualSortMap()
     if (separateLaunchers) {
         // Sort only launchers.
         TasksModelLessThan lt(concatProxyModel, q, true);
-        std::stable_sort(sortedPreFilterRows.begin(), sortedPreFilterRows.end(), lt);
+        sortedPreFilterRows.sort(lt);
         // Otherwise process any entries in the insert queue and move them intelligently
         // in the sort map.
     } else {
@@ -639,6 +827,24 @@ void TasksModel::Private::updateManualSortMap()
     }
 }
 
+void TasksModel::Private::sortInManualSortMap()
+{
+    // With launchers kept separate, rows only need sorting in relative to the
+    // launchers. As long as the map was in order before the rows were appended,
+    // binary insertion puts them where a full sort would.
+    // Launch-in-place sorts windows by the position of their launcher, which
+    // also shifts with launchers coming and going and with windows resolving
+    // their launcher later on; keep doing full sorts for that.
+    if (separateLaunchers && !launchInPlace && sortedPreFilterRows.sortedCount() > 0) {
+        TasksModelLessThan lt(concatProxyModel, q, true);
+        sortedPreFilterRows.sortIn(lt);
+
+        return;
+    }
+
+    updateManualSortMap();
+}
+
 void TasksModel::Private::consolidateManualSortMapForGroup(const QModelIndex &groupingProxyIndex)
 {
     // Consolidates sort map entries for a group's items to be contiguous
@@ -661,7 +867,10 @@ void TasksModel::Private::consolidateManualSortMapForGroup(const QModelIndex &gr
         const int leaderPos = sortedPreFilterRows.indexOf(preFilterLeader.row());
         const int childPos = sortedPreFilterRows.indexOf(preFilterChild.row());
         const int insertPos = (leaderPos + i) + ((leaderPos + i) > childPos ? -1 : 0);
-        sortedPreFilterRows.move(childPos, insertPos);
+        // Group members share the app, so among windows only ordered relative
+        // to launchers, moving them next to each other keeps that order unless
+        // launchers are sorted in with windows.
+        sortedPreFilterRows.move(childPos, insertPos, !launchInPlace);
     }
 }
 
@@ -692,6 +901,7 @@ void TasksModel::Private::updateGroupInline()
 
         abstractTasksSourceModel = flattenGroupsProxyModel;
         q->setSourceModel(flattenGroupsProxyModel);
+        gate.connectClose();
 
         if (sortMode == SortManual) {
             forceResort();
@@ -706,6 +916,7 @@ void TasksModel::Private::updateGroupInline()
 
         abstractTasksSourceModel = groupingProxyModel;
         q->setSourceModel(groupingProxyModel);
+        gate.connectClose();
 
         delete flattenGroupsProxyModel;
         flattenGroupsProxyModel = nullptr;
@@ -972,6 +1183,10 @@ TasksModel::TasksModel(QObject *parent)
 {
     d->initModels();
 
+    connect(this, &QAbstractItemModel::layoutAboutToBeChanged, this, [this]() {
+        ++d->resorts;
+    });
+
     // Start sorting.
     sort(0);
 
@@ -1740,12 +1955,9 @@ void TasksModel::syncLaunchers()
             // to persistent configuration storage, e.g. `preferred://browser`. We mean to compare
             // this last "save state" to a higher, resolved URL representation to compute the delta
             // so we need to move the unresolved URLs through `TaskTools::appDataFromUrl()` first.
-            // TODO: This bypasses an existing lookup cache for the resolved app data that exists
-            // in LauncherTasksModel. It's likely a good idea to eventually move these caches out
-            // of the various models and share them among users of `TaskTools::appDataFromUrl()`,
-            // and then also do resolution implicitly in `TaskTools::launcherUrlsMatch`, to speed
-            // things up slightly and make the models simpler (central cache eviction, ...).
-            if (launcherUrlsMatch(appDataFromUrl(launcherUrl).url, rowLauncherUrl, IgnoreQueryItems)) {
+            // The launchers are referenced by LauncherTasksModel, so this hits the shared cache.
+            // TODO: Do resolution implicitly in `TaskTools::launcherUrlsMatch`.
+            if (launcherUrlsMatch(CachedAppData(launcherUrl).data().url, rowLauncherUrl, IgnoreQueryItems)) {
                 row = i;
                 break;
             }
@@ -1854,6 +2066,11 @@ bool TasksModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent
 
     const QModelIndex &sourceIndex = sourceModel()->index(sourceRow, 0);
 
+    // Only roles we don't filter by changed; the row stays in or out.
+    if (d->gate.skipFilter(sourceIndex)) {
+        return mapFromSource(sourceIndex).isValid();
+    }
+
     // In inline grouping mode, filter out group parents.
     if (d->groupInline && d->flattenGroupsProxyModel && sourceIndex.data(AbstractTasksModel::IsGroupParent).toBool()) {
         return false;
@@ -1897,6 +2114,16 @@ bool TasksModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent
     return true;
 }
 
+QVariantMap DebugStatistics::of(const TasksModel *model)
+{
+    QVariantMap statistics = model->d->gate.statistics();
+    statistics.insert(QStringLiteral("resorts"), model->d->resorts);
+
+    return QVariantMap{{QStringLiteral("filter"), of(model->d->filterProxyModel)},
+                       {QStringLiteral("grouping"), of(model->d->groupingProxyModel)},
+                       {QStringLiteral("tasks"), statistics}};
+}
+
 bool TasksModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
     // In manual sort mode, sort by map.
@@ -891,6 +891,7 @@ private:
     class Private;
     class TasksModelLessThan;
     friend class TasksModelLessThan;
+    friend class DebugStatistics;
     QScopedPointer<Private> d;
 };
 
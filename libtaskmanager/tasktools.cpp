@@ -6,6 +6,8 @@
 
 #include "tasktools.h"
 #include "abstracttasksmodel.h"
+#include "serviceindex.h"
+#include "windowurlcache.h"
 
 #include <KActivities/ResourceInstance>
 #include <KApplicationTrader>
@@ -25,6 +27,7 @@
 #include <config-X11.h>
 
 #include <QDir>
+#include <QFileInfo>
 #include <QGuiApplication>
 #include <QRegularExpression>
 #include <QScreen>
@@ -193,12 +196,39 @@ AppData appDataFromAppId(const QString &appId)
     return data;
 }
 
-QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr rulesConfig, const QString &xWindowsWMClassName)
+static QString bamfDesktopFileHint(quint32 pid)
 {
-    if (!rulesConfig) {
-        return QUrl();
+    QFile environFile(QStringLiteral("/proc/%1/environ").arg(QString::number(pid)));
+    if (!environFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
     }
 
+    const QByteArray bamfDesktopFileHint = QByteArrayLiteral("BAMF_DESKTOP_FILE_HINT");
+
+    const auto lines = environFile.readAll().split('\0');
+    for (const QByteArray &line : lines) {
+        const int equalsIdx = line.indexOf('=');
+        if (equalsIdx <= 0) {
+            continue;
+        }
+
+        if (line.left(equalsIdx) == bamfDesktopFileHint) {
+            return QString::fromUtf8(line.mid(equalsIdx + 1));
+        }
+    }
+
+    return QString();
+}
+
+// What servicesFromPid() looks at of the process
+static void addProcessToKey(WindowUrlCache::Key &key, quint32 pid)
+{
+    key.desktopFileHint = bamfDesktopFileHint(pid);
+    key.commandLineDigest = WindowUrlCache::commandLineDigest(KProcessList::processInfo(pid).command());
+}
+
+static QUrl resolveWindowUrl(const QString &appId, quint32 pid, KSharedConfig::Ptr rulesConfig, const QString &xWindowsWMClassName, bool *usedProcess)
+{
     QUrl url;
     KService::List services;
     bool triedPid = false;
@@ -220,7 +250,7 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
     // of wine-Programs-Steam-Steam.desktop. The weighing done by this function makes
     // sure the Linux native version gets mapped to the former, while other heuristics
     // map the Wine version reliably to the latter.
-    // In lieu of this weighing we just used whatever KServiceTypeTrader returned first,
+    // In lieu of this weighing we just used whatever the service lookup returned first,
     // so what we do here can be no worse.
     auto sortServicesByMenuId = [](KService::List &services, const QString &key) {
         if (services.count() == 1) {
@@ -246,12 +276,14 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
 
         if (!appId.isEmpty() && matchCommandLineFirst.contains(appId)) {
             triedPid = true;
+            *usedProcess = (pid != 0);
             services = servicesFromPid(pid, rulesConfig);
         }
 
         // Try to match using xWindowsWMClassName also.
         if (!xWindowsWMClassName.isEmpty() && matchCommandLineFirst.contains("::" + xWindowsWMClassName)) {
             triedPid = true;
+            *usedProcess = (pid != 0);
             services = servicesFromPid(pid, rulesConfig);
         }
 
@@ -293,14 +325,12 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
             //
             // Source: https://specifications.freedesktop.org/startup-notification-spec/startup-notification-0.1.txt
             if (services.isEmpty()) {
-                services =
-                    KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ StartupWMClass)").arg(appId));
+                services = ServiceIndex::self()->services(ServiceIndex::StartupWMClass, appId);
                 sortServicesByMenuId(services, appId);
             }
 
             if (services.isEmpty() && !xWindowsWMClassName.isEmpty()) {
-                services = KServiceTypeTrader::self()->query(QStringLiteral("Application"),
-                                                             QStringLiteral("exist Exec and ('%1' =~ StartupWMClass)").arg(xWindowsWMClassName));
+                services = ServiceIndex::self()->services(ServiceIndex::StartupWMClass, xWindowsWMClassName);
                 sortServicesByMenuId(services, xWindowsWMClassName);
             }
 
@@ -347,9 +377,15 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
                                 rewrittenString = matchProperty;
                             }
 
-                            services =
-                                KServiceTypeTrader::self()->query(QStringLiteral("Application"),
-                                                                  QStringLiteral("exist Exec and ('%1' =~ %2)").arg(rewrittenString, serviceSearchIdentifier));
+                            ServiceIndex::Property property;
+
+                            if (ServiceIndex::propertyFromName(serviceSearchIdentifier, &property)) {
+                                services = ServiceIndex::self()->services(property, rewrittenString);
+                            } else {
+                                services = KServiceTypeTrader::self()->query(
+                                    QStringLiteral("Application"),
+                                    QStringLiteral("exist Exec and ('%1' =~ %2)").arg(rewrittenString, serviceSearchIdentifier));
+                            }
                             sortServicesByMenuId(services, serviceSearchIdentifier);
 
                             if (!services.isEmpty()) {
@@ -377,34 +413,26 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
 
             // Try matching mapped name against DesktopEntryName.
             if (!mapped.isEmpty() && services.isEmpty()) {
-                services = KServiceTypeTrader::self()->query(
-                    QStringLiteral("Application"),
-                    QStringLiteral("exist Exec and ('%1' =~ DesktopEntryName) and (not exist NoDisplay or not NoDisplay)").arg(mapped));
+                services = ServiceIndex::self()->services(ServiceIndex::DesktopEntryName, mapped, ServiceIndex::DisplayedServices);
                 sortServicesByMenuId(services, mapped);
             }
 
             // Try matching mapped name against 'Name'.
             if (!mapped.isEmpty() && services.isEmpty()) {
-                services =
-                    KServiceTypeTrader::self()->query(QStringLiteral("Application"),
-                                                      QStringLiteral("exist Exec and ('%1' =~ Name) and (not exist NoDisplay or not NoDisplay)").arg(mapped));
+                services = ServiceIndex::self()->services(ServiceIndex::Name, mapped, ServiceIndex::DisplayedServices);
                 sortServicesByMenuId(services, mapped);
             }
 
             // Try matching appId against DesktopEntryName.
             if (services.isEmpty()) {
-                services = KServiceTypeTrader::self()->query(
-                    QStringLiteral("Application"),
-                    QStringLiteral("exist Exec and ('%1' =~ DesktopEntryName) and (not exist NoDisplay or not NoDisplay)").arg(appId));
+                services = ServiceIndex::self()->services(ServiceIndex::DesktopEntryName, appId, ServiceIndex::DisplayedServices);
                 sortServicesByMenuId(services, appId);
             }
 
             // Try matching appId against 'Name'.
             // This has a shaky chance of success as appId is untranslated, but 'Name' may be localized.
             if (services.isEmpty()) {
-                services =
-                    KServiceTypeTrader::self()->query(QStringLiteral("Application"),
-                                                      QStringLiteral("exist Exec and ('%1' =~ Name) and (not exist NoDisplay or not NoDisplay)").arg(appId));
+                services = ServiceIndex::self()->services(ServiceIndex::Name, appId, ServiceIndex::DisplayedServices);
                 sortServicesByMenuId(services, appId);
             }
 
@@ -428,6 +456,7 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
 
         // Ok, absolute *last* chance, try matching via pid (but only if we have not already tried this!) ...
         if (services.isEmpty() && !triedPid) {
+            *usedProcess = (pid != 0);
             services = servicesFromPid(pid, rulesConfig);
         }
     }
@@ -446,15 +475,7 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
     // - appId also cannot match the binary because of name mismatch
     // - in the following code *.appId can match org.kde.dragonplayer though
     if (services.isEmpty() || services.at(0)->desktopEntryName().isEmpty()) {
-        auto matchingServices =
-            KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' ~~ DesktopEntryName)").arg(appId));
-        QMutableListIterator<KService::Ptr> it(matchingServices);
-        while (it.hasNext()) {
-            auto service = it.next();
-            if (!service->desktopEntryName().endsWith("." + appId)) {
-                it.remove();
-            }
-        }
+        const auto matchingServices = ServiceIndex::self()->servicesByDesktopEntrySuffix(appId);
         // Exactly one match is expected, otherwise we discard the results as to reduce
         // the likelihood of false-positive mappings. Since we essentially eliminate the
         // uniqueness that RDN is meant to bring to the table we could potentially end
@@ -491,6 +512,53 @@ QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr
     return url;
 }
 
+QUrl windowUrlFromMetadata(const QString &appId, quint32 pid, KSharedConfig::Ptr rulesConfig, const QString &xWindowsWMClassName)
+{
+    if (!rulesConfig) {
+        return QUrl();
+    }
+
+    // Resolving the metadata is a cascade of trader queries and possibly a look at
+    // the process, so keep what it came up with, across restarts as well. The
+    // executable is part of the key as programs running through the same runtime
+    // or wrapper can share their window metadata.
+    WindowUrlCache::Key key{appId, xWindowsWMClassName, QString(), QString(), QByteArray()};
+
+    if (pid != 0) {
+        key.executable = QFileInfo(QStringLiteral("/proc/%1/exe").arg(QString::number(pid))).symLinkTarget();
+    }
+
+    QUrl url;
+    bool byCommandLine = false;
+
+    if (WindowUrlCache::self()->find(key, &url, &byCommandLine)) {
+        if (!byCommandLine) {
+            return url;
+        }
+
+        addProcessToKey(key, pid);
+
+        if (WindowUrlCache::self()->find(key, &url, &byCommandLine)) {
+            return url;
+        }
+    }
+
+    bool usedProcess = false;
+    url = resolveWindowUrl(appId, pid, rulesConfig, xWindowsWMClassName, &usedProcess);
+
+    if (usedProcess) {
+        WindowUrlCache::self()->insertByCommandLine(key);
+
+        if (key.commandLineDigest.isEmpty()) {
+            addProcessToKey(key, pid);
+        }
+    }
+
+    WindowUrlCache::self()->insert(key, url);
+
+    return url;
+}
+
 KService::List servicesFromPid(quint32 pid, KSharedConfig::Ptr rulesConfig)
 {
     if (pid == 0) {
@@ -502,27 +570,11 @@ KService::List servicesFromPid(quint32 pid, KSharedConfig::Ptr rulesConfig)
     }
 
     // Read the BAMF_DESKTOP_FILE_HINT environment variable which contains the actual desktop file path for Snaps.
-    QFile environFile(QStringLiteral("/proc/%1/environ").arg(QString::number(pid)));
-    if (environFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        const QByteArray bamfDesktopFileHint = QByteArrayLiteral("BAMF_DESKTOP_FILE_HINT");
-
-        const auto lines = environFile.readAll().split('\0');
-        for (const QByteArray &line : lines) {
-            const int equalsIdx = line.indexOf('=');
-            if (equalsIdx <= 0) {
-                continue;
-            }
-
-            const QByteArray key = line.left(equalsIdx);
-            if (key == bamfDesktopFileHint) {
-                const QByteArray value = line.mid(equalsIdx + 1);
-
-                KService::Ptr service = KService::serviceByDesktopPath(QString::fromUtf8(value));
-                if (service) {
-                    return {service};
-                }
-                break;
-            }
+    const QString desktopFileHint = bamfDesktopFileHint(pid);
+    if (!desktopFileHint.isEmpty()) {
+        KService::Ptr service = KService::serviceByDesktopPath(desktopFileHint);
+        if (service) {
+            return {service};
         }
     }
 
@@ -552,15 +604,14 @@ KService::List servicesFromCmdLine(const QString &_cmdLine, const QString &proce
     const int firstSpace = cmdLine.indexOf(' ');
     int slash = 0;
 
-    services = KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ Exec)").arg(cmdLine));
+    services = ServiceIndex::self()->services(ServiceIndex::Exec, cmdLine);
 
     if (services.isEmpty()) {
         // Could not find with complete command line, so strip out the path part ...
         slash = cmdLine.lastIndexOf('/', firstSpace);
 
         if (slash > 0) {
-            services =
-                KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ Exec)").arg(cmdLine.mid(slash + 1)));
+            services = ServiceIndex::self()->services(ServiceIndex::Exec, cmdLine.mid(slash + 1));
         }
     }
 
@@ -568,14 +619,13 @@ KService::List servicesFromCmdLine(const QString &_cmdLine, const QString &proce
         // Could not find with arguments, so try without ...
         cmdLine.truncate(firstSpace);
 
-        services = KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ Exec)").arg(cmdLine));
+        services = ServiceIndex::self()->services(ServiceIndex::Exec, cmdLine);
 
         if (services.isEmpty()) {
             slash = cmdLine.lastIndexOf('/');
 
             if (slash > 0) {
-                services = KServiceTypeTrader::self()->query(QStringLiteral("Application"),
-                                                             QStringLiteral("exist Exec and ('%1' =~ Exec)").arg(cmdLine.mid(slash + 1)));
+                services = ServiceIndex::self()->services(ServiceIndex::Exec, cmdLine.mid(slash + 1));
             }
         }
     }
@@ -5,6 +5,7 @@
 */
 
 #include "waylandtasksmodel.h"
+#include "cachedappdata.h"
 #include "tasktools.h"
 #include "virtualdesktopinfo.h"
 
@@ -21,6 +22,7 @@
 #include <QQuickItem>
 #include <QQuickWindow>
 #include <QSet>
+#include <QTimer>
 #include <QUrl>
 #include <QUuid>
 #include <QWindow>
@@ -32,8 +34,13 @@ class Q_DECL_HIDDEN WaylandTasksModel::Private
 public:
     Private(WaylandTasksModel *q);
     QList<KWayland::Client::PlasmaWindow *> windows;
-    QHash<KWayland::Client::PlasmaWindow *, AppData> appDataCache;
+    QList<KWayland::Client::PlasmaWindow *> pendingWindows;
+    QTimer pendingWindowsTimer;
+    QHash<KWayland::Client::PlasmaWindow *, CachedAppData> appDataCache;
+    QSet<KWayland::Client::PlasmaWindow *> usingWindowIcon;
     QHash<KWayland::Client::PlasmaWindow *, QTime> lastActivated;
+    // key=window uuid, value=position in the stacking order
+    QHash<QByteArray, int> stackingOrder;
     KWayland::Client::PlasmaWindowManagement *windowManagement = nullptr;
     KSharedConfig::Ptr rulesConfig;
     KDirWatch *configWatcher = nullptr;
@@ -43,6 +50,8 @@ public:
     void init();
     void initWayland();
     void addWindow(KWayland::Client::PlasmaWindow *window);
+    void insertPendingWindows();
+    void updateStackingOrder();
 
     AppData appData(KWayland::Client::PlasmaWindow *window);
 
@@ -73,6 +82,7 @@ void WaylandTasksModel::Private::init()
         }
 
         appDataCache.clear();
+        usingWindowIcon.clear();
 
         // Emit changes of all roles satisfied from app data cache.
         Q_EMIT q->dataChanged(q->index(0, 0),
@@ -104,6 +114,14 @@ void WaylandTasksModel::Private::init()
 
     virtualDesktopInfo = new VirtualDesktopInfo(q);
 
+    // Insert the windows announced in this event loop cycle as one range.
+    pendingWindowsTimer.setSingleShot(true);
+    pendingWindowsTimer.setInterval(0);
+
+    QObject::connect(&pendingWindowsTimer, &QTimer::timeout, q, [this]() {
+        insertPendingWindows();
+    });
+
     initWayland();
 }
 
@@ -128,6 +146,8 @@ void WaylandTasksModel::Private::initWayland()
         QObject::connect(windowManagement, &KWayland::Client::PlasmaWindowManagement::interfaceAboutToBeReleased, q, [this] {
             q->beginResetModel();
             windows.clear();
+            pendingWindows.clear();
+            stackingOrder.clear();
             q->endResetModel();
         });
 
@@ -136,15 +156,17 @@ void WaylandTasksModel::Private::initWayland()
         });
 
         QObject::connect(windowManagement, &KWayland::Client::PlasmaWindowManagement::stackingOrderUuidsChanged, q, [this]() {
-            for (const auto window : qAsConst(windows)) {
-                this->dataChanged(window, StackingOrder);
-            }
+            updateStackingOrder();
         });
 
+        updateStackingOrder();
+
         const auto windows = windowManagement->windows();
         for (auto it = windows.constBegin(); it != windows.constEnd(); ++it) {
             addWindow(*it);
         }
+
+        insertPendingWindows();
     });
 
     registry->setup();
@@ -152,25 +174,32 @@ void WaylandTasksModel::Private::initWayland()
 
 void WaylandTasksModel::Private::addWindow(KWayland::Client::PlasmaWindow *window)
 {
-    if (windows.indexOf(window) != -1) {
+    if (windows.indexOf(window) != -1 || pendingWindows.contains(window)) {
         return;
     }
 
-    const int count = windows.count();
-
-    q->beginInsertRows(QModelIndex(), count, count);
+    // App data is only resolved once a role needing it is asked for.
+    pendingWindows.append(window);
+    pendingWindowsTimer.start();
 
-    windows.append(window);
+    auto removeWindow = [window, this] {
+        // Pending windows may have been activated or had their app data asked for already.
+        const auto forgetWindow = [window, this] {
+            appDataCache.remove(window);
+            usingWindowIcon.remove(window);
+            lastActivated.remove(window);
+        };
 
-    q->endInsertRows();
+        if (pendingWindows.removeOne(window)) {
+            forgetWindow();
+            return;
+        }
 
-    auto removeWindow = [window, this] {
         const int row = windows.indexOf(window);
         if (row != -1) {
             q->beginRemoveRows(QModelIndex(), row, row);
             windows.removeAt(row);
-            appDataCache.remove(window);
-            lastActivated.remove(window);
+            forgetWindow();
             q->endRemoveRows();
         }
     };
@@ -184,11 +213,13 @@ void WaylandTasksModel::Private::addWindow(KWayland::Client::PlasmaWindow *windo
 
     QObject::connect(window, &KWayland::Client::PlasmaWindow::iconChanged, q, [window, this] {
         // The icon in the AppData struct might come from PlasmaWindow if it wasn't
-        // filled in by windowUrlFromMetadata+appDataFromUrl.
-        // TODO: Don't evict the cache unnecessarily if this isn't the case. As icons
-        // are currently very static on Wayland, this eviction is unlikely to happen
-        // frequently as of now.
-        appDataCache.remove(window);
+        // filled in by windowUrlFromMetadata+appDataFromUrl. Only that icon needs
+        // to be fetched again, once asked for.
+        if (!usingWindowIcon.remove(window)) {
+            return;
+        }
+
+        appDataCache[window].data().icon = QIcon();
 
         this->dataChanged(window, Qt::DecorationRole);
     });
@@ -198,6 +229,7 @@ void WaylandTasksModel::Private::addWindow(KWayland::Client::PlasmaWindow *windo
         // to be evicted in favor of a fresh struct based on the changed
         // window metadata.
         appDataCache.remove(window);
+        usingWindowIcon.remove(window);
 
         // Refresh roles satisfied from the app data cache.
         this->dataChanged(window, QVector<int>{AppId, AppName, GenericName, LauncherUrl, LauncherUrlWithoutIcon, SkipTaskbar});
@@ -308,19 +340,37 @@ void WaylandTasksModel::Private::addWindow(KWayland::Client::PlasmaWindow *windo
     });
 }
 
+void WaylandTasksModel::Private::insertPendingWindows()
+{
+    pendingWindowsTimer.stop();
+
+    if (pendingWindows.isEmpty()) {
+        return;
+    }
+
+    const int count = windows.count();
+
+    q->beginInsertRows(QModelIndex(), count, count + pendingWindows.count() - 1);
+
+    windows.append(pendingWindows);
+    pendingWindows.clear();
+
+    q->endInsertRows();
+}
+
 AppData WaylandTasksModel::Private::appData(KWayland::Client::PlasmaWindow *window)
 {
     const auto &it = appDataCache.constFind(window);
 
     if (it != appDataCache.constEnd()) {
-        return *it;
+        return it->data();
     }
 
-    const AppData &data = appDataFromUrl(windowUrlFromMetadata(window->appId(), window->pid(), rulesConfig));
+    const CachedAppData data(windowUrlFromMetadata(window->appId(), window->pid(), rulesConfig));
 
     appDataCache.insert(window, data);
 
-    return data;
+    return data.data();
 }
 
 QIcon WaylandTasksModel::Private::icon(KWayland::Client::PlasmaWindow *window)
@@ -331,9 +381,12 @@ QIcon WaylandTasksModel::Private::icon(KWayland::Client::PlasmaWindow *window)
         return app.icon;
     }
 
-    appDataCache[window].icon = window->icon();
+    const QIcon &icon = window->icon();
+
+    appDataCache[window].data().icon = icon;
+    usingWindowIcon.insert(window);
 
-    return window->icon();
+    return icon;
 }
 
 QString WaylandTasksModel::Private::mimeType()
@@ -350,15 +403,39 @@ QString WaylandTasksModel::Private::groupMimeType()
     return QStringLiteral("windowsystem/multiple-winids+") + uuid.toString();
 }
 
+void WaylandTasksModel::Private::updateStackingOrder()
+{
+    const QVector<QByteArray> &order = windowManagement->stackingOrderUuids();
+
+    QHash<QByteArray, int> oldStackingOrder;
+    oldStackingOrder.swap(stackingOrder);
+    stackingOrder.reserve(order.count());
+
+    for (int i = 0; i < order.count(); ++i) {
+        stackingOrder.insert(order.at(i), i);
+    }
+
+    q->stackingOrderChanged([this, &oldStackingOrder](int row) {
+        const QByteArray &uuid = windows.at(row)->uuid();
+        return oldStackingOrder.value(uuid, -1) != stackingOrder.value(uuid, -1);
+    });
+}
+
 void WaylandTasksModel::Private::dataChanged(KWayland::Client::PlasmaWindow *window, int role)
 {
-    QModelIndex idx = q->index(windows.indexOf(window));
-    emit q->dataChanged(idx, idx, QVector<int>{role});
+    dataChanged(window, QVector<int>{role});
 }
 
 void WaylandTasksModel::Private::dataChanged(KWayland::Client::PlasmaWindow *window, const QVector<int> &roles)
 {
-    QModelIndex idx = q->index(windows.indexOf(window));
+    const int row = windows.indexOf(window);
+
+    // Still pending, it will show up with all its data once it's added
+    if (row == -1) {
+        return;
+    }
+
+    QModelIndex idx = q->index(row);
     emit q->dataChanged(idx, idx, roles);
 }
 
@@ -455,7 +532,7 @@ QVariant WaylandTasksModel::data(const QModelIndex &index, int role) const
     } else if (role == AppPid) {
         return window->pid();
     } else if (role == StackingOrder) {
-        return d->windowManagement->stackingOrderUuids().indexOf(window->uuid());
+        return d->stackingOrder.value(window->uuid(), -1);
     } else if (role == LastActivated) {
         if (d->lastActivated.contains(window)) {
             return d->lastActivated.value(window);
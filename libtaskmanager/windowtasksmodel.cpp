@@ -5,6 +5,7 @@
 */
 
 #include "windowtasksmodel.h"
+#include "windowtasksmodel_p.h"
 
 #include <config-X11.h>
 
@@ -17,13 +18,15 @@
 
 namespace TaskManager
 {
+static int instanceCount = 0;
+static AbstractTasksModel *sourceTasksModelOverride = nullptr;
+
 class Q_DECL_HIDDEN WindowTasksModel::Private
 {
 public:
     Private(WindowTasksModel *q);
     ~Private();
 
-    static int instanceCount;
     static AbstractTasksModel *sourceTasksModel;
 
     void initSourceTasksModel();
@@ -32,7 +35,6 @@ private:
     WindowTasksModel *q;
 };
 
-int WindowTasksModel::Private::instanceCount = 0;
 AbstractTasksModel *WindowTasksModel::Private::sourceTasksModel = nullptr;
 
 WindowTasksModel::Private::Private(WindowTasksModel *q)
@@ -46,13 +48,19 @@ WindowTasksModel::Private::~Private()
     --instanceCount;
 
     if (!instanceCount) {
-        delete sourceTasksModel;
+        if (sourceTasksModel != sourceTasksModelOverride) {
+            delete sourceTasksModel;
+        }
         sourceTasksModel = nullptr;
     }
 }
 
 void WindowTasksModel::Private::initSourceTasksModel()
 {
+    if (!sourceTasksModel && sourceTasksModelOverride) {
+        sourceTasksModel = sourceTasksModelOverride;
+    }
+
     if (!sourceTasksModel && KWindowSystem::isPlatformWayland()) {
         sourceTasksModel = new WaylandTasksModel();
     }
@@ -86,6 +94,13 @@ QHash<int, QByteArray> WindowTasksModel::roleNames() const
     return QHash<int, QByteArray>();
 }
 
+void setWindowTasksModelSourceOverride(AbstractTasksModel *model)
+{
+    Q_ASSERT(!instanceCount);
+
+    sourceTasksModelOverride = model;
+}
+
 QModelIndex WindowTasksModel::mapIfaceToSource(const QModelIndex &index) const
 {
     return mapToSource(index);
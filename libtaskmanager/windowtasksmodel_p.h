@@ -0,0 +1,28 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include "taskmanager_export.h"
+
+namespace TaskManager
+{
+class AbstractTasksModel;
+
+/**
+ * Makes all WindowTasksModel instances present the tasks of the given
+ * model instead of those of the windowing system. The model is not
+ * owned and has to outlive all instances. This has to be called before
+ * the first instance is created.
+ *
+ * This is meant for autotests and benchmarks, which need to run without
+ * an X or Wayland server.
+ *
+ * @param model A window tasks model, or nullptr to use the windowing system.
+ **/
+TASKMANAGER_EXPORT void setWindowTasksModelSourceOverride(AbstractTasksModel *model);
+
+}
@@ -0,0 +1,222 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "windowurlcache.h"
+
+#include <KSycoca>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace TaskManager
+{
+// 2: command lines are stored as digests
+static const quint32 s_cacheVersion = 2;
+// Command lines with file arguments make for plenty of one-off entries; don't let them pile up.
+static const int s_maxEntries = 2000;
+
+Q_GLOBAL_STATIC(WindowUrlCache, s_windowUrlCache)
+
+WindowUrlCache *WindowUrlCache::self()
+{
+    return s_windowUrlCache();
+}
+
+QByteArray WindowUrlCache::commandLineDigest(const QString &commandLine)
+{
+    return QCryptographicHash::hash(commandLine.toUtf8(), QCryptographicHash::Sha256);
+}
+
+WindowUrlCache::WindowUrlCache()
+    : QObject()
+{
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(2000);
+
+    connect(&m_saveTimer, &QTimer::timeout, this, &WindowUrlCache::save);
+
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, [this] {
+            if (m_saveTimer.isActive()) {
+                m_saveTimer.stop();
+                save();
+            }
+        });
+    }
+
+    void (KSycoca::*myDatabaseChangeSignal)(const QStringList &) = &KSycoca::databaseChanged;
+    connect(KSycoca::self(), myDatabaseChangeSignal, this, [this](const QStringList &changedResources) {
+        if (changedResources.contains(QLatin1String("services")) || changedResources.contains(QLatin1String("apps"))
+            || changedResources.contains(QLatin1String("xdgdata-apps"))) {
+            invalidate();
+        }
+    });
+
+    load();
+}
+
+WindowUrlCache::~WindowUrlCache() = default;
+
+bool WindowUrlCache::find(const Key &key, QUrl *url, bool *byCommandLine)
+{
+    checkGeneration();
+
+    const QString &string = keyString(key);
+
+    if (m_byCommandLine.contains(string)) {
+        *byCommandLine = true;
+        return true;
+    }
+
+    const auto it = m_urls.constFind(string);
+
+    if (it == m_urls.constEnd()) {
+        return false;
+    }
+
+    *url = *it;
+    *byCommandLine = false;
+
+    return true;
+}
+
+void WindowUrlCache::insert(const Key &key, const QUrl &url)
+{
+    if (m_urls.count() + m_byCommandLine.count() >= s_maxEntries) {
+        m_urls.clear();
+        m_byCommandLine.clear();
+    }
+
+    m_urls.insert(keyString(key), url);
+    m_saveTimer.start();
+}
+
+void WindowUrlCache::insertByCommandLine(const Key &key)
+{
+    Key plainKey = key;
+    plainKey.desktopFileHint.clear();
+    plainKey.commandLineDigest.clear();
+
+    m_byCommandLine.insert(keyString(plainKey));
+    m_saveTimer.start();
+}
+
+void WindowUrlCache::invalidate()
+{
+    m_generation = currentGeneration();
+    m_urls.clear();
+    m_byCommandLine.clear();
+    m_saveTimer.start();
+}
+
+QString WindowUrlCache::keyString(const Key &key)
+{
+    return key.appId + QChar(0x1f) + key.wmClass + QChar(0x1f) + key.executable + QChar(0x1f) + key.desktopFileHint + QChar(0x1f)
+        + QString::fromLatin1(key.commandLineDigest.toHex());
+}
+
+QString WindowUrlCache::fileName()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QLatin1String("/libtaskmanager/windowurls");
+}
+
+QString WindowUrlCache::currentGeneration()
+{
+    QStringList generation;
+
+    const QFileInfo sycoca(KSycoca::absoluteFilePath());
+    generation << QString::number(sycoca.lastModified().toMSecsSinceEpoch());
+
+    const auto locations = QStandardPaths::standardLocations(QStandardPaths::ConfigLocation);
+
+    for (const QString &location : locations) {
+        const QFileInfo rules(location + QLatin1String("/taskmanagerrulesrc"));
+
+        if (rules.exists()) {
+            generation << rules.filePath() << QString::number(rules.lastModified().toMSecsSinceEpoch());
+        }
+    }
+
+    return generation.join(QLatin1Char(':'));
+}
+
+void WindowUrlCache::checkGeneration()
+{
+    // The sycoca database may have been rebuilt without us having been told yet.
+    if (m_generation != currentGeneration()) {
+        invalidate();
+    }
+}
+
+void WindowUrlCache::load()
+{
+    m_generation = currentGeneration();
+
+    QFile file(fileName());
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    quint32 version = 0;
+    QString generation;
+    stream >> version >> generation;
+
+    if (version != s_cacheVersion) {
+        // Older versions stored command lines as they were
+        file.close();
+        file.remove();
+        return;
+    }
+
+    if (generation != m_generation) {
+        return;
+    }
+
+    QHash<QString, QUrl> urls;
+    QSet<QString> byCommandLine;
+    stream >> urls >> byCommandLine;
+
+    if (stream.status() == QDataStream::Ok) {
+        m_urls = urls;
+        m_byCommandLine = byCommandLine;
+    }
+}
+
+void WindowUrlCache::save()
+{
+    const QString &path = fileName();
+
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write window URL cache:" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << s_cacheVersion << m_generation << m_urls << m_byCommandLine;
+
+    if (!file.commit()) {
+        qWarning() << "Could not write window URL cache:" << file.errorString();
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
+
+namespace TaskManager
+{
+/*
+ * Persistent cache of what windowUrlFromMetadata() resolved window metadata to.
+ *
+ * Entries are keyed on the app id, the WM_CLASS name and the executable of the
+ * window's process. Results which depended on inspecting the process (command
+ * line matching, BAMF_DESKTOP_FILE_HINT) are only valid for the command line
+ * and environment they were found for, so the plain key merely records that
+ * those need to be part of it. Command lines may hold anything from file names
+ * to passwords, so only a digest of them is kept.
+ *
+ * The cache is dropped whenever the sycoca database or the task manager rules
+ * change, and saved to disk shortly after it was changed.
+ */
+class WindowUrlCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Key {
+        QString appId;
+        QString wmClass;
+        QString executable;
+        QString desktopFileHint; /**< BAMF_DESKTOP_FILE_HINT of the process */
+        QByteArray commandLineDigest; /**< See commandLineDigest() */
+    };
+
+    static WindowUrlCache *self();
+
+    static QByteArray commandLineDigest(const QString &commandLine);
+
+    /**
+     * @param url receives the cached URL
+     * @param byCommandLine set if the entry is only valid with Key::commandLine filled in
+     * @return false if there is no entry for @p key
+     */
+    bool find(const Key &key, QUrl *url, bool *byCommandLine);
+    void insert(const Key &key, const QUrl &url);
+    /**
+     * Records that results for @p key depend on the command line and environment of the process.
+     */
+    void insertByCommandLine(const Key &key);
+
+    /**
+     * Drops all entries, e.g. because the rules config changed.
+     */
+    void invalidate();
+
+    WindowUrlCache();
+    ~WindowUrlCache() override;
+
+private:
+    static QString keyString(const Key &key);
+    static QString fileName();
+    /**
+     * Identifies the sycoca database and rules config the entries were resolved against
+     */
+    static QString currentGeneration();
+
+    void checkGeneration();
+    void load();
+    void save();
+
+    QString m_generation;
+    QHash<QString, QUrl> m_urls;
+    QSet<QString> m_byCommandLine;
+    QTimer m_saveTimer;
+};
+
+}
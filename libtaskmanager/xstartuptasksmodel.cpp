@@ -5,12 +5,12 @@
 */
 
 #include "xstartuptasksmodel.h"
+#include "serviceindex.h"
 
 #include <KConfig>
 #include <KConfigGroup>
 #include <KDirWatch>
 #include <KService>
-#include <KServiceTypeTrader>
 #include <KStartupInfo>
 
 #include <QIcon>
@@ -159,7 +159,7 @@ QUrl XStartupTasksModel::Private::launcherUrl(const KStartupInfoData &data)
             // turn into KService desktop entry name
             appId.chop(strlen(".desktop"));
 
-            services = KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ DesktopEntryName)").arg(appId));
+            services = ServiceIndex::self()->services(ServiceIndex::DesktopEntryName, appId);
         }
     }
 
@@ -167,14 +167,14 @@ QUrl XStartupTasksModel::Private::launcherUrl(const KStartupInfoData &data)
 
     // Try StartupWMClass.
     if (services.empty() && !wmClass.isEmpty()) {
-        services = KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ StartupWMClass)").arg(wmClass));
+        services = ServiceIndex::self()->services(ServiceIndex::StartupWMClass, wmClass);
     }
 
     const QString name = data.findName();
 
     // Try via name ...
     if (services.empty() && !name.isEmpty()) {
-        services = KServiceTypeTrader::self()->query(QStringLiteral("Application"), QStringLiteral("exist Exec and ('%1' =~ Name)").arg(name));
+        services = ServiceIndex::self()->services(ServiceIndex::Name, name);
     }
 
     if (!services.empty()) {
@@ -0,0 +1,185 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "xwindowpropertyfetcher.h"
+
+#include <QScopedPointer>
+#include <QX11Info>
+
+#include <algorithm>
+#include <cstring>
+
+namespace TaskManager
+{
+// Enough for any sane number of window types or states.
+static const uint32_t s_maxAtoms = 32;
+
+XWindowPropertyFetcher::XWindowPropertyFetcher()
+    : m_connection(QX11Info::connection())
+{
+    static const char *const names[AtomCount] = {
+        "_NET_WM_WINDOW_TYPE",
+        "_NET_WM_STATE",
+        "_NET_WM_STATE_DEMANDS_ATTENTION",
+        "_NET_WM_WINDOW_TYPE_NORMAL",
+        "_NET_WM_WINDOW_TYPE_DIALOG",
+        "_NET_WM_WINDOW_TYPE_UTILITY",
+        "_KDE_NET_WM_WINDOW_TYPE_OVERRIDE",
+        "_NET_WM_WINDOW_TYPE_DESKTOP",
+        "_NET_WM_WINDOW_TYPE_DOCK",
+        "_NET_WM_WINDOW_TYPE_TOOLBAR",
+        "_NET_WM_WINDOW_TYPE_MENU",
+        "_KDE_NET_WM_WINDOW_TYPE_TOPMENU",
+        "_NET_WM_WINDOW_TYPE_SPLASH",
+    };
+
+    xcb_intern_atom_cookie_t cookies[AtomCount];
+
+    for (int i = 0; i < AtomCount; ++i) {
+        cookies[i] = xcb_intern_atom(m_connection, false, strlen(names[i]), names[i]);
+    }
+
+    for (int i = 0; i < AtomCount; ++i) {
+        QScopedPointer<xcb_intern_atom_reply_t, QScopedPointerPodDeleter> reply(xcb_intern_atom_reply(m_connection, cookies[i], nullptr));
+        m_atoms[i] = reply ? reply->atom : XCB_ATOM_NONE;
+    }
+}
+
+XWindowPropertyFetcher::~XWindowPropertyFetcher()
+{
+    for (const Cookies &cookies : qAsConst(m_cookies)) {
+        discard(cookies);
+    }
+}
+
+void XWindowPropertyFetcher::request(WId window)
+{
+    auto it = m_cookies.find(window);
+
+    if (it != m_cookies.end()) {
+        discard(*it);
+    } else {
+        it = m_cookies.insert(window, Cookies());
+        m_order.append(window);
+    }
+
+    it->windowType = xcb_get_property(m_connection, false, window, m_atoms[WindowType], XCB_ATOM_ATOM, 0, s_maxAtoms);
+    it->state = xcb_get_property(m_connection, false, window, m_atoms[State], XCB_ATOM_ATOM, 0, s_maxAtoms);
+    it->transientFor = xcb_get_property(m_connection, false, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+
+    xcb_flush(m_connection);
+}
+
+void XWindowPropertyFetcher::cancel(WId window)
+{
+    const auto it = m_cookies.constFind(window);
+
+    if (it == m_cookies.constEnd()) {
+        return;
+    }
+
+    discard(*it);
+    m_cookies.erase(it);
+    m_order.removeOne(window);
+}
+
+bool XWindowPropertyFetcher::isPending(WId window) const
+{
+    return m_cookies.contains(window);
+}
+
+bool XWindowPropertyFetcher::isEmpty() const
+{
+    return m_cookies.isEmpty();
+}
+
+QVector<std::pair<WId, XWindowPropertyFetcher::Properties>> XWindowPropertyFetcher::takeReplies()
+{
+    QVector<std::pair<WId, Properties>> replies;
+    replies.reserve(m_order.count());
+
+    for (const WId window : qAsConst(m_order)) {
+        replies.append({window, properties(m_cookies.value(window))});
+    }
+
+    m_order.clear();
+    m_cookies.clear();
+
+    return replies;
+}
+
+QVector<std::pair<WId, XWindowPropertyFetcher::Properties>> XWindowPropertyFetcher::takeArrivedReplies()
+{
+    QVector<std::pair<WId, Properties>> replies;
+    int taken = 0;
+
+    for (; taken < m_order.count(); ++taken) {
+        const WId window = m_order.at(taken);
+        const Cookies cookies = m_cookies.value(window);
+
+        // Replies come in the order of the requests, so once the one for the
+        // last request of a window is there, so are the others.
+        void *transientFor = nullptr;
+
+        if (!xcb_poll_for_reply(m_connection, cookies.transientFor.sequence, &transientFor, nullptr)) {
+            break;
+        }
+
+        replies.append({window, properties(cookies, static_cast<xcb_get_property_reply_t *>(transientFor))});
+        m_cookies.remove(window);
+    }
+
+    m_order.remove(0, taken);
+
+    return replies;
+}
+
+void XWindowPropertyFetcher::discard(const Cookies &cookies)
+{
+    xcb_discard_reply(m_connection, cookies.windowType.sequence);
+    xcb_discard_reply(m_connection, cookies.state.sequence);
+    xcb_discard_reply(m_connection, cookies.transientFor.sequence);
+}
+
+XWindowPropertyFetcher::Properties XWindowPropertyFetcher::properties(const Cookies &cookies, xcb_get_property_reply_t *transientForReply)
+{
+    Properties properties;
+
+    QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> windowType(xcb_get_property_reply(m_connection, cookies.windowType, nullptr));
+    QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> state(xcb_get_property_reply(m_connection, cookies.state, nullptr));
+    QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> transientFor(
+        transientForReply ? transientForReply : xcb_get_property_reply(m_connection, cookies.transientFor, nullptr));
+
+    if (windowType && windowType->type == XCB_ATOM_ATOM && windowType->format == 32) {
+        const auto types = static_cast<const xcb_atom_t *>(xcb_get_property_value(windowType.data()));
+        const int count = xcb_get_property_value_length(windowType.data()) / sizeof(xcb_atom_t);
+
+        // Like KWindowInfo::windowType(), skip types not asked for.
+        for (int i = 0; i < count; ++i) {
+            const xcb_atom_t *known = std::find(m_atoms + TypeNormal, m_atoms + AtomCount, types[i]);
+
+            if (types[i] != XCB_ATOM_NONE && known != m_atoms + AtomCount) {
+                properties.isTaskType = (known < m_atoms + TypeDesktop);
+                break;
+            }
+        }
+    }
+
+    if (state && state->type == XCB_ATOM_ATOM && state->format == 32) {
+        const auto states = static_cast<const xcb_atom_t *>(xcb_get_property_value(state.data()));
+        const int count = xcb_get_property_value_length(state.data()) / sizeof(xcb_atom_t);
+
+        properties.demandsAttention = std::find(states, states + count, m_atoms[StateDemandsAttention]) != states + count;
+    }
+
+    if (transientFor && transientFor->type == XCB_ATOM_WINDOW && transientFor->format == 32 && xcb_get_property_value_length(transientFor.data()) >= 4) {
+        properties.transientFor = *static_cast<const xcb_window_t *>(xcb_get_property_value(transientFor.data()));
+    }
+
+    return properties;
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+    SPDX-FileCopyrightText: 2021 Plasma Development Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#pragma once
+
+#include <QHash>
+#include <QVector>
+#include <qwindowdefs.h>
+
+#include <xcb/xcb.h>
+
+#include <utility>
+
+namespace TaskManager
+{
+/*
+ * Fetches what XWindowTasksModel needs to know about windows as they appear
+ * or their transient relationships change, for many windows at once.
+ *
+ * The requests for a window are sent as soon as it is requested, without
+ * waiting for replies. The replies are collected in one go later on, either
+ * those which arrived by then or all of them; there is no round trip per
+ * window, unlike with KWindowInfo.
+ */
+class XWindowPropertyFetcher
+{
+public:
+    struct Properties {
+        /**
+         * Whether the window type makes the window a task; the first type
+         * KWindowInfo::windowType() knows about is one of Normal, Dialog,
+         * Utility or Override, or it has none.
+         */
+        bool isTaskType = true;
+        bool demandsAttention = false;
+        WId transientFor = XCB_WINDOW_NONE;
+    };
+
+    XWindowPropertyFetcher();
+    ~XWindowPropertyFetcher();
+
+    /**
+     * Sends the requests for @p window, replacing those sent before.
+     */
+    void request(WId window);
+    /**
+     * Drops the requests for @p window, if any.
+     */
+    void cancel(WId window);
+
+    bool isPending(WId window) const;
+    bool isEmpty() const;
+
+    /**
+     * Collects the replies for all requested windows, in the order they were
+     * first requested, waiting for those that did not arrive yet.
+     */
+    QVector<std::pair<WId, Properties>> takeReplies();
+    /**
+     * Collects the replies for the windows requested first whose replies
+     * all arrived, without waiting. The others stay pending.
+     */
+    QVector<std::pair<WId, Properties>> takeArrivedReplies();
+
+private:
+    struct Cookies {
+        xcb_get_property_cookie_t windowType;
+        xcb_get_property_cookie_t state;
+        xcb_get_property_cookie_t transientFor;
+    };
+
+    enum Atom {
+        WindowType = 0,
+        State,
+        StateDemandsAttention,
+        // Window types, see isTaskType.
+        TypeNormal,
+        TypeDialog,
+        TypeUtility,
+        TypeOverride,
+        TypeDesktop,
+        TypeDock,
+        TypeToolbar,
+        TypeMenu,
+        TypeTopMenu,
+        TypeSplash,
+        AtomCount,
+    };
+
+    void discard(const Cookies &cookies);
+    /**
+     * @param transientFor The reply to cookies.transientFor if it was taken already
+     */
+    Properties properties(const Cookies &cookies, xcb_get_property_reply_t *transientFor = nullptr);
+
+    xcb_connection_t *m_connection = nullptr;
+    xcb_atom_t m_atoms[AtomCount];
+    QVector<WId> m_order;
+    QHash<WId, Cookies> m_cookies;
+};
+
+}
@@ -9,42 +9,175 @@
 #include <QDebug>
 #include <QTimerEvent>
 
+#include <algorithm>
+#include <limits>
+
 #define BATCH_TIME 10
+// Minimum time between two relayed changes of the same window, unless they are urgent.
+#define WINDOW_INTERVAL 100
+// Likewise, for windows in the background which only changed their names.
+#define BACKGROUND_NAME_INTERVAL 1000
 
-static const NET::Properties s_cachableProperties = NET::WMName | NET::WMVisibleName;
-static const NET::Properties2 s_cachableProperties2 = NET::WM2UserTime;
+static const NET::Properties s_nameProperties = NET::WMName | NET::WMVisibleName | NET::WMIconName | NET::WMVisibleIconName;
+static const NET::Properties s_cachableProperties = s_nameProperties | NET::WMGeometry | NET::WMFrameExtents | NET::WMIcon;
+static const NET::Properties2 s_cachableProperties2 = NET::WM2UserTime | NET::WM2Opacity;
 
 XWindowSystemEventBatcher::XWindowSystemEventBatcher(QObject *parent)
     : QObject(parent)
 {
-    connect(KWindowSystem::self(), &KWindowSystem::windowAdded, this, &XWindowSystemEventBatcher::windowAdded);
+    m_clock.start();
+    m_activeWindow = KWindowSystem::activeWindow();
 
-    // remove our cache entries when we lose a window, otherwise we might fire change signals after a window is destroyed which wouldn't make sense
-    connect(KWindowSystem::self(), &KWindowSystem::windowRemoved, this, [this](WId wid) {
-        m_cache.remove(wid);
-        emit windowRemoved(wid);
-    });
+    connect(KWindowSystem::self(), &KWindowSystem::windowAdded, this, &XWindowSystemEventBatcher::addWindow);
+    connect(KWindowSystem::self(), &KWindowSystem::windowRemoved, this, &XWindowSystemEventBatcher::removeWindow);
+    connect(KWindowSystem::self(), &KWindowSystem::activeWindowChanged, this, &XWindowSystemEventBatcher::activeWindowChanged);
 
     void (KWindowSystem::*myWindowChangeSignal)(WId window, NET::Properties properties, NET::Properties2 properties2) = &KWindowSystem::windowChanged;
-    QObject::connect(KWindowSystem::self(), myWindowChangeSignal, this, [this](WId window, NET::Properties properties, NET::Properties2 properties2) {
-        // if properties contained only cachable flags
-        if ((properties | s_cachableProperties) == s_cachableProperties && (properties2 | s_cachableProperties2) == s_cachableProperties2) {
-            m_cache[window].properties |= properties;
-            m_cache[window].properties2 |= properties2;
-            if (!m_timerId) {
-                m_timerId = startTimer(BATCH_TIME);
-            }
+    QObject::connect(KWindowSystem::self(), myWindowChangeSignal, this, &XWindowSystemEventBatcher::changeWindow);
+}
+
+QVariantMap XWindowSystemEventBatcher::statistics() const
+{
+    return QVariantMap{{QStringLiteral("windowsAddedIn"), m_added.in},
+                       {QStringLiteral("windowsAddedOut"), m_added.out},
+                       {QStringLiteral("windowsRemovedIn"), m_removed.in},
+                       {QStringLiteral("windowsRemovedOut"), m_removed.out},
+                       {QStringLiteral("windowsChangedIn"), m_changed.in},
+                       {QStringLiteral("windowsChangedOut"), m_changed.out}};
+}
+
+void XWindowSystemEventBatcher::addWindow(WId window)
+{
+    ++m_added.in;
+
+    if (m_pendingAdds.contains(window)) {
+        return;
+    }
+
+    if (m_pendingAdds.isEmpty()) {
+        m_addsDue = m_clock.elapsed() + BATCH_TIME;
+    }
+
+    m_pendingAdds.append(window);
+    scheduleTimer();
+}
+
+void XWindowSystemEventBatcher::removeWindow(WId window)
+{
+    ++m_removed.in;
+
+    // remove our cache entries when we lose a window, otherwise we might fire change signals after a window is destroyed which wouldn't make sense
+    m_cache.remove(window);
+    m_lastChange.remove(window);
+
+    // a window that is gone before it was relayed was never there
+    if (m_pendingAdds.removeOne(window)) {
+        return;
+    }
+
+    ++m_removed.out;
+    emit windowRemoved(window);
+}
+
+void XWindowSystemEventBatcher::changeWindow(WId window, NET::Properties properties, NET::Properties2 properties2)
+{
+    ++m_changed.in;
+
+    // a window yet to be relayed is read in full once it is
+    if (m_pendingAdds.contains(window)) {
+        return;
+    }
+
+    // if properties contained only cachable flags
+    if ((properties | s_cachableProperties) == s_cachableProperties && (properties2 | s_cachableProperties2) == s_cachableProperties2) {
+        AllProps &props = m_cache[window];
+        const qint64 due = dueTime(window, properties);
+
+        if (!props.properties && !props.properties2) {
+            props.due = due;
         } else {
-            // submit all caches along with any real updates
-            auto it = m_cache.constFind(window);
-            if (it != m_cache.constEnd()) {
-                properties |= it->properties;
-                properties2 |= it->properties2;
-                m_cache.erase(it);
-            }
-            emit windowChanged(window, properties, properties2);
+            props.due = std::min(props.due, due);
+        }
+
+        props.properties |= properties;
+        props.properties2 |= properties2;
+        scheduleTimer();
+    } else {
+        // submit all caches along with any real updates
+        auto it = m_cache.constFind(window);
+        if (it != m_cache.constEnd()) {
+            properties |= it->properties;
+            properties2 |= it->properties2;
+            m_cache.erase(it);
+        }
+        emitWindowChanged(window, properties, properties2);
+    }
+}
+
+void XWindowSystemEventBatcher::activeWindowChanged(WId window)
+{
+    m_activeWindow = window;
+
+    // bring the name of the window the user just switched to up to date soon
+    auto it = m_cache.find(window);
+    if (it != m_cache.end()) {
+        it->due = std::min(it->due, dueTime(window, it->properties));
+        scheduleTimer();
+    }
+}
+
+void XWindowSystemEventBatcher::emitWindowChanged(WId window, NET::Properties properties, NET::Properties2 properties2)
+{
+    m_lastChange[window] = m_clock.elapsed();
+    ++m_changed.out;
+    emit windowChanged(window, properties, properties2);
+}
+
+qint64 XWindowSystemEventBatcher::dueTime(WId window, NET::Properties properties) const
+{
+    int interval = WINDOW_INTERVAL;
+
+    if (window != m_activeWindow && (properties | s_nameProperties) == s_nameProperties) {
+        interval = BACKGROUND_NAME_INTERVAL;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    const auto it = m_lastChange.constFind(window);
+
+    if (it == m_lastChange.constEnd()) {
+        return now + BATCH_TIME;
+    }
+
+    return std::max(now + BATCH_TIME, *it + interval);
+}
+
+void XWindowSystemEventBatcher::scheduleTimer()
+{
+    qint64 due = std::numeric_limits<qint64>::max();
+
+    if (!m_pendingAdds.isEmpty()) {
+        due = m_addsDue;
+    }
+
+    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it) {
+        due = std::min(due, it->due);
+    }
+
+    if (m_timerId) {
+        if (due == m_timerDue) {
+            return;
         }
-    });
+
+        killTimer(m_timerId);
+        m_timerId = 0;
+    }
+
+    if (due == std::numeric_limits<qint64>::max()) {
+        return;
+    }
+
+    m_timerDue = due;
+    m_timerId = startTimer(int(std::max<qint64>(0, due - m_clock.elapsed())));
 }
 
 void XWindowSystemEventBatcher::timerEvent(QTimerEvent *event)
@@ -52,10 +185,35 @@ void XWindowSystemEventBatcher::timerEvent(QTimerEvent *event)
     if (event->timerId() != m_timerId) {
         return;
     }
-    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); it++) {
-        emit windowChanged(it.key(), it.value().properties, it.value().properties2);
-    };
-    m_cache.clear();
     killTimer(m_timerId);
     m_timerId = 0;
+
+    const qint64 now = m_clock.elapsed();
+
+    // take everything that is due before relaying any of it, handlers may call back into KWindowSystem
+    QVector<WId> added;
+    if (!m_pendingAdds.isEmpty() && m_addsDue <= now) {
+        added.swap(m_pendingAdds);
+    }
+
+    QVector<std::pair<WId, AllProps>> changed;
+    for (auto it = m_cache.begin(); it != m_cache.end();) {
+        if (it->due <= now) {
+            changed.append({it.key(), *it});
+            it = m_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const WId window : qAsConst(added)) {
+        ++m_added.out;
+        emit windowAdded(window);
+    }
+
+    for (const auto &change : qAsConst(changed)) {
+        emitWindowChanged(change.first, change.second.properties, change.second.properties2);
+    }
+
+    scheduleTimer();
 }
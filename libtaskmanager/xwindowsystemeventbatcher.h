@@ -9,16 +9,35 @@
 #include <QObject>
 
 #include <KWindowSystem>
+#include <QElapsedTimer>
 #include <QHash>
+#include <QVariantMap>
+#include <QVector>
 
 /*
  * Relay class for KWindowSystem events that batches updates
+ *
+ * State changes the user sees right away (e.g. minimizing, demanding attention)
+ * are relayed immediately. Property changes which tend to come in bursts, such
+ * as titles updated by terminals or media players, are merged and relayed at
+ * most once per interval for each window; for windows in the background, name
+ * changes are held back longer. New windows are relayed with the next batch,
+ * so windows which are gone again by then are never relayed at all.
  */
 class XWindowSystemEventBatcher : public QObject
 {
     Q_OBJECT
+
+    Q_PROPERTY(QVariantMap statistics READ statistics)
+
 public:
     XWindowSystemEventBatcher(QObject *parent);
+
+    /**
+     * Counts of the events received from KWindowSystem and of those relayed.
+     */
+    QVariantMap statistics() const;
+
 Q_SIGNALS:
     void windowAdded(WId window);
     void windowRemoved(WId window);
@@ -31,7 +50,34 @@ private:
     struct AllProps {
         NET::Properties properties = {};
         NET::Properties2 properties2 = {};
+        qint64 due = 0;
+    };
+
+    struct Counts {
+        quint64 in = 0;
+        quint64 out = 0;
     };
+
+    void addWindow(WId window);
+    void removeWindow(WId window);
+    void changeWindow(WId window, NET::Properties properties, NET::Properties2 properties2);
+    void activeWindowChanged(WId window);
+
+    void emitWindowChanged(WId window, NET::Properties properties, NET::Properties2 properties2);
+    qint64 dueTime(WId window, NET::Properties properties) const;
+    void scheduleTimer();
+
     QHash<WId, AllProps> m_cache;
+    QHash<WId, qint64> m_lastChange;
+    QVector<WId> m_pendingAdds;
+    qint64 m_addsDue = 0;
+    WId m_activeWindow = 0;
+
+    QElapsedTimer m_clock;
     int m_timerId = 0;
+    qint64 m_timerDue = 0;
+
+    Counts m_added;
+    Counts m_removed;
+    Counts m_changed;
 };
@@ -6,7 +6,10 @@
 */
 
 #include "xwindowtasksmodel.h"
+#include "cachedappdata.h"
+#include "debugstatistics_p.h"
 #include "tasktools.h"
+#include "xwindowpropertyfetcher.h"
 #include "xwindowsystemeventbatcher.h"
 
 #include <KDesktopFile>
@@ -30,6 +33,9 @@
 
 namespace TaskManager
 {
+// How often to look for property replies still on their way.
+static const int s_replyPollInterval = 5;
+
 static const NET::Properties windowInfoFlags =
     NET::WMState | NET::XAWMState | NET::WMDesktop | NET::WMVisibleName | NET::WMGeometry | NET::WMFrameExtents | NET::WMWindowType | NET::WMPid;
 static const NET::Properties2 windowInfoFlags2 =
@@ -49,21 +55,32 @@ public:
     QMultiHash<WId, WId> transientsDemandingAttention;
 
     QHash<WId, KWindowInfo *> windowInfoCache;
-    QHash<WId, AppData> appDataCache;
+    QHash<WId, CachedAppData> appDataCache;
     QHash<WId, QRect> delegateGeometries;
     QSet<WId> usingFallbackIcon;
     QHash<WId, QTime> lastActivated;
-    QList<WId> cachedStackingOrder;
+    // key=window, value=position in the stacking order
+    QHash<WId, int> stackingOrder;
     WId activeWindow = -1;
     KSharedConfig::Ptr rulesConfig;
     KDirWatch *configWatcher = nullptr;
     QTimer sycocaChangeTimer;
+    XWindowSystemEventBatcher *eventBatcher = nullptr;
+    XWindowPropertyFetcher propertyFetcher;
+    QTimer pendingWindowsTimer;
 
     void init();
+    void updateStackingOrder();
     void addWindow(WId window);
+    /**
+     * @param wait Whether to wait for replies that did not arrive yet, rather
+     * than leaving their windows for later.
+     */
+    void processPendingWindows(bool wait);
     void removeWindow(WId window);
     void windowChanged(WId window, NET::Properties properties, NET::Properties2 properties2);
     void transientChanged(WId window, NET::Properties properties, NET::Properties2 properties2);
+    void updateTransient(WId window, const XWindowPropertyFetcher::Properties &properties);
     void dataChanged(WId window, const QVector<int> &roles);
 
     KWindowInfo *windowInfo(WId window);
@@ -101,6 +118,7 @@ void XWindowTasksModel::Private::init()
         }
 
         appDataCache.clear();
+        usingFallbackIcon.clear();
 
         // Emit changes of all roles satisfied from app data cache.
         Q_EMIT q->dataChanged(q->index(0, 0),
@@ -114,13 +132,26 @@ void XWindowTasksModel::Private::init()
                                            AbstractTasksModel::SkipTaskbar});
     };
 
-    cachedStackingOrder = KWindowSystem::stackingOrder();
+    updateStackingOrder();
 
     sycocaChangeTimer.setSingleShot(true);
     sycocaChangeTimer.setInterval(100);
 
     QObject::connect(&sycocaChangeTimer, &QTimer::timeout, q, clearCacheAndRefresh);
 
+    // Collect the properties of the windows that appeared or changed in this
+    // event loop cycle in one go, without blocking on those yet to arrive.
+    pendingWindowsTimer.setSingleShot(true);
+    pendingWindowsTimer.setInterval(0);
+
+    QObject::connect(&pendingWindowsTimer, &QTimer::timeout, q, [this]() {
+        processPendingWindows(false);
+
+        if (!propertyFetcher.isEmpty()) {
+            pendingWindowsTimer.start(s_replyPollInterval);
+        }
+    });
+
     void (KSycoca::*myDatabaseChangeSignal)(const QStringList &) = &KSycoca::databaseChanged;
     QObject::connect(KSycoca::self(), myDatabaseChangeSignal, q, [this](const QStringList &changedResources) {
         if (changedResources.contains(QLatin1String("services")) || changedResources.contains(QLatin1String("apps"))
@@ -146,6 +177,7 @@ void XWindowTasksModel::Private::init()
     QObject::connect(configWatcher, &KDirWatch::deleted, rulesConfigChange);
 
     auto windowSystem = new XWindowSystemEventBatcher(q);
+    eventBatcher = windowSystem;
 
     QObject::connect(windowSystem, &XWindowSystemEventBatcher::windowAdded, q, [this](WId window) {
         addWindow(window);
@@ -185,8 +217,7 @@ void XWindowTasksModel::Private::init()
     });
 
     QObject::connect(KWindowSystem::self(), &KWindowSystem::stackingOrderChanged, q, [this]() {
-        cachedStackingOrder = KWindowSystem::stackingOrder();
-        Q_EMIT q->dataChanged(q->index(0, 0), q->index(q->rowCount() - 1, 0), QVector<int>{StackingOrder});
+        updateStackingOrder();
     });
 
     activeWindow = KWindowSystem::activeWindow();
@@ -195,6 +226,27 @@ void XWindowTasksModel::Private::init()
     foreach (const WId window, KWindowSystem::windows()) {
         addWindow(window);
     }
+
+    // The model starts out with all existing windows.
+    processPendingWindows(true);
+}
+
+void XWindowTasksModel::Private::updateStackingOrder()
+{
+    const QList<WId> &order = KWindowSystem::stackingOrder();
+
+    QHash<WId, int> oldStackingOrder;
+    oldStackingOrder.swap(stackingOrder);
+    stackingOrder.reserve(order.count());
+
+    for (int i = 0; i < order.count(); ++i) {
+        stackingOrder.insert(order.at(i), i);
+    }
+
+    q->stackingOrderChanged([this, &oldStackingOrder](int row) {
+        const WId window = windows.at(row);
+        return oldStackingOrder.value(window, -1) != stackingOrder.value(window, -1);
+    });
 }
 
 void XWindowTasksModel::Private::addWindow(WId window)
@@ -204,39 +256,74 @@ void XWindowTasksModel::Private::addWindow(WId window)
         return;
     }
 
-    KWindowInfo info(window, NET::WMWindowType | NET::WMState | NET::WMName | NET::WMVisibleName, NET::WM2TransientFor);
+    propertyFetcher.request(window);
+    pendingWindowsTimer.start(0);
+}
 
-    NET::WindowType wType = info.windowType(NET::NormalMask | NET::DesktopMask | NET::DockMask | NET::ToolbarMask | NET::MenuMask | NET::DialogMask
-                                            | NET::OverrideMask | NET::TopMenuMask | NET::UtilityMask | NET::SplashMask);
+void XWindowTasksModel::Private::processPendingWindows(bool wait)
+{
+    pendingWindowsTimer.stop();
 
-    const WId leader = info.transientFor();
+    if (propertyFetcher.isEmpty()) {
+        return;
+    }
+
+    const auto &replies = wait ? propertyFetcher.takeReplies() : propertyFetcher.takeArrivedReplies();
+
+    QVector<WId> newWindows;
+    QSet<WId> newWindowsSet;
 
-    // Handle transient.
-    if (leader > 0 && leader != window && leader != QX11Info::appRootWindow() && !transients.contains(window) && windows.contains(leader)) {
-        transients.insert(window, leader);
+    for (const auto &reply : replies) {
+        const WId window = reply.first;
+        const XWindowPropertyFetcher::Properties &properties = reply.second;
 
-        // Update demands attention state for leader.
-        if (info.hasState(NET::DemandsAttention) && windows.contains(leader)) {
-            transientsDemandingAttention.insertMulti(leader, window);
-            dataChanged(leader, QVector<int>{IsDemandingAttention});
+        if (transients.contains(window)) {
+            updateTransient(window, properties);
+            continue;
         }
 
-        return;
+        if (windows.contains(window) || newWindowsSet.contains(window)) {
+            continue;
+        }
+
+        const WId leader = properties.transientFor;
+
+        // Handle transient.
+        if (leader > 0 && leader != window && leader != QX11Info::appRootWindow() && (windows.contains(leader) || newWindowsSet.contains(leader))) {
+            transients.insert(window, leader);
+
+            // Update demands attention state for leader.
+            if (properties.demandsAttention) {
+                transientsDemandingAttention.insertMulti(leader, window);
+                dataChanged(leader, QVector<int>{IsDemandingAttention});
+            }
+
+            continue;
+        }
+
+        // Ignore NET::Tool and other special window types; they are not considered tasks.
+        if (!properties.isTaskType) {
+            continue;
+        }
+
+        newWindows.append(window);
+        newWindowsSet.insert(window);
     }
 
-    // Ignore NET::Tool and other special window types; they are not considered tasks.
-    if (wType != NET::Normal && wType != NET::Override && wType != NET::Unknown && wType != NET::Dialog && wType != NET::Utility) {
+    if (newWindows.isEmpty()) {
         return;
     }
 
     const int count = windows.count();
-    q->beginInsertRows(QModelIndex(), count, count);
-    windows.append(window);
+    q->beginInsertRows(QModelIndex(), count, count + newWindows.count() - 1);
+    windows.append(newWindows);
     q->endInsertRows();
 }
 
 void XWindowTasksModel::Private::removeWindow(WId window)
 {
+    propertyFetcher.cancel(window);
+
     const int row = windows.indexOf(window);
 
     if (row != -1) {
@@ -268,41 +355,33 @@ void XWindowTasksModel::Private::removeWindow(WId window)
 
 void XWindowTasksModel::Private::transientChanged(WId window, NET::Properties properties, NET::Properties2 properties2)
 {
-    // Changes to a transient's state might change demands attention state for leader.
-    if (properties & (NET::WMState | NET::XAWMState)) {
-        const KWindowInfo info(window, NET::WMState | NET::XAWMState, NET::WM2TransientFor);
-        const WId leader = info.transientFor();
+    // Changes to a transient's state or leader might change demands attention state for leader.
+    if (properties & (NET::WMState | NET::XAWMState) || properties2 & NET::WM2TransientFor) {
+        propertyFetcher.request(window);
+        pendingWindowsTimer.start(0);
+    }
+}
+
+void XWindowTasksModel::Private::updateTransient(WId window, const XWindowPropertyFetcher::Properties &properties)
+{
+    const WId oldLeader = transientsDemandingAttention.key(window, XCB_WINDOW_NONE);
+    const WId leader = properties.transientFor;
 
-        if (!windows.contains(leader)) {
+    if (properties.demandsAttention) {
+        if (leader == oldLeader || !windows.contains(leader)) {
             return;
         }
 
-        if (info.hasState(NET::DemandsAttention)) {
-            if (!transientsDemandingAttention.values(leader).contains(window)) {
-                transientsDemandingAttention.insertMulti(leader, window);
-                dataChanged(leader, QVector<int>{IsDemandingAttention});
-            }
-        } else if (transientsDemandingAttention.remove(window)) {
-            dataChanged(leader, QVector<int>{IsDemandingAttention});
+        if (oldLeader != XCB_WINDOW_NONE) {
+            transientsDemandingAttention.remove(oldLeader, window);
+            dataChanged(oldLeader, QVector<int>{IsDemandingAttention});
         }
-        // Leader might have changed.
-    } else if (properties2 & NET::WM2TransientFor) {
-        const KWindowInfo info(window, NET::WMState | NET::XAWMState, NET::WM2TransientFor);
-
-        if (info.hasState(NET::DemandsAttention)) {
-            const WId oldLeader = transientsDemandingAttention.key(window, XCB_WINDOW_NONE);
-
-            if (oldLeader != XCB_WINDOW_NONE) {
-                const WId leader = info.transientFor();
 
-                if (leader != oldLeader) {
-                    transientsDemandingAttention.remove(oldLeader, window);
-                    transientsDemandingAttention.insertMulti(leader, window);
-                    dataChanged(oldLeader, QVector<int>{IsDemandingAttention});
-                    dataChanged(leader, QVector<int>{IsDemandingAttention});
-                }
-            }
-        }
+        transientsDemandingAttention.insertMulti(leader, window);
+        dataChanged(leader, QVector<int>{IsDemandingAttention});
+    } else if (oldLeader != XCB_WINDOW_NONE) {
+        transientsDemandingAttention.remove(oldLeader, window);
+        dataChanged(oldLeader, QVector<int>{IsDemandingAttention});
     }
 }
 
@@ -313,8 +392,19 @@ void XWindowTasksModel::Private::windowChanged(WId window, NET::Properties prope
         return;
     }
 
+    // Windows yet to be added are read once their properties arrived; only
+    // make sure these are up to date.
+    if (propertyFetcher.isPending(window)) {
+        if (properties & (NET::WMState | NET::WMWindowType) || properties2 & NET::WM2TransientFor) {
+            propertyFetcher.request(window);
+        }
+
+        return;
+    }
+
     bool wipeInfoCache = false;
     bool wipeAppDataCache = false;
+    bool wipeFallbackIcon = false;
     QVector<int> changedRoles;
 
     if (properties & (NET::WMPid) || properties2 & (NET::WM2DesktopFileName | NET::WM2WindowClass)) {
@@ -329,7 +419,7 @@ void XWindowTasksModel::Private::windowChanged(WId window, NET::Properties prope
     }
 
     if ((properties & NET::WMIcon) && usingFallbackIcon.contains(window)) {
-        wipeAppDataCache = true;
+        wipeFallbackIcon = true;
 
         if (!changedRoles.contains(Qt::DecorationRole)) {
             changedRoles << Qt::DecorationRole;
@@ -385,6 +475,16 @@ void XWindowTasksModel::Private::windowChanged(WId window, NET::Properties prope
 
     if (wipeAppDataCache) {
         appDataCache.remove(window);
+        usingFallbackIcon.remove(window);
+    } else if (wipeFallbackIcon) {
+        // Only the icon came from the window; have icon() fetch it again once
+        // asked for, rather than resolving the app data anew.
+        auto it = appDataCache.find(window);
+
+        if (it != appDataCache.end()) {
+            it->data().icon = QIcon();
+        }
+
         usingFallbackIcon.remove(window);
     }
 
@@ -424,28 +524,22 @@ AppData XWindowTasksModel::Private::appData(WId window)
     const auto &it = appDataCache.constFind(window);
 
     if (it != appDataCache.constEnd()) {
-        return *it;
+        return it->data();
     }
 
-    const AppData &data = appDataFromUrl(windowUrl(window));
+    CachedAppData data(windowUrl(window));
 
     // If we weren't able to derive a launcher URL from the window meta data,
     // fall back to WM_CLASS Class string as app id. This helps with apps we
     // can't map to an URL due to existing outside the regular system
     // environment, e.g. wine clients.
-    if (data.id.isEmpty() && data.url.isEmpty()) {
-        AppData dataCopy = data;
-
-        dataCopy.id = windowInfo(window)->windowClassClass();
-
-        appDataCache.insert(window, dataCopy);
-
-        return dataCopy;
+    if (data.data().id.isEmpty() && data.data().url.isEmpty()) {
+        data.data().id = windowInfo(window)->windowClassClass();
     }
 
     appDataCache.insert(window, data);
 
-    return data;
+    return data.data();
 }
 
 QString XWindowTasksModel::Private::appMenuServiceName(WId window)
@@ -475,7 +569,7 @@ QIcon XWindowTasksModel::Private::icon(WId window)
     icon.addPixmap(KWindowSystem::icon(window, KIconLoader::SizeMedium, KIconLoader::SizeMedium, false));
     icon.addPixmap(KWindowSystem::icon(window, KIconLoader::SizeLarge, KIconLoader::SizeLarge, false));
 
-    appDataCache[window].icon = icon;
+    appDataCache[window].data().icon = icon;
     usingFallbackIcon.insert(window);
 
     return icon;
@@ -676,7 +770,7 @@ QVariant XWindowTasksModel::data(const QModelIndex &index, int role) const
     } else if (role == AppPid) {
         return d->windowInfo(window)->pid();
     } else if (role == StackingOrder) {
-        return d->cachedStackingOrder.indexOf(window);
+        return d->stackingOrder.value(window, -1);
     } else if (role == LastActivated) {
         if (d->lastActivated.contains(window)) {
             return d->lastActivated.value(window);
@@ -1121,4 +1215,9 @@ QList<WId> XWindowTasksModel::winIdsFromMimeData(const QMimeData *mimeData, bool
     return ids;
 }
 
+QVariantMap DebugStatistics::of(const XWindowTasksModel *model)
+{
+    return model->d->eventBatcher->statistics();
+}
+
 }
@@ -223,6 +223,7 @@ public:
 
 private:
     class Private;
+    friend class DebugStatistics;
     QScopedPointer<Private> d;
 };
 